@@ -0,0 +1,85 @@
+/*
+  This file is part of the ELEV-8 Flight Controller Firmware
+  for Parallax part #80204, Revisions A & B
+  
+  Copyright 2016 Parallax Incorporated
+
+  ELEV-8 Flight Controller Firmware is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free Software Foundation, 
+  either version 3 of the License, or (at your option) any later version.
+
+  ELEV-8 Flight Controller Firmware is distributed in the hope that it will be useful, but 
+  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with the ELEV-8 Flight Controller Firmware.  If not, see <http://www.gnu.org/licenses/>.
+  
+  Written by Jason Dorie
+*/
+
+#include <propeller.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "blackbox.h"
+#include "serial_4x.h"
+
+u16 Checksum(u16 checksum, u16 * buf , int len );   // from CommLink
+
+
+// Version, update rate, frame size, then name:type[count] for each field in BLACKBOX_FRAME, in order
+static const char BlackboxHeader[] =
+  "E8BB 1 250 84 sync:u16,counter:u16,altiest:s32,gyro:s16[3],accel:s16[3],radio:s16[9],"
+  "pid_roll:s16[4],pid_pitch:s16[4],pid_yaw:s16[4],alt_out:s16,ascent_out:s16,motor:s16[4],"
+  "cycles:u16,flags:u16,noise_hz:u16,checksum:u16\n";
+
+static BLACKBOX_FRAME Frames[2];              // Main loop fills one while the logger cog sends the other
+static volatile int   FrameSeq = 0;           // Incremented for each committed frame, low bit is the one to send
+static volatile char  HeaderPending = 0;
+
+static int blackbox_stack[BLACKBOX_STACK_SIZE];
+
+
+static void Blackbox_Thread( void * par )
+{
+  int lastSeq = FrameSeq;
+
+  while( true )
+  {
+    while( FrameSeq == lastSeq )
+      ;
+    lastSeq = FrameSeq;
+
+    if( HeaderPending ) {
+      S4_Put_Bytes( BLACKBOX_PORT, (void*)BlackboxHeader, sizeof(BlackboxHeader)-1 );
+      HeaderPending = 0;
+    }
+
+    BLACKBOX_FRAME * f = &Frames[lastSeq & 1];
+    f->Checksum = Checksum( 0, (u16*)f, offsetof(BLACKBOX_FRAME, Checksum) / 2 );
+    S4_Put_Bytes( BLACKBOX_PORT, f, sizeof(BLACKBOX_FRAME) );
+  }
+}
+
+
+void Blackbox_Start(void)
+{
+  Frames[0].Sync = Frames[1].Sync = BLACKBOX_SYNC;
+  cogstart( &Blackbox_Thread , NULL, blackbox_stack, sizeof(blackbox_stack) );
+}
+
+void Blackbox_NewLog(void)
+{
+  HeaderPending = 1;
+}
+
+BLACKBOX_FRAME * Blackbox_Frame(void)
+{
+  return &Frames[(FrameSeq + 1) & 1];
+}
+
+void Blackbox_Commit(void)
+{
+  FrameSeq++;
+}
@@ -0,0 +1,63 @@
+#ifndef __BLACKBOX_H__
+#define __BLACKBOX_H__
+
+/*
+  This file is part of the ELEV-8 Flight Controller Firmware
+  for Parallax part #80204, Revisions A & B
+  
+  Copyright 2016 Parallax Incorporated
+
+  ELEV-8 Flight Controller Firmware is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free Software Foundation, 
+  either version 3 of the License, or (at your option) any later version.
+
+  ELEV-8 Flight Controller Firmware is distributed in the hope that it will be useful, but 
+  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or 
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with the ELEV-8 Flight Controller Firmware.  If not, see <http://www.gnu.org/licenses/>.
+  
+  Written by Jason Dorie
+*/
+
+#include "elev8types.h"
+
+// Binary flight data logger.  The main loop fills in one frame per iteration and commits it, and
+// a separate cog adds the checksum and writes it to the logging serial port.  Each log starts with
+// a text header line describing the frame layout, so the decoder doesn't need to match firmware versions.
+
+#define BLACKBOX_PORT   3
+#define BLACKBOX_BAUD   230400      // 84 byte frames at 250hz is 21000 bytes/sec, 91% of this rate
+#define BLACKBOX_SYNC   0xBB55
+
+// Must match the field list in BlackboxHeader, and stay a multiple of 4 bytes.  Pad isn't in the
+// header - the decoder rounds the field sizes up to 4 itself.
+struct BLACKBOX_FRAME {
+  u16   Sync;           // BLACKBOX_SYNC
+  u16   Counter;        // Low 16 bits of the main loop counter - gaps mean dropped frames
+  long  AltiEst;
+  short Gyro[3];
+  short Accel[3];
+  short Radio[9];       // Thro, Aile, Elev, Rudd, Gear, Aux1, Aux2, Aux3, Aux4
+  short RollPID[4];     // P error, I error, D error, Output
+  short PitchPID[4];
+  short YawPID[4];
+  short AltOut, AscentOut;
+  short Motor[4];
+  u16   LoopCycles;     // Length of the previous loop iteration, in units of 64 clocks
+  u16   Flags;          // FlightMode, ControlMode << 4, IsHolding << 8
+  u16   NoiseHz;        // Gyro notch center from the noise tracker, 0 if the notch is off
+  u16   Checksum;       // Filled in by the logger cog
+  u16   Pad;            // Always 0, so the log doesn't carry stray bytes
+};
+
+
+void Blackbox_Start(void);
+void Blackbox_NewLog(void);                   // Call when logging starts, to send the header first
+BLACKBOX_FRAME * Blackbox_Frame(void);        // The frame to fill in this iteration
+void Blackbox_Commit(void);                   // Hand the frame to the logger cog
+
+#define BLACKBOX_STACK_SIZE (32 + 40)         // stack needs to accomodate thread control structure (40) plus room for functions (32)
+
+#endif
@@ -26,6 +26,11 @@ u16 COMMLINK::packetChecksum;
 u8  COMMLINK::packetBuf[64];
 u8  COMMLINK::bufIndex;
 
+char   COMMLINK::txPort;
+char * COMMLINK::txBuf;
+int    COMMLINK::txSize;
+int    COMMLINK::txIndex;
+
 u16 Checksum(u16 checksum, u16 * buf , int len );
 
 
@@ -67,11 +72,58 @@ void COMMLINK::AddPacketData( void * data , u16 Count )
 
 void COMMLINK::EndPacket(void)
 {
+  if( bufIndex & 1 ) {
+    packetBuf[bufIndex++] = 0;    // The checksum is done on u16's, so pad to an even length
+  }
+  ((u16*)packetBuf)[2] = bufIndex + 2;   // Actual length, including the checksum - compact packets aren't known up front
+
   packetChecksum = Checksum( 0, (u16*)packetBuf, bufIndex>>1 );
   memcpy( packetBuf + bufIndex, &packetChecksum, 2 );
   bufIndex += 2;
 }
 
+void COMMLINK::AddPacketVarInt( int value )
+{
+  u32 v = ((u32)value << 1) ^ (value >> 31);   // zig-zag : 0, -1, 1, -2, 2... becomes 0, 1, 2, 3, 4...
+
+  while( v >= 0x80 ) {
+    packetBuf[bufIndex++] = v | 0x80;     // low 7 bits first, high bit set means more bytes follow
+    v >>= 7;
+  }
+  packetBuf[bufIndex++] = v;
+}
+
+void COMMLINK::AddPacketQuat( float * q )
+{
+  // Send the index of the largest component, and the other three as signed 16 bit values.  The largest is
+  // rebuilt on the other end from the unit length.  Since it's the largest, the rest must be within +/- 1/sqrt(2),
+  // so they're scaled up by sqrt(2) to use the full range.  q and -q are the same rotation, so the sign is
+  // flipped if needed to make the largest positive.
+  int * qi = (int *)q;
+  char largest = 0;
+  for( char i=1; i<4; i++ ) {
+    if( (qi[i] & 0x7fffffff) > (qi[largest] & 0x7fffffff) )   // Compare magnitudes as ints - much cheaper than float compares
+      largest = i;
+  }
+
+  const float Scale = 32767.0f * 1.41421356f;
+  float scale = (qi[largest] < 0) ? -Scale : Scale;
+
+  short out[4];
+  out[0] = largest;
+  char n = 1;
+  for( char i=0; i<4; i++ )
+  {
+    if( i == largest ) continue;
+    int v = (int)(q[i] * scale);
+    v = (v > 32767) ? 32767 : v;
+    v = (v < -32767) ? -32767 : v;
+    out[n++] = v;
+  }
+
+  AddPacketData( out, 8 );
+}
+
 void COMMLINK::BuildPacket( u8 type , void * data , u16 length )
 {
   StartPacket( type , length );
@@ -81,6 +133,51 @@ void COMMLINK::BuildPacket( u8 type , void * data , u16 length )
 
 
 
+char COMMLINK::Reserve( char port, u8 type, u16 length )
+{
+  cachedLength = length + 8;    // 2 byte signature, 2 byte type, 2 byte length, 2 byte checksum
+  txPort = port;
+
+  txIndex = S4_Reserve( port, cachedLength );
+  if( txIndex < 0 ) return 0;
+
+  txBuf = S4_Tx_Buffer( port );
+  txSize = S4_Tx_Size( port );
+
+  u16 buf[3];
+  buf[0] = 0xAA55;
+  buf[1] = type;
+  buf[2] = cachedLength;
+
+  packetChecksum = 0;
+  Write( buf, 6 );
+  return 1;
+}
+
+void COMMLINK::Write( void * data, u16 Count )
+{
+  packetChecksum = Checksum( packetChecksum, (u16*)data, Count>>1 );
+
+  int C = txSize - txIndex;     // Room before the end of the ring
+  if( C > Count ) C = Count;
+
+  memcpy( txBuf + txIndex, data, C );
+  if( Count > C ) {
+    memcpy( txBuf, (u8*)data + C, Count - C );    // Wrap to the head of the ring
+  }
+
+  txIndex += Count;
+  if( txIndex >= txSize ) txIndex -= txSize;
+}
+
+void COMMLINK::Commit(void)
+{
+  u16 check = packetChecksum;
+  Write( &check, 2 );
+  S4_Commit( txPort, txIndex );
+}
+
+
 u16 Checksum(u16 checksum, u16 * buf , int len )
 {
   for( int i=0; i<len; i++) {
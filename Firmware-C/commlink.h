@@ -52,16 +52,37 @@ public:
   static void AddPacketData( void * data , u16 Count );   // Incrementally add packet data as you like
   static void EndPacket(void);                            // Call this when the packet is finished to close it and send the CRC
 
+  // Compact encodings - packets using these are variable length, so EndPacket() fills in the final length
+  static void AddPacketVarInt( int value );               // Zig-zag varint, 1 to 5 bytes (small values of either sign are 1 byte)
+  static void AddPacketQuat( float * q );                 // "Smallest three" quaternion, 8 bytes instead of 16
+
   static void BuildPacket( u8 type , void * data , u16 length );
   static void SendPacket( char port ) {  // Sends the pre-built packet to the port
       S4_Put_Bytes( port, packetBuf, bufIndex );
   }
 
+  static u8 PacketLength(void) { return bufIndex; }     // Size of the pre-built packet, including header & checksum
+
+  // Zero-copy versions - the packet is written straight into the port's TX buffer, with no size limit beyond
+  // the buffer itself.  Reserve returns 0 immediately if the whole packet won't fit, otherwise the Writes can't
+  // fail, and nothing goes out until Commit.  Length and Counts must be even, as with AddPacketData.
+  static char Reserve( char port, u8 type, u16 length );
+  static void Write( void * data, u16 Count );
+  static void Commit(void);
+  static void Drop(void) {          // Call this instead if Reserve failed and the packet won't be tried again
+      S4_Tx_Drop( txPort, cachedLength );
+  }
+
 private:
   static u16 cachedLength;
   static u16 packetChecksum;
   static u8  packetBuf[64];
   static u8  bufIndex;
+
+  static char   txPort;
+  static char * txBuf;
+  static int    txSize;
+  static int    txIndex;
 };
 
 #endif
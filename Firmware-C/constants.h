@@ -31,6 +31,7 @@
 
 #define Const_UpdateRate  250
 #define Const_UpdateCycles (Const_ClockFreq / Const_UpdateRate)
+#define Const_GyroRate  952					//Must match the gyro output data rate set in sensors_driver.spin
 
 #define Const_OneG  4096					//Must match the scale of the accelerometer
 #define Const_Alti_UpdateRate  25			//Must match the update rate of the device  
@@ -30,6 +30,7 @@
 #include "elev8-main.h"         // Main thread functions and defines                            (Main thread takes 1 COG)
 #include "f32.h"                // 32 bit IEEE floating point math and stream processor         (1 COG)
 #include "intpid.h"             // Integer PID functions
+#include "noisetrack.h"         // Motor noise tracker, moves the gyro notch with motor speed     (1 COG, if enabled)
 
 #if defined(ENABLE_LASER_RANGE)
 #include "laserrange.h"         // Laser Rangefinder
@@ -44,20 +45,102 @@
 #include "serial_4x.h"          // 4 port simultaneous serial I/O                               (1 COG)
 #include "servo32_highres.h"    // 32 port, high precision / high rate PWM servo output driver  (1 COG)
 
-//#define ENABLE_LOGGING
+//#define ENABLE_LOGGING       // Binary flight data log on serial port 3 (PIN_MOTOR_AUX2)    (1 COG, if enabled)
 
 #ifdef ENABLE_LOGGING
+#include "blackbox.h"
 void DoLogOutput(void);
-void DataLogThread(void *par);
+#endif
 
-#define LOG_STACK_SIZE (16 + 40)      // stack needs to accomodate thread control structure (40) plus room for functions (16)
-static int log_stack[LOG_STACK_SIZE]; // allocate space for the stack - you need to set up a 
+//#define ENABLE_NOISE_TRACKER // Moves the gyro notch to follow motor noise, when the notch is on  (1 COG, if enabled)
 
-volatile char LogTrigger = 0;
+#if defined(ENABLE_NOISE_TRACKER) && defined(ENABLE_LOGGING) && defined(ENABLE_LASER_RANGE)
+#error - Not enough cogs for the noise tracker, logging, and the laser range finder at once
 #endif
 
-short UsbPulse = 0;     // Periodically, the GroundStation will ping the FC to say it's still there - these are countdowns
-short XBeePulse = 0;
+// Periodically, a GroundStation will ping the FC to say it's still there - these are countdowns for USB and XBee.
+// Each port is serviced for as long as its own heartbeat keeps arriving, so both can be connected at once.
+short PortPulse[2];
+
+
+// Telemetry scheduler - each stream is sent once every StreamPeriod update cycles (0 == off), as long
+// as the port has enough byte budget to carry it.  The budget accrues at the line rate of the port.
+#define USB_BAUD       115200
+#define USB_FAST_BAUD  230400   // Fastest the serial_4x cog sustains with all four ports running - see serial_4x_driver.spin
+#define XBEE_BAUD      57600
+
+#define USB_TX_SIZE    128      // Room for a full cycle of telemetry at USB_FAST_BAUD
+#define XBEE_TX_SIZE   64
+
+#define USB_BAUD_TIMEOUT  Const_UpdateRate    // Fall back to USB_BAUD after 1 second without a heartbeat or ping at the fast rate
+
+#define Port_BytesPerCycle(baud)  ((baud) / 10 / Const_UpdateRate)   // 10 bits per byte on the wire
+
+static short PortBytesPerCycle[2] = { Port_BytesPerCycle(USB_BAUD), Port_BytesPerCycle(XBEE_BAUD) };
+static const short PortMaxBudget[2] = { USB_TX_SIZE, XBEE_TX_SIZE };  // An idle port can't save up more than a buffer full
+
+static int   UsbBaud = USB_BAUD;      // Current USB rate - the host can negotiate USB_FAST_BAUD after connecting
+static short UsbBaudWatchdog;         // Cycles left at the fast rate before falling back, unless the host keeps talking.
+                                      // Also retries the serial cog if a restart couldn't get one.
+
+#define MAX_STREAM_PERIOD  Const_UpdateRate    // Slowest a stream can be asked for - once a second
+
+static const u8 DefaultStreamPeriod[2][Stream_Count] = {
+  {  8,  8,  8,  8,  8,  8,  8, 0 },   // USB  - 31.25 updates per second, at 250hz
+  { 16, 16, 16, 16, 16, 16, 16, 0 },   // XBee - ~15 updates per second, at 250hz
+};
+
+// Full packet sizes on the wire (payload + 8 bytes of header and checksum).  Compact packets are
+// variable length, so the compact table holds the worst case.
+#define IMU_BATCH_SIZE  (4 + IMU_BATCH_SAMPLES*12 + 8)
+
+static const char StreamPacketType[Stream_Count]  = { 1, 7, 2, 3, 5, 4, 6, 8 };
+static const char StreamPacketSize[Stream_Count]  = { 26+8, 12+8, 24+8,         16+8, 8+8, 24+8, 16+8, IMU_BATCH_SIZE };
+static const char CompactPacketSize[Stream_Count] = { 26+8, 12+8, 2+10*3+5+8,    8+8, 8+8, 24+8,  8+8, IMU_BATCH_SIZE };
+
+static char  CompactTelemetry[2];   // Set per port when the GroundStation asks for compact packets
+static char  SensorSeq[2];          // Compact sensor packet sequence number
+static short PrevSensors[2][10];    // Last sensor values sent on each port, for delta encoding
+static long  PrevSensorCounter[2];  // Main loop counter of the last sensor packet on each port, so the GroundStation knows the time step
+
+// Full rate gyro & accel capture.  Samples are gathered every cycle into BatchFill, and a full batch is
+// moved to BatchReady to wait for the scheduler.  If the link can't keep up, the older batch is dropped,
+// which the GroundStation sees as a jump in StartCounter.
+static struct IMU_BATCH {
+  long  StartCounter;                     // Main loop counter value of the first sample
+  short Samples[IMU_BATCH_SAMPLES][6];    // GyroX,Y,Z, AccelX,Y,Z
+} BatchFill, BatchReady;
+
+static char  BatchCount;
+static char  BatchIsReady;        // One bit per port - each port sends the ready batch once
+
+static u8    StreamPeriod[2][Stream_Count];      // Cycles between sends of each stream, 0 == off
+static u8    StreamCountdown[2][Stream_Count];
+static short PortBudget[2];       // Bytes each port is currently allowed to send
+
+// Preferences upload state.  The host sends UPrf, then the struct in sequence numbered chunks, each acknowledged
+// before the next is sent.  Chunks are assembled as bytes arrive, so the update loop never waits on the link.
+static struct PREFS_UPLOAD {
+  PREFS Temp;                     // Incoming prefs - only copied to Prefs once complete and the checksum matches
+  short Offset;                   // Bytes received and acknowledged so far
+  short Timeout;                  // Update cycles of silence before the upload is abandoned
+  char  Active;
+  char  Port;
+  char  State;                    // Chunk receive state, Chunk_Idle between chunks
+  char  Result;                   // Final status, repeated if the host resends the last chunk
+  unsigned char NextSeq;
+  unsigned char Seq, Length, Got, Sum;
+} Upload;
+
+enum CHUNK_STATE {
+  Chunk_Idle = 0,
+  Chunk_Seq,
+  Chunk_Length,
+  Chunk_Data,
+  Chunk_Sum,
+};
+
+#define PREFS_UPLOAD_TIMEOUT  (Const_UpdateRate * 2)
 
 
 // Potential new settings values
@@ -79,12 +162,18 @@ static struct CYCLESTATS {
   short AvgCycles;
 } Stats;
 
+static long BootCycles[Boot_Count];   // CNT cycles each part of Initialize() took
+static long BootMark;                 // CNT at the end of the last timed part
+static char BootCyclesSent;           // One bit per port, set once the boot times have gone out since the last connect
+
 
 //Sensor inputs, in order of outputs from the Sensors cog, so they can be bulk copied for speed
 static SENS sens;
+static long LastSampleTime;           // Timestamp of the samples used in the previous IMU update
 
 
 static long  GyroZX, GyroZY, GyroZZ;  // Gyro zero values
+static int   ZeroAccel[3], ZeroMag[3];// Accel and compass sums over the readings FindGyroZero() kept, for FindInitialOrientation()
 
 static long  AccelZSmooth;            // Smoothed (filtered) accelerometer Z value (used for height fluctuation damping)
 
@@ -96,7 +185,17 @@ static char   Quat[16];       //Current quaternion from the IMU functions
 static char Mode = MODE_None;         //Debug communication mode
 static signed char NudgeMotor = -1;   // Which motor to nudge during testing (-1 == no motor)
 static char NudgeCount[4];            // How long to spin the motor for (0 == stopped)
-static int HostCommandUSB, HostCommandXBee;
+
+// Host command receiver, one per port.  Bytes are shifted into Command until it matches a known
+// command, then any argument bytes that command takes are collected before it's dispatched.
+static struct HOST_RX {
+  int  Command;
+  char ArgsNeeded;
+  char ArgCount;
+  unsigned char Args[5];
+} HostRx[2];
+
+#define HOST_RX_CYCLES  (Const_UpdateCycles / 32)   // Most time to spend per cycle reading commands, for each port
 
 static long  AltiEst, AscentEst;                              // altitude estimate and ascent rate estimate
 static long  DesiredAltitude, DesiredAscentRate;              // desired values for altitude and ascent rate
@@ -108,7 +207,10 @@ static long  GyroRPFilter, GyroYawFilter;   // Tunable damping values for gyro n
 
 
 static short Motor[4];                     //Motor output values
-static long  LEDValue[LED_COUNT];           //LED outputs (copied to the LEDs by the Sensors cog)
+static struct {
+  long  Changes;                            //Bumped after Value changes, so the Sensors cog knows to resend them
+  long  Value[LED_COUNT];                   //LED outputs (copied to the LEDs by the Sensors cog)
+} LED;
 
 static long loopTimer;                      //Master flight loop counter - used to keep a steady update rate
 
@@ -123,7 +225,7 @@ static char ControlMode;
 static char IsHolding = 0;            // Are we currently in altitude hold? (hover mode)
 static char AllowThrottleCut = 1;     // < -1100 throttle is considered a system kill
 static char AllowRearm = 1;           // Will get moved into Prefs once tested
-static short StartupDelay;            //Used to change convergence rates for IMU, enable battery monitor
+static short StartupDelay;            //Used to enable battery monitor
 
 static char MotorPin[4] = {PIN_MOTOR_FL, PIN_MOTOR_FR, PIN_MOTOR_BR, PIN_MOTOR_BL };            //Motor index to pin index table
 
@@ -131,6 +233,16 @@ static long LEDModeColor;
 
 static short BatteryVolts = 0;
 
+// S-BUS and RemoteRX frames arrive every 7 to 22ms, so the radio inputs and control quaternion are only updated
+// when there's a new one.  PWM / PPM receivers have no frame count, and are treated as new every cycle.
+#define RADIO_MAX_CYCLES  8           // Longest gap the rate inputs are scaled up to cover - beyond that, the sticks are stale
+
+static long  RadioFrames;             // Receiver frame count last acted on
+static long  RadioFrameTime;          // CNT when that frame arrived
+static char  RadioCycles;             // Update cycles since the control quaternion was last updated
+static char  LatencyStage;            // Counts down to the cycle where a new frame reaches the motors
+static short RadioLatency;            // uS from the last frame arriving to the motor outputs that used it
+
 
 static char calib_StartQuadrant;
 static char calib_Quadrants;
@@ -159,36 +271,6 @@ void LaserRangeThread( void *par );
 #endif
 
 
-#ifdef ENABLE_LOGGING
-// Only used for debugging
-static const char * nibbleToAscii = "0123456789abcdef";
-
-static char LogInt( int x , char * dest )
-{
-  char buf[14];
-  char index = 13;
-  buf[index] = ',';   // Add the comma here for speed
-  char isNeg;
-  if( x < 0 ) {
-    isNeg = 1;
-    x = -x;
-  }    
-  else isNeg = 0;
-
-  do {
-    buf[--index] = nibbleToAscii[x & 15];
-    x >>= 4;
-  } while(x > 0);
-
-  if( isNeg ) {
-    buf[--index] = '-';
-  }    
-
-  char count = 14-index;
-  memcpy( dest, buf+index, count );
-  return count;
-}
-#endif
 
 
 static int abs(int v) {
@@ -205,6 +287,7 @@ int main()                                    // Main function
 
   //Grab the first set of sensor readings (should be ready by now)
   memcpy( &sens, Sensors_Address(), Sensors_ParamsSize );
+  LastSampleTime = sens.SampleTime;
 
   //Set a reasonable starting point for the altitude computation
   QuatIMU_SetInitialAltitudeGuess( sens.Alt );
@@ -225,18 +308,45 @@ int main()                                    // Main function
     //Read ALL inputs from the sensors into local memory, starting at Temperature
     memcpy( &sens, Sensors_Address(), Sensors_ParamsSize );
 
-    QuatIMU_Update( (int*)&sens.GyroX );        //Entire IMU takes ~125000 cycles
+    // Integrate over the time the samples actually cover.  The sensors produce slightly fewer outputs
+    // than the loop consumes, so a repeated set of samples is zero time, and a stall is capped.
+    int SampleCycles = sens.SampleTime - LastSampleTime;
+    LastSampleTime = sens.SampleTime;
+    if( SampleCycles > Const_ClockFreq/25 ) SampleCycles = Const_ClockFreq/25;
+
+    QuatIMU_Update( (int*)&sens.GyroX , SampleCycles );   //Entire IMU takes ~125000 cycles
+
+    // The IMU keeps refining the gyro zero as it runs - the rate PIDs use its latest estimate
+    int GyroZero[3];
+    QuatIMU_GetGyroZero( GyroZero );
+    GyroZX = GyroZero[0];
+    GyroZY = GyroZero[1];
+    GyroZZ = GyroZero[2];
+
     AccelZSmooth += (sens.AccelZ - AccelZSmooth) * Prefs.AccelCorrectionFilter / 256;
 
-    if( Prefs.ReceiverType & 1 ) // SBUS or RemoteRX?
+    char NewRadioFrame = 1;
+    if( RadioCycles < RADIO_MAX_CYCLES ) RadioCycles++;
+
+    if( Prefs.ReceiverType == 1 || Prefs.ReceiverType >= 3 ) // SBUS, RemoteRX, or CRSF?
     {
-      // Unrolling these loops saves about 10000 cycles, but costs a little over 1/2kb of code space
-      for( int i=0; i<8; i++ ) {
-        Radio.Channel(i) =  (SBUS::GetRC(Prefs.ChannelIndex(i)) - Prefs.ChannelCenter(i)) * Prefs.ChannelScale(i) / 1024;
-      }
+      long frames = SBUS::FrameCount();
+      NewRadioFrame = (frames != RadioFrames);
+
+      if( NewRadioFrame )
+      {
+        RadioFrames = frames;
+        RadioFrameTime = SBUS::FrameTime();
+        LatencyStage = 2;       // The control quaternion updates at the end of this cycle, and the motors use it next cycle
+
+        // Unrolling these loops saves about 10000 cycles, but costs a little over 1/2kb of code space
+        for( int i=0; i<8; i++ ) {
+          Radio.Channel(i) =  (SBUS::GetRC(Prefs.ChannelIndex(i)) - Prefs.ChannelCenter(i)) * Prefs.ChannelScale(i) / 1024;
+        }
 
-      // Extra raw channel for SBUS users, tuning, experimentation
-      Radio.Channel(8) =  ((SBUS::GetRC(8) + 32) * 1280) / 1024;  // Aux4
+        // Extra raw channel for SBUS users, tuning, experimentation
+        Radio.Channel(8) =  ((SBUS::GetRC(8) + 32) * 1280) / 1024;  // Aux4
+      }
     }
     else
     {
@@ -308,6 +418,11 @@ int main()                                    // Main function
       }
 
       UpdateFlightLoop();            //~72000 cycles when in flight mode
+
+      if( LatencyStage && --LatencyStage == 0 ) {
+        long us = (CNT - RadioFrameTime) / (Const_ClockFreq / 1000000);
+        RadioLatency = (us < 32767) ? us : 32767;
+      }
       //-------------------------------------------------
 
       // Sound travels approx 343m/sec in 20C air, but it varies with temperature and pressure (faster at higher temps or lower pressure).
@@ -332,16 +447,16 @@ int main()                                    // Main function
       #endif
     }
 
+#ifdef ENABLE_NOISE_TRACKER
+    // Motor speed hint for the noise tracker
+    NoiseTrack_SetThrottle( FlightEnabled ? (Motor[0] + Motor[1] + Motor[2] + Motor[3]) / 4 - Prefs.MinThrottle : 0 );
+#endif
 
     if( Prefs.UseBattMon )
     {
       if( StartupDelay > 0 ) {
         StartupDelay--;       // Count down until the startup delay has passed
         LEDModeColor = LED_Blue;
-
-        if( StartupDelay == 0 ) { // Did we JUST hit zero?
-          QuatIMU_SetErrScaleMode(0);   // No longer in power-up (fast-convergence) mode
-        }          
       }
       else
       {
@@ -362,7 +477,13 @@ int main()                                    // Main function
     QuatIMU_WaitForCompletion();    // Wait for the IMU to finish updating
 
 
-    QuatIMU_UpdateControls( &Radio , ControlMode == ControlMode_Manual , FlightMode == FlightMode_AutoManual );   // Now update the control quaternion
+    if( NewRadioFrame ) {
+      QuatIMU_UpdateControls( &Radio , ControlMode == ControlMode_Manual , FlightMode == FlightMode_AutoManual , RadioCycles );   // Now update the control quaternion
+      RadioCycles = 0;
+    }
+    else {
+      QuatIMU_UpdateOrientationChange();    // Same desired orientation, but we've moved
+    }
     QuatIMU_WaitForCompletion();
 
     PitchDifference = QuatIMU_GetPitchDifference();
@@ -376,13 +497,19 @@ int main()                                    // Main function
     CheckDebugInput();
     DoDebugModeOutput();
 
-#ifdef ENABLE_LOGGING
-    DoLogOutput();
-#endif
+    // Single param changes are written to EEPROM a page at a time, far enough apart that the
+    // EEPROM has finished the previous write, so this never has to wait on it
+    if( !FlightEnabled && (counter & 7) == 0 ) {
+      Prefs_SaveDirty();
+    }
 
     LoopCycles = CNT - Cycles;    // Record how long it took for one full iteration
     CycleCount[counter & 7] = LoopCycles / 64;
 
+#ifdef ENABLE_LOGGING
+    DoLogOutput();
+#endif
+
     ++counter;
     loopTimer += Const_UpdateCycles;
 
@@ -416,22 +543,27 @@ void Initialize(void)
   ControlMode = ControlMode_AutoLevel;
   Stats.Version = 0x0201;   // Version 2.0.1
 
-  InitSerial();
+  BootMark = CNT;
 
   All_LED( LED_Red & LED_Half );                         //LED red on startup
 
-  // Do this before settings are loaded, because Sensors_Start resets the drift coefficients to defaults
-  Sensors_Start( PIN_SDI, PIN_SDO, PIN_SCL, PIN_CS_AG, PIN_CS_M, PIN_CS_ALT, PIN_LED, (int)&LEDValue[0], LED_COUNT );
+  // The sensors cog goes first - it takes the longest to configure the sensors and produce readings, and
+  // everything else up to FindGyroZero() happens while it does.  It also has to be started before settings
+  // are loaded, because Sensors_Start resets the drift coefficients to defaults
+  Sensors_Start( PIN_SDI, PIN_SDO, PIN_SCL, PIN_CS_AG, PIN_CS_M, PIN_CS_ALT, PIN_LED, (int)&LED, LED_COUNT );
 
+  InitSerial();
   F32::Start();
   QuatIMU_Start();
-  QuatIMU_SetErrScaleMode(1);   // Start with the IMU in fast-converge mode (takes ~3 instead of ~26 seconds to converge)
+  BootPhaseDone( Boot_Cogs );
 
   InitializePrefs();
+  BootPhaseDone( Boot_Prefs );
+
   InitReceiver();
+  BootPhaseDone( Boot_Receiver );
 
   // Wait 2 seconds after startup to begin checking battery voltage, rounded to an integer multiple of 16 updates
-  // Also used to reduce convergence rate for the IMU (starts up with a high convergence rate)
   StartupDelay = (Const_UpdateRate * 2) & ~15;
 
 #ifdef __PINS_V3_H__
@@ -453,6 +585,7 @@ void Initialize(void)
   #endif
 
   Servo32_Start();
+  BootPhaseDone( Boot_Outputs );
 
   int RollPitch_P = 500;
   int RollPitch_D = 1560 * Const_UpdateRate;
@@ -500,25 +633,35 @@ void Initialize(void)
 
 
 #ifdef ENABLE_LOGGING
-  cogstart( &DataLogThread , NULL, log_stack, sizeof(log_stack) );
+  Blackbox_Start();
+#endif
+
+#ifdef ENABLE_NOISE_TRACKER
+  NoiseTrack_Start();
 #endif
 
 #if defined(EXTRA_LIGHTS)
-  LEDValue[3 +  0] = LED_Green;
-  LEDValue[4 +  0] = LED_Green;
-  LEDValue[5 +  0] = LED_Green;
-  LEDValue[3 +  5] = LED_Green;
-  LEDValue[4 +  5] = LED_Green;
-  LEDValue[5 +  5] = LED_Green;
-  LEDValue[3 + 10] = LED_Red;
-  LEDValue[4 + 10] = LED_Red;
-  LEDValue[5 + 10] = LED_Red;
-  LEDValue[3 + 15] = LED_Red;
-  LEDValue[4 + 15] = LED_Red;
-  LEDValue[5 + 15] = LED_Red;
+  LED.Value[3 +  0] = LED_Green;
+  LED.Value[4 +  0] = LED_Green;
+  LED.Value[5 +  0] = LED_Green;
+  LED.Value[3 +  5] = LED_Green;
+  LED.Value[4 +  5] = LED_Green;
+  LED.Value[5 +  5] = LED_Green;
+  LED.Value[3 + 10] = LED_Red;
+  LED.Value[4 + 10] = LED_Red;
+  LED.Value[5 + 10] = LED_Red;
+  LED.Value[3 + 15] = LED_Red;
+  LED.Value[4 + 15] = LED_Red;
+  LED.Value[5 + 15] = LED_Red;
+  LED.Changes++;
 #endif
-  
+  BootPhaseDone( Boot_PIDs );
+
   FindGyroZero();
+  BootPhaseDone( Boot_GyroZero );
+
+  FindInitialOrientation();
+  BootPhaseDone( Boot_Orientation );
 
 #ifdef ENABLE_LASER_RANGE
   cogstart( &LaserRangeThread , NULL, laser_stack, sizeof(laser_stack) );
@@ -526,6 +669,14 @@ void Initialize(void)
 }
 
 
+void BootPhaseDone( char phase )
+{
+  int now = CNT;
+  BootCycles[phase] = now - BootMark;
+  BootMark = now;
+}
+
+
 void InitReceiver(void)
 {
   RC::Stop();
@@ -543,39 +694,115 @@ void InitReceiver(void)
       break;
 
     case 1:
-      SBUS::Start( PIN_RC_0, false ); // SBUS mode
+      SBUS::Start( PIN_RC_0, SBUS::Futaba ); // SBUS mode
       break;
 
     case 3:
-      SBUS::Start( PIN_RC_0 , true ); // RemoteRX mode - DSM2/2048
+      SBUS::Start( PIN_RC_0 , SBUS::RemoteRX ); // RemoteRX mode - DSM2/2048
+      break;
+
+    case 4:
+      SBUS::Start( PIN_RC_0 , SBUS::CRSF ); // CRSF mode - Crossfire / ExpressLRS
       break;
   }
 }
 
 
-static char RXBuf1[32], TXBuf1[64];
-static char RXBuf2[32], TXBuf2[64];
+// Serial buffers are sized from the features using each port, so a port nothing is connected to costs
+// 8 bytes of hub RAM instead of a few hundred.  Sizes are passed to S4_Define_Port as a char, so 255 max.
+#define SERIAL_UNUSED_SIZE  4
+
+#define HOST_RX_SIZE  32              // Host commands - a full prefs chunk with its command and header fits
 
-#if 1 // Currently unused - these buffers might grow later
-static char RXBuf3[128],TXBuf3[4];  // GPS?
-static char RXBuf4[4],  TXBuf4[64]; // Data Logger
+#ifdef ENABLE_LASER_RANGE
+#define EXP_RX_SIZE   32              // Laser rangefinder - a few readings of ~8 characters
+#define EXP_TX_SIZE   4               // Single character ping
+#define EXP_TX_PIN    19              // PIN_EXP_TX on V3 boards
+#define EXP_RX_PIN    20
 #else
-static char RXBuf3[32], TXBuf3[4]; // laser rangefinder
-static char RXBuf4[4],  TXBuf4[4]; // Data Logger
+#define EXP_RX_SIZE   SERIAL_UNUSED_SIZE
+#define EXP_TX_SIZE   SERIAL_UNUSED_SIZE
+#define EXP_TX_PIN    32
+#define EXP_RX_PIN    32
 #endif
 
+#ifdef ENABLE_LOGGING
+#define LOG_TX_SIZE   128             // Room for more than one full frame
+#define LOG_TX_PIN    PIN_MOTOR_AUX2
+#define LOG_BAUD      BLACKBOX_BAUD
+typedef char LogBufferHoldsFrame[ (LOG_TX_SIZE > sizeof(BLACKBOX_FRAME)) ? 1 : -1 ];
+#else
+#define LOG_TX_SIZE   SERIAL_UNUSED_SIZE
+#define LOG_TX_PIN    32
+#define LOG_BAUD      115200
+#endif
+#define LOG_RX_SIZE   SERIAL_UNUSED_SIZE  // Transmit only
+
+#define SERIAL_STR_(x)  #x
+#define SERIAL_STR(x)   SERIAL_STR_(x)
+#pragma message( "Serial buffer hub RAM: USB " SERIAL_STR(HOST_RX_SIZE) "+" SERIAL_STR(USB_TX_SIZE) \
+                 ", XBee " SERIAL_STR(HOST_RX_SIZE) "+" SERIAL_STR(XBEE_TX_SIZE) \
+                 ", Exp " SERIAL_STR(EXP_RX_SIZE) "+" SERIAL_STR(EXP_TX_SIZE) \
+                 ", Log " SERIAL_STR(LOG_RX_SIZE) "+" SERIAL_STR(LOG_TX_SIZE) " bytes (rx+tx)" )
+
+static char RXBuf1[HOST_RX_SIZE], TXBuf1[USB_TX_SIZE];
+static char RXBuf2[HOST_RX_SIZE], TXBuf2[XBEE_TX_SIZE];
+static char RXBuf3[EXP_RX_SIZE],  TXBuf3[EXP_TX_SIZE];   // Expansion port - laser rangefinder
+static char RXBuf4[LOG_RX_SIZE],  TXBuf4[LOG_TX_SIZE];   // Data Logger
+
 void InitSerial(void)
 {
   S4_Initialize();
 
-  S4_Define_Port(0, 115200,      30, TXBuf1, sizeof(TXBuf1),      31, RXBuf1, sizeof(RXBuf1));
-  S4_Define_Port(1,  57600, XBEE_TX, TXBuf2, sizeof(TXBuf2), XBEE_RX, RXBuf2, sizeof(RXBuf2));
+  S4_Define_Port(0,  USB_BAUD,      30, TXBuf1, sizeof(TXBuf1),      31, RXBuf1, sizeof(RXBuf1));
+  S4_Define_Port(1, XBEE_BAUD, XBEE_TX, TXBuf2, sizeof(TXBuf2), XBEE_RX, RXBuf2, sizeof(RXBuf2));
 
   // Unused ports get a pin value of 32
-  S4_Define_Port(2, 19200,       19, TXBuf3, sizeof(TXBuf3),      20, RXBuf3, sizeof(RXBuf3));
-  S4_Define_Port(3, 115200, PIN_MOTOR_AUX2, TXBuf4, sizeof(TXBuf4), 32, RXBuf4, sizeof(RXBuf4));
+  S4_Define_Port(2,    19200, EXP_TX_PIN, TXBuf3, sizeof(TXBuf3), EXP_RX_PIN, RXBuf3, sizeof(RXBuf3));
+  S4_Define_Port(3, LOG_BAUD, LOG_TX_PIN, TXBuf4, sizeof(TXBuf4),         32, RXBuf4, sizeof(RXBuf4));
 
   S4_Start();
+
+  ResetStreamRates(0);
+  ResetStreamRates(1);
+}
+
+
+void SetUsbBaud( int baud )
+{
+  // The cog only reads the bit timing when it starts, so a new rate means restarting it.  The buffers and
+  // their indices are in hub RAM and carry over, but a byte being shifted out on another port is cut short.
+  S4_Stop();
+  S4_Define_Port(0, baud, 30, TXBuf1, sizeof(TXBuf1), 31, RXBuf1, sizeof(RXBuf1));
+  if( S4_Start() ) {
+    UsbBaud = baud;
+    PortBytesPerCycle[0] = Port_BytesPerCycle(baud);
+    UsbBaudWatchdog = (baud == USB_BAUD) ? 0 : USB_BAUD_TIMEOUT;
+    return;
+  }
+
+  // Something else took the cog that was just freed, and every port is down until the serial cog runs again.
+  // Go back to the rate we had - a host that already switched gives up on the new rate when it goes quiet.
+  S4_Define_Port(0, UsbBaud, 30, TXBuf1, sizeof(TXBuf1), 31, RXBuf1, sizeof(RXBuf1));
+  if( S4_Start() ) {
+    UsbBaudWatchdog = (UsbBaud == USB_BAUD) ? 0 : USB_BAUD_TIMEOUT;
+    return;
+  }
+
+  // Still no cog - sound the alarm, and let the fall back in CheckDebugInput try again in a second
+  BeepHz( 2000, 300 );
+  loopTimer = CNT;                      // Keep the outer counter happy - the beep has a delay, which messes it up
+  UsbBaudWatchdog = Const_UpdateRate;
+}
+
+
+void ResetStreamRates( char port )
+{
+  for( int i=0; i<Stream_Count; i++ ) {
+    StreamPeriod[port][i] = DefaultStreamPeriod[port][i];
+    StreamCountdown[port][i] = i+1;   // Stagger the first sends so the streams don't all come due on the same cycle
+  }
+  PortBudget[port] = 0;
 }
 
 
@@ -588,18 +815,28 @@ static int clamp( int v, int min, int max ) {
 static int max( int a, int b ) { return a > b ? a : b; }
 static int min( int a, int b ) { return a < b ? a : b; }
 
+// Waits for the sensors cog to produce a new set of samples, or about 10ms if it doesn't
+static void WaitForNewSamples(void)
+{
+  int stamp = Sensors_In(16), start = CNT;
+  while( Sensors_In(16) == stamp && CNT - start < Const_ClockFreq/100 )
+    ;
+}
+
 
 
 void FindGyroZero(void)
 {
-  // The idea here is that it's VERY hard for someone to hold a thing perfectly still.
-  // If we detect variation in the gyro, keep waiting until it settles down, or "too long" has elapsed.
+  // This only needs to be a quick first guess - the IMU estimates the bias continuously from there.
+  // It's VERY hard for someone to hold a thing perfectly still, so take the steadiest of a few short
+  // sets of readings, but never wait more than about half a second.
 
   int vmin[3], vmax[3], avg[3];     // min, max, avg readings for each gyro axis
+  int acc[3], mag[3];               // accel and compass sums, kept along with the best set for FindInitialOrientation()
   int best[3], bestvar = -1;        // best set of readings found so far, and the variance for them
 
   int TryCounter = 0;
-  const int MinTries = 2, MaxTries = 64;
+  const int MinTries = 1, MaxTries = 4;
 
   // Wait for any buzzer vibration to stop.  Yes, this is actually necessary, it can be that sensitive.
   waitcnt( CNT + Const_ClockFreq/50 );
@@ -608,30 +845,33 @@ void FindGyroZero(void)
     // Take an initial sensor reading for each axis as a starting point, and zero the average
     for( int a=0; a<3; a++) {
       vmin[a] = vmax[a] = Sensors_In(1+a);
-      avg[a] = 0;
+      avg[a] = acc[a] = mag[a] = 0;
     }
 
-    // take a bunch of readings over about 1/10th of a second, keeping track of the min, max, and sum (average)
-    for( int i=0; i<64; i++ )
+    // take a bunch of readings over about 1/8 of a second, keeping track of the min, max, and sum (average)
+    for( int i=0; i<32; i++ )
     {
+      WaitForNewSamples();    // Each reading is a distinct set of samples, never a repeat
+
       for( int a=0; a<3; a++) {
         int v = Sensors_In(1+a);
         vmin[a] = min(vmin[a], v);
         vmax[a] = max(vmax[a], v);
         avg[a] += v;
-      }
 
-      waitcnt( CNT + Const_ClockFreq/250 );
+        acc[a] += Sensors_In(4+a);
+        mag[a] += Sensors_In(7+a);
+      }
     }
 
     // Compute the mid-point between the min & max, and how different that is from the average (variation)
     int maxVar = 0;
     for( int a=0; a<3; a++)
     {
-      if( avg[a] >= 0 ) avg[a] += 32;   // rounding to reduce drift
-      else avg[a] -= 32;
+      if( avg[a] >= 0 ) avg[a] += 16;   // rounding to reduce drift
+      else avg[a] -= 16;
 
-      avg[a] /= 64;
+      avg[a] /= 32;
 
       // range is the difference between min and max over the sample period.
       // I measured this as ~15 units on all axis when totally still
@@ -649,11 +889,9 @@ void FindGyroZero(void)
       best[1] = avg[1];
       best[2] = avg[2];
       bestvar = maxVar;
-    }
 
-    // Every 4th loop, beep at the user to tell them what's happening
-    if( (TryCounter & 3) == 3 ) {
-      BeepHz( 4000, 80 );
+      memcpy( ZeroAccel, acc, sizeof(acc) );
+      memcpy( ZeroMag, mag, sizeof(mag) );
     }
 
     TryCounter++;
@@ -669,6 +907,16 @@ void FindGyroZero(void)
 }
 
 
+void FindInitialOrientation(void)
+{
+  // Start the IMU at the orientation given by the accelerometer and compass readings taken along with the
+  // gyro zero, instead of starting level and waiting for it to converge.  Reusing them saves sampling again.
+  // Must follow FindGyroZero()
+
+  QuatIMU_InitOrientation( ZeroAccel, ZeroMag );
+}
+
+
 void UpdateCycleStats(void)
 {
   // Prime the initial values
@@ -953,7 +1201,7 @@ void UpdateFlightLoop(void)
     // The low-throttle clamp prevents combined PID output from sending the ESCs below a minimum value
     // Some ESCs appear to stall (go into "stop" mode) if the throttle gets too close to zero, even for a moment, so avoid that
 
-    if( UsbPulse > 0 && Prefs.DisableMotors == 0 ) {
+    if( PortPulse[0] > 0 && Prefs.DisableMotors == 0 ) {
       // If USB is connected and motors aren't disabled, don't allow throttle to go above test value for added safety.
       Motor[0] = clamp( Motor[0], Prefs.MinThrottleArmed , Prefs.ThrottleTest);
       Motor[1] = clamp( Motor[1], Prefs.MinThrottleArmed , Prefs.ThrottleTest);
@@ -1051,10 +1299,11 @@ void ArmFlightMode(void)
   FlightEnableStep = 0;
   CompassConfigStep = 0;
   Beep2();
-   
-  All_LED( LED_Red & LED_Half );
-  FindGyroZero();
-   
+
+  // No new gyro zero here - it would throw away the bias the IMU has been learning while disarmed,
+  // which is a far better estimate than one short set of readings
+  QuatIMU_SetArmed( true );
+
   All_LED( LED_Blue & LED_Half );
   BeepTune();
 
@@ -1072,6 +1321,7 @@ void DisarmFlightMode(void)
   FlightEnabled = 0;
   FlightEnableStep = 0;
   CompassConfigStep = 0;
+  QuatIMU_SetArmed( false );
   Beep3();
   
   All_LED( LED_Green & LED_Half );
@@ -1272,39 +1522,139 @@ void DoCompassCalibrate(void)
 
 void CheckDebugInput(void)
 {
-  int i, c, HostCommand;
+  if( Upload.Active && --Upload.Timeout == 0 ) {
+    Upload.Active = 0;    // Host went away mid-upload - keep the current prefs
+    Upload.State = Chunk_Idle;
+  }
 
-  char port = 0;
-  c = S4_Check(0);
-  if(c < 0) {
-    c = S4_Check(1);
-    if(c < 0)
-      return;
-    port = 1;
-    HostCommandXBee = (HostCommandXBee<<8) | c;
-    HostCommand = HostCommandXBee;
+  // The fall back waits until we're disarmed - restarting the serial cog cuts off bytes on the other ports,
+  // including a serial receiver
+  if( UsbBaudWatchdog && !FlightEnabled && --UsbBaudWatchdog == 0 ) {
+    SetUsbBaud( USB_BAUD );   // The host stopped talking at the fast rate - it gave up on it, or went away
   }
-  else {
-    HostCommandUSB = (HostCommandUSB<<8) | c;
-    HostCommand = HostCommandUSB;
-  }    
 
+  // Take everything that's arrived on both ports, unless it's taking too long - anything left over waits
+  // for the next cycle.  Each port gets its own time, so a busy USB link can't starve the XBee.
+  // Commands that take a long time (prefs save, etc) reset the loop timer themselves.
+  for( char port = 0; port < 2; port++ )
+  {
+    int start = CNT;
+    int c;
+    while( (int)(CNT - start) < HOST_RX_CYCLES && (c = S4_Check(port)) >= 0 ) {
+      ReceiveHostByte( port, c );
+    }
+  }
+}
+
+
+void ReceiveHostByte( char port, int c )
+{
+  HOST_RX & rx = HostRx[port];
+
+  if( Upload.State != Chunk_Idle && port == Upload.Port ) {
+    ReceivePrefsChunk( c );
+    return;
+  }
+
+  if( rx.ArgsNeeded ) {
+    rx.Args[rx.ArgCount++] = c;
+    if( --rx.ArgsNeeded == 0 ) {
+      DoHostCommand( port, rx.Command, rx.Args );
+      rx.Command = 0;   // Arguments aren't part of the next command
+    }
+    return;
+  }
+
+  rx.Command = (rx.Command << 8) | c;
+
+  rx.ArgCount = 0;
+  switch( rx.Command ) {
+    case Comm_SetRate:  rx.ArgsNeeded = 2;  break;
+    case Comm_GetParam: rx.ArgsNeeded = 1;  break;
+    case Comm_SetParam: rx.ArgsNeeded = 5;  break;
+    case Comm_Ping:     rx.ArgsNeeded = 4;  break;
+    case Comm_SetBaud:  rx.ArgsNeeded = 4;  break;
+    default:
+      DoHostCommand( port, rx.Command, rx.Args );
+      break;
+  }
+}
+
+
+void DoHostCommand( char port, int HostCommand, unsigned char * args )
+{
   if( HostCommand == Comm_Beat )
   {
     Mode = MODE_SensorTest;
-    if( port == 0 ) {
-      UsbPulse = 500;   // send USB data for the next two seconds (we'll get another heartbeat before then)
-      XBeePulse = 0;
+    PortPulse[port] = 500;    // send data to this port for the next two seconds (we'll get another heartbeat before then)
+    if( port == 0 && UsbBaudWatchdog ) UsbBaudWatchdog = USB_BAUD_TIMEOUT;
+    return;
+  }
+
+  if( HostCommand == Comm_Ping ) {
+    SendPong( port, args );
+    if( port == 0 && UsbBaudWatchdog ) UsbBaudWatchdog = USB_BAUD_TIMEOUT;
+    return;
+  }
+
+  if( HostCommand == Comm_SetBaud ) {
+    NegotiateUsbBaud( port, args );
+    return;
+  }
+
+  if( HostCommand == Comm_Elv8 ) {
+    S4_Put_Partial( port, &HostCommand , 4 );   //Simple ping-back to tell the application we have the right comm port
+    CompactTelemetry[port] = 0;                 // New connection - stay with the original packets until asked otherwise
+    BootCyclesSent &= ~(1<<port);               // and send it the boot times again
+    return;
+  }
+
+  if( HostCommand == Comm_Compact ) {
+    CompactTelemetry[port] = 1;
+    SensorSeq[port] = 0;
+    return;
+  }
+
+  if( HostCommand == Comm_SetRate )     // Telemetry rates only affect the debug output, so these are allowed in flight
+  {
+    int stream = args[0];
+    int period = args[1];
+
+    if( stream == 0xFF ) {
+      ResetStreamRates(port);
     }
-    if( port == 1 ) {
-      UsbPulse = 0;
-      XBeePulse = 500;  // send XBee data for the next two seconds (we'll get another heartbeat before then)
+    else if( stream < Stream_Count ) {
+      if( period > MAX_STREAM_PERIOD ) period = MAX_STREAM_PERIOD;
+      StreamPeriod[port][stream] = period;
+      StreamCountdown[port][stream] = 1;
     }
     return;
   }
 
-  if( HostCommand == Comm_Elv8 ) {
-    S4_Put_Bytes( port, &HostCommand , 4 );     //Simple ping-back to tell the application we have the right comm port
+  if( HostCommand == Comm_GetParam ) {
+    SendParam( port, args[0], Param_OK );
+    return;
+  }
+
+  if( HostCommand == Comm_SetParam )
+  {
+    int id = args[0];
+    int value = args[1] | (args[2] << 8) | (args[3] << 16) | (args[4] << 24);
+
+    char result = Param_Locked;   // Don't allow any settings adjustment when in-flight
+    if( !FlightEnabled )
+    {
+      char receiverType = Prefs.ReceiverType;
+      result = Prefs_SetParam( id, value );
+
+      if( result == Param_OK ) {
+        ApplyPrefs();
+        if( Prefs.ReceiverType != receiverType ) {
+          InitReceiver();
+        }
+      }
+    }
+    SendParam( port, id, result );    // Echo back what's actually stored
     return;
   }
 
@@ -1361,146 +1711,422 @@ void CheckDebugInput(void)
       Prefs.Checksum = Prefs_CalculateChecksum( Prefs );
       int size = sizeof(Prefs);
 
-      COMMLINK::StartPacket( 0, 0x18 , size );
-      COMMLINK::AddPacketData( 0, &Prefs, size );
+      COMMLINK::StartPacket( port, 0x18 , size );
+      COMMLINK::AddPacketData( port, &Prefs, size );
       COMMLINK::EndPacket(port);
       }
       break;
 
-    case Comm_SetPrefs:  //Store new preferences
-      {
-      PREFS TempPrefs;
-      for( int i=0; i<sizeof(Prefs); i++ ) {
-        ((char *)&TempPrefs)[i] = S4_Get_Timed(port, 50);   // wait up to 50ms per byte - Should be plenty
+    case Comm_SetPrefs:  // Start receiving new preferences - the data follows in PChk chunks
+      Upload.Active = 1;
+      Upload.Port = port;
+      Upload.Offset = 0;
+      Upload.NextSeq = 0;
+      Upload.State = Chunk_Idle;
+      Upload.Timeout = PREFS_UPLOAD_TIMEOUT;
+      return;
+
+    case Comm_PrefsChunk:
+      if( !Upload.Active || port != Upload.Port ) {
+        SendPrefsAck( port, 0, Upload_Restart );
+        return;
+      }
+      Upload.State = Chunk_Seq;     // The rest of the chunk goes to ReceivePrefsChunk
+      Upload.Timeout = PREFS_UPLOAD_TIMEOUT;
+      return;
+
+    case Comm_Wipe: // Default prefs - wipe
+      Prefs_SetDefaults();
+      Prefs_Save();
+      Beep3();
+      break;
+
+    default:
+      return;
+  }
+
+  loopTimer = CNT;                                                          //Reset the loop counter in case we took too long 
+}
+
+void ReceivePrefsChunk( int c )
+{
+  Upload.Timeout = PREFS_UPLOAD_TIMEOUT;
+
+  switch( Upload.State )
+  {
+    case Chunk_Seq:
+      Upload.Seq = c;
+      Upload.Sum = c;
+      Upload.State = Chunk_Length;
+      break;
+
+    case Chunk_Length:
+      Upload.Length = c;
+      Upload.Sum += c;
+      Upload.Got = 0;
+      if( c == 0 || c > PREFS_CHUNK_MAX ) {
+        Upload.State = Chunk_Idle;
+        SendPrefsAck( Upload.Port, Upload.Seq, Upload_Resend );
       }
+      else {
+        Upload.State = Chunk_Data;
+      }
+      break;
 
-      if( Prefs_CalculateChecksum( TempPrefs ) == TempPrefs.Checksum ) {
-        memcpy( &Prefs, &TempPrefs, sizeof(Prefs) );
-        Prefs_Save();
+    case Chunk_Data:
+      if( Upload.Offset + Upload.Got < sizeof(PREFS) ) {
+        ((char *)&Upload.Temp)[Upload.Offset + Upload.Got] = c;
+      }
+      Upload.Sum += c;
+      if( ++Upload.Got == Upload.Length ) {
+        Upload.State = Chunk_Sum;
+      }
+      break;
+
+    case Chunk_Sum:
+      Upload.State = Chunk_Idle;
+      if( (unsigned char)c != Upload.Sum ) {
+        SendPrefsAck( Upload.Port, Upload.Seq, Upload_Resend );
+      }
+      else if( Upload.Seq == Upload.NextSeq && Upload.Offset + Upload.Length <= sizeof(PREFS) ) {
+        Upload.Offset += Upload.Length;
+        Upload.NextSeq++;
 
-        if( Prefs_Load() ) {
-          BeepOff( 'A' );   // turn off the alarm beeper if it was on
-          Beep2();
-          ApplyPrefs();
-          InitReceiver();   // In case the user changes receiver types
-          FindGyroZero();   // Prevents the IMU from wandering around when we change gyro or accel offsets
+        if( Upload.Offset == sizeof(PREFS) ) {
+          FinishPrefsUpload();
+          SendPrefsAck( Upload.Port, Upload.Seq, Upload.Result );
         }
         else {
-          Beep();
+          SendPrefsAck( Upload.Port, Upload.Seq, Upload_ChunkOK );
         }
       }
+      else if( (unsigned char)(Upload.Seq + 1) == Upload.NextSeq ) {
+        // A repeat of the last chunk - our ack was lost, so just send it again
+        SendPrefsAck( Upload.Port, Upload.Seq, Upload.Offset == sizeof(PREFS) ? Upload.Result : Upload_ChunkOK );
+      }
       else {
-        Beep();
+        SendPrefsAck( Upload.Port, Upload.Seq, Upload_Resend );
+      }
+      break;
+  }
+}
+
+void FinishPrefsUpload(void)
+{
+  Upload.Result = Upload_Failed;
+
+  if( !FlightEnabled && Prefs_CalculateChecksum( Upload.Temp ) == Upload.Temp.Checksum )
+  {
+    memcpy( &Prefs, &Upload.Temp, sizeof(Prefs) );
+    Prefs_Save();
+
+    if( Prefs_Load() ) {
+      BeepOff( 'A' );   // turn off the alarm beeper if it was on
+      Beep2();
+      ApplyPrefs();
+      InitReceiver();   // In case the user changes receiver types
+      FindGyroZero();   // Prevents the IMU from wandering around when we change gyro or accel offsets
+      FindInitialOrientation();
+      Upload.Result = Upload_Complete;
+    }
+    else {
+      Beep();
+    }
+  }
+  else {
+    Beep();
+  }
+
+  // Upload stays active until it times out, so a resent final chunk gets the same answer
+  loopTimer = CNT;    // Writing the EEPROM takes a while
+}
+
+void SendPrefsAck( char port, char seq, char status )
+{
+  char ack[4] = { seq, status, (char)Upload.Offset, (char)(Upload.Offset >> 8) };
+
+  if( !COMMLINK::Reserve( port, 0x19, 4 ) ) {           // No room - the ground station resends the chunk
+    COMMLINK::Drop();
+    return;
+  }
+  COMMLINK::Write( ack, 4 );
+  COMMLINK::Commit();
+}
+
+void SendParam( char port, int id, char result )
+{
+  int value = 0;
+  char type = 0;
+  if( Prefs_GetParam( id, &value, &type ) != Param_OK ) {
+    result = Param_BadID;
+  }
+
+  long reply[2];
+  char * header = (char *)&reply[0];
+  header[0] = (char)id;  header[1] = result;  header[2] = type;  header[3] = 0;
+  reply[1] = value;
+
+  if( !COMMLINK::Reserve( port, 0x1A, 8 ) ) {           // No room - the ground station asks again
+    COMMLINK::Drop();
+    return;
+  }
+  COMMLINK::Write( reply, 8 );
+  COMMLINK::Commit();
+}
+
+void NegotiateUsbBaud( char port, unsigned char * args )
+{
+  int requested;
+  memcpy( &requested, args, 4 );
+
+  // Answer with the rate we'll use - the fastest we support that isn't above the request.  The XBee rate
+  // belongs to the radio's own configuration, and the rate can't change while armed.
+  long baud = (port == 0) ? UsbBaud : XBEE_BAUD;
+  if( port == 0 && !FlightEnabled ) {
+    baud = (requested >= USB_FAST_BAUD) ? USB_FAST_BAUD : USB_BAUD;
+  }
+
+  // The answer goes out at the current rate.  If there's no room, the host asks again.
+  if( !COMMLINK::Reserve( port, 0x1C, 4 ) ) {
+    COMMLINK::Drop();
+    return;
+  }
+  COMMLINK::Write( &baud, 4 );
+  COMMLINK::Commit();
+
+  if( port != 0 || baud == UsbBaud ) return;
+
+  // Flush returns when the last byte leaves the buffer, so give it two byte times to finish shifting out
+  S4_Flush_Output( 0 );
+  waitcnt( CNT + Const_ClockFreq / UsbBaud * 20 );
+
+  SetUsbBaud( baud );
+  loopTimer = CNT;    // The flush can take a few ms
+}
+
+void SendPong( char port, unsigned char * token )
+{
+  // The receive stamp is when the command was parsed, which can be up to one update cycle after the
+  // bytes arrived.  The transmit stamp is taken as late as possible, just before the packet is committed.
+  long reply[3];
+  reply[1] = CNT;
+  memcpy( &reply[0], token, 4 );
+
+  if( !COMMLINK::Reserve( port, 0x1B, 12 ) ) {          // No room - the host counts it as lost, which it effectively is
+    COMMLINK::Drop();
+    return;
+  }
+
+  COMMLINK::Write( &reply[0], 8 );
+  reply[2] = CNT;
+  COMMLINK::Write( &reply[2], 4 );
+  COMMLINK::Commit();
+}
+
+void CollectIMUBatch(void)
+{
+  if( BatchCount == 0 ) {
+    BatchFill.StartCounter = counter;
+  }
+
+  short * dest = BatchFill.Samples[BatchCount];
+  dest[0] = sens.GyroX;
+  dest[1] = sens.GyroY;
+  dest[2] = sens.GyroZ;
+  dest[3] = sens.AccelX;
+  dest[4] = sens.AccelY;
+  dest[5] = sens.AccelZ;
+
+  if( ++BatchCount == IMU_BATCH_SAMPLES ) {
+    memcpy( &BatchReady, &BatchFill, sizeof(BatchReady) );
+    BatchIsReady = 3;
+    BatchCount = 0;
+  }
+}
+
+
+// Sends one telemetry stream to the given port.  Returns the number of bytes sent, or zero if the
+// port didn't have the budget or the buffer space to take the packet without blocking
+char SendStream( char port, char stream )
+{
+  if( stream == Stream_IMUBatch && (BatchIsReady & (1<<port)) == 0 ) return 0;
+
+  char compact = CompactTelemetry[port];
+  char size = compact ? CompactPacketSize[stream] : StreamPacketSize[stream];
+  if( stream == Stream_Debug && (BootCyclesSent & (1<<port)) == 0 ) size += sizeof(BootCycles);   // Boot times ride along once
+  if( size > PortBudget[port] ) return 0;
+
+  if( stream == Stream_Sensors )
+  {
+    TxData[0] = sens.Temperature;       //Copy the values we're interested in into a WORD array, for faster transmission                        
+    TxData[1] = sens.GyroX;
+    TxData[2] = sens.GyroY;
+    TxData[3] = sens.GyroZ;
+    TxData[4] = sens.AccelX;
+    TxData[5] = sens.AccelY;
+    TxData[6] = sens.AccelZ;
+    TxData[7] = sens.MagX;
+    TxData[8] = sens.MagY;
+    TxData[9] = sens.MagZ;
+  }
+
+  if( compact && (stream == Stream_Sensors || stream == Stream_Quat || stream == Stream_DesiredQuat) )
+  {
+    // Compact packets are variable length, so they're built in the COMMLINK buffer and then sent
+    if( S4_Can_Put(port, size) == 0 ) return 0;
+
+    switch( stream )
+    {
+    case Stream_Sensors:
+      {
+      // Sequence number, keyframe flag, then each value and the loop counter as a varint delta from the last one
+      // sent.  Every 32nd packet is a keyframe (deltas from zero) so the GroundStation can recover from a lost packet.
+      char key = (SensorSeq[port] & 31) == 0;
+      char hdr[2] = { SensorSeq[port]++, key };
+
+      COMMLINK::StartPacket( 0x12, 0 );
+      COMMLINK::AddPacketData( hdr, 2 );
+      for( char i=0; i<10; i++ ) {
+        COMMLINK::AddPacketVarInt( key ? TxData[i] : TxData[i] - PrevSensors[port][i] );
+        PrevSensors[port][i] = TxData[i];
       }
+      COMMLINK::AddPacketVarInt( key ? counter : counter - PrevSensorCounter[port] );
+      PrevSensorCounter[port] = counter;
       }
       break;
 
-    case Comm_Wipe: // Default prefs - wipe
-      Prefs_SetDefaults();
-      Prefs_Save();
-      Beep3();
+    case Stream_Quat:
+      COMMLINK::StartPacket( 0x13, 8 );                       // Compact quaternion, 8 byte payload
+      COMMLINK::AddPacketQuat( QuatIMU_GetQuaternion() );
       break;
 
-    default:
-      return;
+    case Stream_DesiredQuat:
+      QuatIMU_GetDesiredQ( (float*)TxData );
+      COMMLINK::StartPacket( 0x16, 8 );                       // Compact desired quaternion, 8 byte payload
+      COMMLINK::AddPacketQuat( (float*)TxData );
+      break;
+    }
+
+    COMMLINK::EndPacket();
+    COMMLINK::SendPacket(port);
+    return COMMLINK::PacketLength();
   }
 
-  loopTimer = CNT;                                                          //Reset the loop counter in case we took too long 
+
+  // Everything else is fixed size, and written straight into the TX buffer of the port
+  if( COMMLINK::Reserve( port, StreamPacketType[stream], size-8 ) == 0 ) return 0;
+
+  switch( stream )
+  {
+  case Stream_Radio:
+    {
+    COMMLINK::Write( &Radio , 16 );       // First 8 channels of Radio struct is 16 bytes total
+    COMMLINK::Write( &BatteryVolts, 2 );  // Send 2 additional bytes for battery voltage
+
+    short rx[4] = { (short)RadioFrames, (short)SBUS::LostFrames(), (short)SBUS::Failsafes(), RadioLatency };
+    COMMLINK::Write( rx, 8 );             // Receiver frame count, lost frames, failsafes, stick to motor latency
+    }
+    break;
+
+  case Stream_Debug:
+    UpdateCycleStats();
+    COMMLINK::Write( &Stats, 8 );          // Version number, + Stats on update cycle counts (sending debug data takes a long time)
+    COMMLINK::Write( &counter, 4 );        // Send the counter (sequence timestamp)
+
+    if( (BootCyclesSent & (1<<port)) == 0 ) {
+      COMMLINK::Write( BootCycles, sizeof(BootCycles) );
+      BootCyclesSent |= 1<<port;
+    }
+    break;
+
+  case Stream_Sensors:
+    COMMLINK::Write( &TxData, 20 );        //Send 20 bytes of data from @TxData onward (sends 10 words worth of data)
+    COMMLINK::Write( &counter, 4 );        //Send the counter, so the time between packets is known
+    break;
+
+  case Stream_Quat:
+    COMMLINK::Write( QuatIMU_GetQuaternion(), 16 );   // Quaternion data, 16 byte payload
+    break;
+
+  case Stream_Motors:
+    COMMLINK::Write( &Motor[0], 8 );       // 8 byte payload
+    break;
+
+  case Stream_Computed:
+    COMMLINK::Write( &PitchDifference, 4 );
+    COMMLINK::Write( &RollDifference, 4 );
+    COMMLINK::Write( &YawDifference, 4 );
+
+    COMMLINK::Write( &sens.Alt, 4 );       //Send 4 bytes of data for Alt
+    COMMLINK::Write( &GroundHeight, 4 );   //Send 4 bytes of data for height above ground
+    COMMLINK::Write( &AltiEst, 4 );        //Send 4 bytes for altitude estimate 
+    break;
+
+  case Stream_DesiredQuat:
+    QuatIMU_GetDesiredQ( (float*)TxData );
+    COMMLINK::Write( TxData, 16 );         // Desired Quaternion data, 16 byte payload
+    break;
+
+  case Stream_IMUBatch:
+    COMMLINK::Write( &BatchReady, sizeof(BatchReady) );   // Start counter + IMU_BATCH_SAMPLES x 12 bytes
+    BatchIsReady &= ~(1<<port);
+    break;
+  }
+
+  COMMLINK::Commit();
+  return size;
 }
 
+
 void DoDebugModeOutput(void)
 {
-  int loop, addr, i, phase;
-  char port = 0;
+  int i;
 
-  if( UsbPulse > 0 ) {
-    if( --UsbPulse == 0 ) {
-      Mode = MODE_None;
-      return;
-    }
-    phase = counter & 7;    // Translates to 31.25 full updates per second, at 250hz
-  }
-  else if( XBeePulse > 0 )
+  char activePorts = 0, batchPorts = 0;
+  for( char port = 0; port < 2; port++ )
   {
-    if( --UsbPulse == 0 ) {
-      Mode = MODE_None;
-      return;
+    if( PortPulse[port] > 0 && --PortPulse[port] > 0 ) {
+      activePorts |= 1 << port;
+      if( StreamPeriod[port][Stream_IMUBatch] ) batchPorts |= 1 << port;
     }
-    port = 1;
-    phase = ((counter >> 1) & 7) | ((counter & 1) << 16);    // Translates to ~15 full updates per second, at 250hz
-  }    
+  }
 
-  if( Mode == MODE_None ) return;
+  if( activePorts == 0 ) {
+    Mode = MODE_None;
+  }
 
   switch( Mode )
   {
     case MODE_SensorTest:
     {
-      switch( phase )
+      if( batchPorts ) {
+        CollectIMUBatch();
+      }
+
+      // Each port has its own streams and budget, so a slow XBee link doesn't hold back USB, or the other way round
+      for( char port = 0; port < 2; port++ )
       {
-      case 0:
-        COMMLINK::StartPacket( 1, 18 );               // Radio values, 18 byte payload
-        COMMLINK::AddPacketData( &Radio , 16 );       // First 8 channels of Radio struct is 16 bytes total
-        COMMLINK::AddPacketData( &BatteryVolts, 2 );  // Send 2 additional bytes for battery voltage
-        COMMLINK::EndPacket();
-        COMMLINK::SendPacket(port);
-        break;
-
-      case 1:
-        UpdateCycleStats();
-        COMMLINK::StartPacket( 7, 12 );                // Debug values, 16 byte payload
-        COMMLINK::AddPacketData( &Stats, 8 );          // Version number, + Stats on update cycle counts (sending debug data takes a long time)
-        COMMLINK::AddPacketData( &counter, 4 );        // Send the counter (sequence timestamp)
-        COMMLINK::EndPacket();
-        COMMLINK::SendPacket(port);
-        break;
-
-      case 2:
-        TxData[0] = sens.Temperature;       //Copy the values we're interested in into a WORD array, for faster transmission                        
-        TxData[1] = sens.GyroX;
-        TxData[2] = sens.GyroY;
-        TxData[3] = sens.GyroZ;
-        TxData[4] = sens.AccelX;
-        TxData[5] = sens.AccelY;
-        TxData[6] = sens.AccelZ;
-        TxData[7] = sens.MagX;
-        TxData[8] = sens.MagY;
-        TxData[9] = sens.MagZ;
-
-        COMMLINK::BuildPacket( 2, &TxData, 20 );   //Send 20 bytes of data from @TxData onward (sends 10 words worth of data)
-        COMMLINK::SendPacket(port);
-        break;
-
-      case 4:
-        COMMLINK::BuildPacket( 3, QuatIMU_GetQuaternion(), 16 );  // Quaternion data, 16 byte payload
-        COMMLINK::SendPacket(port);
-        break;
-
-      case 5: // Motor data
-        COMMLINK::BuildPacket( 5, &Motor[0], 8 );   // 8 byte payload
-        COMMLINK::SendPacket(port);
-        break;
-
-
-      case 6:
-        COMMLINK::StartPacket( 4, 24 );   // Computed data, 24 byte payload
-
-        COMMLINK::AddPacketData( &PitchDifference, 4 );
-        COMMLINK::AddPacketData( &RollDifference, 4 );
-        COMMLINK::AddPacketData( &YawDifference, 4 );
-
-        COMMLINK::AddPacketData( &sens.Alt, 4 );       //Send 4 bytes of data for Alt
-        COMMLINK::AddPacketData( &GroundHeight, 4 );   //Send 4 bytes of data for height above ground
-        COMMLINK::AddPacketData( &AltiEst, 4 );        //Send 4 bytes for altitude estimate 
-        COMMLINK::EndPacket();
-        COMMLINK::SendPacket(port);
-        break;
-
-      case 7:
-        QuatIMU_GetDesiredQ( (float*)TxData );
-        COMMLINK::BuildPacket( 6, TxData, 16 );   // Desired Quaternion data, 16 byte payload
-        COMMLINK::SendPacket(port);
-        break;
+        if( (activePorts & (1 << port)) == 0 ) continue;
+
+        // Accrue this cycle's share of the line rate, capped so an idle port can't save up more than a buffer full
+        PortBudget[port] = min( PortBudget[port] + PortBytesPerCycle[port], PortMaxBudget[port] );
+
+        for( char s=0; s<Stream_Count; s++ )
+        {
+          if( StreamPeriod[port][s] == 0 ) continue;
+
+          if( StreamCountdown[port][s] > 1 ) {
+            StreamCountdown[port][s]--;
+            continue;
+          }
+
+          // Stream is due - send it if we can afford it, otherwise it stays due and gets another chance next cycle
+          char size = SendStream( port, s );
+          if( size != 0 ) {
+            PortBudget[port] -= size;
+            StreamCountdown[port][s] = StreamPeriod[port][s];
+          }
+        }
       }
     }
     break;
@@ -1588,49 +2214,56 @@ void DoDebugModeOutput(void)
 #ifdef ENABLE_LOGGING
 void DoLogOutput(void)
 {
-  if( FlightEnabled == 0 ) return;
-  LogTrigger = 1;
-}
-
-
-void DataLogThread(void *par)
-{
-  char phase = 0;
-
-  while( true )
-  {
-    while( LogTrigger == 0 )
-      ;
-
-    if( phase == 0 ) {
-      // Probably better to write this to just dump raw int, float, etc.
-      // MUCH faster, smaller, and the PC can extract it relatively easily
-
-      static char tempBuf[128];
-      char count = 0;
-
-      count =  LogInt( DesiredAscentRate , tempBuf+count );
-      count += LogInt( AscentEst , tempBuf+count );
-      count += LogInt( AscentPID.LastPError , tempBuf+count );
-      count += LogInt( AscentPID.IError , tempBuf+count );
-      count += LogInt( AscentPID.Output , tempBuf+count );
-      count += LogInt( DesiredAltitude , tempBuf+count );
-      count += LogInt( AltiEst, tempBuf+count );
-      count += LogInt( AltPID.LastPError , tempBuf+count );
-      count += LogInt( AltPID.IError , tempBuf+count );
-      count += LogInt( FlightMode , tempBuf+count);
-
-      count += LogInt( Radio.Thro , tempBuf+count );
-      tempBuf[count++] = 13;  // overwrite the last comma with a carriage return
-
-      S4_Put_Bytes( 3, tempBuf, count );
-    }
+  static char WasLogging = 0;
 
-    phase = (phase+1) & 3; // Cut the data rate down a little
+  if( FlightEnabled == 0 ) {
+    WasLogging = 0;
+    return;
+  }
 
-    // Reset the log trigger
-    LogTrigger = 0;
+  if( WasLogging == 0 ) {
+    Blackbox_NewLog();    // Each flight starts with a header so the log can be decoded on its own
+    WasLogging = 1;
   }
+
+  // Just copy the values - the logger cog does the checksum and the serial output
+  BLACKBOX_FRAME * f = Blackbox_Frame();
+
+  f->Counter = counter;
+  f->AltiEst = AltiEst;
+
+  f->Gyro[0] = sens.GyroX;
+  f->Gyro[1] = sens.GyroY;
+  f->Gyro[2] = sens.GyroZ;
+  f->Accel[0] = sens.AccelX;
+  f->Accel[1] = sens.AccelY;
+  f->Accel[2] = sens.AccelZ;
+
+  memcpy( f->Radio, &Radio, sizeof(f->Radio) );
+
+  f->RollPID[0] = RollPID.LastPError;
+  f->RollPID[1] = RollPID.IError;
+  f->RollPID[2] = RollPID.DError;
+  f->RollPID[3] = RollPID.Output;
+  f->PitchPID[0] = PitchPID.LastPError;
+  f->PitchPID[1] = PitchPID.IError;
+  f->PitchPID[2] = PitchPID.DError;
+  f->PitchPID[3] = PitchPID.Output;
+  f->YawPID[0] = YawPID.LastPError;
+  f->YawPID[1] = YawPID.IError;
+  f->YawPID[2] = YawPID.DError;
+  f->YawPID[3] = YawPID.Output;
+  f->AltOut = AltPID.Output;
+  f->AscentOut = AscentPID.Output;
+
+  memcpy( f->Motor, Motor, sizeof(f->Motor) );
+
+  f->LoopCycles = LoopCycles / 64;
+  f->Flags = FlightMode | (ControlMode << 4) | (IsHolding << 8);
+  f->NoiseHz = NoiseTrack_Frequency();
+  f->Pad = 0;
+
+  Blackbox_Commit();
 }
 #endif
 
@@ -1667,7 +2300,7 @@ void LaserRangeThread( void *par )
     } while( c >= 0 );
 
     if( laserCount == 0 ) {
-      S4_Put(2,'A');
+      S4_Try_Put(2,'A');
       laserCount = 16;      // Ping the laser occasionally for a new reading
     }
     else {
@@ -1686,9 +2319,11 @@ void InitializePrefs(void)
 
 void ApplyPrefs(void)
 {
-  Sensors_SetDriftValues( &Prefs.DriftScale[0] );
+  Sensors_SetDriftValues( &Prefs.DriftScale[0], &Prefs.DriftCurve[0] );
   Sensors_SetAccelOffsetValues( &Prefs.AccelOffset[0] );
   Sensors_SetMagnetometerScaleOffsets( &Prefs.MagScaleOfs[0] );
+  Sensors_SetGyroFilters( &Prefs.GyroLowPass[0], &Prefs.GyroNotch[0] );
+  NoiseTrack_SetPrefs( &Prefs.GyroNotch[0], Prefs.CenterThrottle - Prefs.MinThrottle );
 
   QuatIMU_SetRollCorrection( &Prefs.RollCorrect[0] );
   QuatIMU_SetPitchCorrection( &Prefs.PitchCorrect[0] );
@@ -1708,23 +2343,27 @@ void ApplyPrefs(void)
 
 void All_LED( int Color )
 {
+  if( LED.Value[0] == Color ) return;   // This is called every loop, but only a change needs sending
+
 #if defined(EXTRA_LIGHTS)
-  LEDValue[0] = Color;
+  LED.Value[0] = Color;
 
-  LEDValue[1 +  0] = Color;
-  LEDValue[2 +  0] = Color;
+  LED.Value[1 +  0] = Color;
+  LED.Value[2 +  0] = Color;
 
-  LEDValue[1 +  5] = Color;
-  LEDValue[2 +  5] = Color;
+  LED.Value[1 +  5] = Color;
+  LED.Value[2 +  5] = Color;
 
-  LEDValue[1 + 10] = Color;
-  LEDValue[2 + 10] = Color;
+  LED.Value[1 + 10] = Color;
+  LED.Value[2 + 10] = Color;
 
-  LEDValue[1 + 15] = Color;
-  LEDValue[2 + 15] = Color;
+  LED.Value[1 + 15] = Color;
+  LED.Value[2 + 15] = Color;
 
 #else
   for( int i=0; i<LED_COUNT; i++ )
-    LEDValue[i] = Color;
+    LED.Value[i] = Color;
 #endif
+
+  LED.Changes++;
 }
@@ -24,7 +24,9 @@
 void Initialize(void);
 void InitReceiver(void);
 void InitSerial(void);
+void BootPhaseDone( char phase );
 void FindGyroZero(void);
+void FindInitialOrientation(void);
 void UpdateFlightLoop(void);
 void UpdateFlightLEDColor(void);
 void ArmFlightMode(void);
@@ -32,7 +34,19 @@ void DisarmFlightMode(void);
 void StartCompassCalibrate(void);
 void DoCompassCalibrate(void);
 void CheckDebugInput(void);
+void ReceiveHostByte( char port, int c );
+void DoHostCommand( char port, int HostCommand, unsigned char * args );
 void DoDebugModeOutput(void);
+void ResetStreamRates( char port );
+char SendStream( char port, char stream );
+void CollectIMUBatch(void);
+void ReceivePrefsChunk( int c );
+void FinishPrefsUpload(void);
+void SendPrefsAck( char port, char seq, char status );
+void SendParam( char port, int id, char result );
+void SendPong( char port, unsigned char * token );
+void NegotiateUsbBaud( char port, unsigned char * args );
+void SetUsbBaud( int baud );
 void InitializePrefs(void);
 void ApplyPrefs(void);
 void All_LED( int Color );
@@ -98,6 +112,47 @@ enum CONTROLMODE {
   ControlMode_Manual = 1,
 };  
 
+// Telemetry streams sent to the GroundStation.  When a port is short on bandwidth,
+// lower numbered streams get first claim on it.  Values are shared with GroundStation.
+enum STREAM {
+  Stream_Radio = 0,
+  Stream_Debug = 1,
+  Stream_Sensors = 2,
+  Stream_Quat = 3,
+  Stream_Motors = 4,
+  Stream_Computed = 5,
+  Stream_DesiredQuat = 6,
+  Stream_IMUBatch = 7,        // Consecutive full-rate gyro & accel samples, off by default
+  Stream_Count = 8,
+};
+
+// Parts of Initialize() that are timed at boot.  The CNT cycles each one took go out once in the first
+// debug packet after a GroundStation connects, in this order.  Values are shared with GroundStation.
+enum BOOT_PHASE {
+  Boot_Cogs = 0,              // Sensors, serial, and F32 cog launches, QuatIMU setup
+  Boot_Prefs = 1,             // Load prefs from EEPROM and apply them
+  Boot_Receiver = 2,
+  Boot_Outputs = 3,           // Battery monitor, buzzer, motor outputs
+  Boot_PIDs = 4,              // PID setup, logging and noise tracker cogs
+  Boot_GyroZero = 5,          // Includes waiting for the sensors cog to produce its first samples
+  Boot_Orientation = 6,
+  Boot_Count = 7,
+};
+
+// Preferences upload.  Every chunk is acknowledged with a 0x19 packet: seq, status, bytes received so far (u16).
+// A whole chunk (PChk, seq, length, data, sum) has to fit in the 32 byte USB & XBee receive buffers.
+#define PREFS_CHUNK_MAX  24
+
+enum UPLOAD_STATUS {
+  Upload_ChunkOK = 0,     // Chunk stored, send the next one
+  Upload_Resend = 1,      // Chunk was damaged or out of order, send it again
+  Upload_Complete = 2,    // All chunks received, prefs were valid and have been saved
+  Upload_Failed = 3,      // All chunks received, but the prefs checksum was bad (or we're armed) - nothing was saved
+  Upload_Restart = 4,     // No upload in progress, start over with UPrf
+};
+
+#define IMU_BATCH_SAMPLES  4  // Samples per IMU batch packet - 4 * 12 bytes + start counter + header fits in the USB & XBee TX buffers
+
 // Structure to hold radio values to make sure they stay in order
 struct RADIO {
   short Thro, Aile, Elev, Rudd, Gear, Aux1, Aux2, Aux3, Aux4;   // Aux4 is an additional raw channel for SBUS users only
@@ -133,6 +188,13 @@ const int LED_DimWhite = LED_White & LED_Half;
 #define Comm_QueryPrefs COMMAND('Q','P','R','F')
 #define Comm_SetPrefs   COMMAND('U','P','r','f')
 #define Comm_Wipe       COMMAND('W','I','P','E')
+#define Comm_PrefsChunk COMMAND('P','C','h','k')    // Followed by seq, length, data bytes, 8-bit sum of seq/length/data
+#define Comm_GetParam   COMMAND('P','G','e','t')    // Followed by param ID - answered with a 0x1A packet
+#define Comm_SetParam   COMMAND('P','S','e','t')    // Followed by param ID, 4 byte value (little endian) - answered with a 0x1A packet
+#define Comm_Ping       COMMAND('P','i','n','g')    // Followed by a 4 byte token - echoed in a 0x1B packet with CNT at receive & transmit
+#define Comm_SetBaud    COMMAND('B','a','u','d')    // Followed by the desired USB baud rate (4 bytes, little endian) - answered with a 0x1C packet, then the FC switches
+#define Comm_SetRate    COMMAND('R','a','t','e')    // Followed by stream index, period in update cycles (0 == off)
+#define Comm_Compact    COMMAND('C','m','p','t')    // Switch the port to compact sensor & quaternion packets (Elv8 switches back)
 
 #define Comm_ZeroGyro   COMMAND('Z','r','G','r')
 #define Comm_ZeroAccel  COMMAND('Z','e','A','c')
@@ -0,0 +1,22 @@
+#!/bin/sh
+# Hub RAM report for a built Elev8-FC image.  Hub RAM is 32KB, shared by code, data, and the stacks
+# and buffers for every cog, and it's what runs out first when adding features.
+#
+#   usage: ./hubram.sh [path/to/elev8-main.elf]   (defaults to the SimpleIDE output folder)
+
+ELF=${1:-cmm/elev8-main.elf}
+PREFIX=${PROPGCC_PREFIX:-propeller-elf-}
+
+if [ ! -f "$ELF" ]; then
+  echo "No image at $ELF - build first, or pass the .elf path"
+  exit 1
+fi
+
+${PREFIX}size "$ELF" | awk 'NR == 2 {
+  used = $1 + $2 + $3
+  printf "code %d, data %d, bss %d - %d of 32768 bytes used, %d free\n", $1, $2, $3, used, 32768 - used
+}'
+
+echo
+echo "Largest data / bss symbols:"
+${PREFIX}nm --size-sort --reverse-sort -S -C -t d "$ELF" | awk '$3 ~ /^[bBdD]$/ { $1 = ""; size = $2; $2 = ""; $3 = ""; printf "%8d  %s\n", size, $0 }' | head -20
@@ -0,0 +1,259 @@
+/*
+  This file is part of the ELEV-8 Flight Controller Firmware
+  for Parallax part #80204, Revisions A & B
+
+  Copyright 2016 Parallax Incorporated
+
+  ELEV-8 Flight Controller Firmware is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free Software Foundation,
+  either version 3 of the License, or (at your option) any later version.
+
+  ELEV-8 Flight Controller Firmware is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with the ELEV-8 Flight Controller Firmware.  If not, see <http://www.gnu.org/licenses/>.
+
+  Written by Jason Dorie
+*/
+
+#include <propeller.h>
+
+#include "constants.h"
+#include "noisetrack.h"
+#include "sensors.h"
+
+// The tracker runs a small Goertzel filter bank over blocks of gyro samples.  The bins are spread
+// around a guess made from the motor outputs, the strongest one (refined between its neighbors) is
+// the noise frequency, and each measurement also corrects the throttle-to-frequency guess.
+
+#define Bins       9          // Goertzel bins, centered on the guess
+#define BlockSize  128        // Samples per measurement, ~7 measurements per second
+#define BinStep    (Const_GyroRate / BlockSize)   // Bins are one resolution step (~7hz) apart
+#define MinHz      50
+#define MaxHz      450        // Just under the 476hz Nyquist limit of the gyro samples
+#define MaxDelta   1024       // Limit on sample-to-sample change, keeps the Goertzel sums in range
+#define MinPower   1000       // Noise weaker than this isn't worth chasing
+
+// Shared with the main cog - it sets these, and reads Frequency
+static volatile int   Throttle;
+static volatile int   Frequency;
+static volatile char  PrefsChanged;
+static volatile char  NotchOn;
+static volatile short NotchA1, NotchA2;     // -a1, -a2 of the notch in the prefs
+static volatile int   ThrottleRange = 1;
+
+// Only the tracker cog touches these
+static short BinHz[Bins];
+static int   Coef[Bins];            // 2cos(w) for each bin, 12 bit fixed point
+static int   State[2][Bins][2];     // Last two Goertzel values for each bin, for gyro X and Y
+static int   Power[Bins];
+
+static int noisetrack_stack[NOISETRACK_STACK_SIZE];
+
+
+#ifndef ROM_SINE
+#define ROM_SINE  ((const unsigned short *)0xE000)    // The host tests point this at a copy of the table
+#endif
+
+// cos( 2pi * hz / Const_GyroRate ), 16 bit fixed point, from the sine table in the Propeller ROM.
+// The table is the first quadrant only, 2049 words from 0 to 65535, so a full turn is 8192 steps.
+static int CosHz( int hz )
+{
+  const unsigned short * sine = ROM_SINE;
+
+  int a = (hz * 8192 + Const_GyroRate/2) / Const_GyroRate;
+  if( a > 4096 ) a = 4096;
+  return (a <= 2048) ? sine[2048 - a] : -sine[a - 2048];
+}
+
+
+// The notch has -a1 = 2cos(w0) / (1 + alpha) and 1 - (-a2) = 2 / (1 + alpha).  Moving the center
+// while keeping -a2 (and b0, b2) as they are keeps the width GroundStation set.
+static int NotchA1For( int hz )
+{
+  return (CosHz(hz) * (4096 - NotchA2) + 32768) >> 16;
+}
+
+
+// Recovers the center of the notch in the prefs - -a1 falls as the frequency rises
+static int NotchCenter(void)
+{
+  int lo = 1, hi = Const_GyroRate/2 - 1;
+  while( lo < hi ) {
+    int mid = (lo + hi) / 2;
+    if( NotchA1For(mid) > NotchA1 ) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+
+static void StartBlock( int hint )
+{
+  for( int b=0; b<Bins; b++ )
+  {
+    int hz = hint + (b - Bins/2) * BinStep;
+    if( hz < MinHz ) hz = MinHz;
+    if( hz > MaxHz ) hz = MaxHz;
+
+    BinHz[b] = hz;
+    Coef[b] = CosHz(hz) >> 3;   // 2cos(w), 16 bits to 12
+
+    State[0][b][0] = State[0][b][1] = 0;
+    State[1][b][0] = State[1][b][1] = 0;
+  }
+}
+
+
+// Runs one sample of the change in gyro X and Y through every bin
+static void AddSample( int dx, int dy )
+{
+  if( dx > MaxDelta ) dx = MaxDelta; else if( dx < -MaxDelta ) dx = -MaxDelta;
+  if( dy > MaxDelta ) dy = MaxDelta; else if( dy < -MaxDelta ) dy = -MaxDelta;
+
+  for( int b=0; b<Bins; b++ )
+  {
+    int * s = State[0][b];
+    int s0 = dx + ((Coef[b] * s[0]) >> 12) - s[1];
+    s[1] = s[0];
+    s[0] = s0;
+
+    s = State[1][b];
+    s0 = dy + ((Coef[b] * s[0]) >> 12) - s[1];
+    s[1] = s[0];
+    s[0] = s0;
+  }
+}
+
+
+// Returns the frequency of the strongest bin, refined between its neighbors, or 0 if nothing stands out
+static int Measure(void)
+{
+  int total = 0, peak = 0;
+
+  for( int b=0; b<Bins; b++ )
+  {
+    int p = 0;
+    for( int axis=0; axis<2; axis++ ) {
+      int s1 = State[axis][b][0] >> 4, s2 = State[axis][b][1] >> 4;    // >> 4 so the squares fit
+      p += s1*s1 + s2*s2 - ((Coef[b] * s1) >> 12) * s2;
+    }
+    Power[b] = p;
+    total += p >> 3;
+    if( p > Power[peak] ) peak = b;
+  }
+
+  // The peak has to hold at least a quarter of the power in the bank
+  if( Power[peak] < MinPower || (Power[peak] >> 3) * 4 < total ) return 0;
+
+  int hz = BinHz[peak];
+  if( peak > 0 && peak < Bins-1 )
+  {
+    // Fit a parabola through the peak and its neighbors - the offset is in 1/256ths of a bin
+    int num = (Power[peak+1] - Power[peak-1]) >> 8;
+    int den = (2*Power[peak] - Power[peak-1] - Power[peak+1]) >> 8;
+    if( den > 0 ) {
+      int offset = num * 128 / den;
+      hz += offset * (BinHz[peak+1] - BinHz[peak-1]) / 512;
+    }
+  }
+  return hz;
+}
+
+
+static void NoiseTrack_Thread( void * par )
+{
+  volatile int * raw = Sensors_GyroHistory();
+
+  int lastX = raw[0], lastY = raw[6], lastZ = raw[12];
+  int center = 0;         // Notch center from the prefs
+  int applied = 0;        // Center the notch was last moved to
+  int scale = 0;          // Guessed hz per unit of throttle, 16 bit fixed point
+  int thr = 0, hint = 0, count = 0;
+
+  while( true )
+  {
+    // Z is filtered last, so once it changes, X and Y hold the same sample.  Two identical Z
+    // samples in a row are missed, which just makes that block a little longer.
+    int z = raw[12];
+    if( z == lastZ ) continue;
+    lastZ = z;
+
+    // The change from the last sample drops the gyro bias and stick movement, and favors high frequencies
+    int x = raw[0], y = raw[6];
+    int dx = x - lastX, dy = y - lastY;
+    lastX = x;
+    lastY = y;
+
+    if( count > 0 )
+    {
+      AddSample( dx, dy );
+      if( --count > 0 ) continue;
+
+      // Nudge the guess toward what was measured, unless the motors are too close to idle to say much
+      int hz = Measure();
+      if( hz != 0 && thr >= ThrottleRange / 4 ) {
+        scale += ((hz << 16) / thr - scale) >> 2;
+      }
+      Frequency = hz ? hz : hint;
+    }
+
+    if( PrefsChanged ) {
+      PrefsChanged = 0;
+      center = NotchOn ? NotchCenter() : 0;
+      applied = center;
+      thr = 0;
+    }
+    else {
+      thr = Throttle;
+    }
+
+    if( center == 0 || thr <= 0 )
+    {
+      // Motors stopped - start over from the notch in the prefs
+      Frequency = center;
+      scale = (center << 16) / ThrottleRange;
+    }
+
+    if( Frequency != applied ) {
+      Sensors_SetGyroNotchCenter( NotchA1For(Frequency) );
+      applied = Frequency;
+    }
+
+    if( center == 0 || thr <= 0 ) continue;
+
+    hint = MaxHz;
+    if( thr < (MaxHz << 16) / scale ) hint = (scale * thr) >> 16;    // The check keeps scale * thr in range
+    if( hint < MinHz ) hint = MinHz;
+
+    StartBlock( hint );
+    count = BlockSize;
+  }
+}
+
+
+void NoiseTrack_Start(void)
+{
+  cogstart( &NoiseTrack_Thread , NULL, noisetrack_stack, sizeof(noisetrack_stack) );
+}
+
+void NoiseTrack_SetPrefs( short * Notch, int Range )
+{
+  NotchOn = Notch[0] != 0;
+  NotchA1 = Notch[3];
+  NotchA2 = Notch[4];
+  ThrottleRange = Range > 0 ? Range : 1;
+  PrefsChanged = 1;
+}
+
+void NoiseTrack_SetThrottle( int Thr )
+{
+  Throttle = Thr;
+}
+
+int NoiseTrack_Frequency(void)
+{
+  return Frequency;
+}
@@ -0,0 +1,36 @@
+#ifndef __NOISETRACK_H__
+#define __NOISETRACK_H__
+
+/*
+  This file is part of the ELEV-8 Flight Controller Firmware
+  for Parallax part #80204, Revisions A & B
+
+  Copyright 2016 Parallax Incorporated
+
+  ELEV-8 Flight Controller Firmware is free software: you can redistribute it and/or modify it
+  under the terms of the GNU General Public License as published by the Free Software Foundation,
+  either version 3 of the License, or (at your option) any later version.
+
+  ELEV-8 Flight Controller Firmware is distributed in the hope that it will be useful, but
+  WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+  FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with the ELEV-8 Flight Controller Firmware.  If not, see <http://www.gnu.org/licenses/>.
+
+  Written by Jason Dorie
+*/
+
+// Motor noise tracker.  Motor vibration moves with throttle, so a notch fixed at one frequency only
+// works part of the time.  This runs in its own cog on the raw 952hz gyro samples, looks for the
+// strongest noise near where the motor outputs say it should be, and moves the gyro notch to it.
+// The notch width and starting frequency come from the prefs - with the notch off, it does nothing.
+
+void NoiseTrack_Start(void);
+void NoiseTrack_SetPrefs( short * Notch, int ThrottleRange );   // Notch coefficients, and CenterThrottle - MinThrottle
+void NoiseTrack_SetThrottle( int Throttle );    // Average motor output above MinThrottle, 0 when disarmed
+int  NoiseTrack_Frequency(void);                // Current notch center in hz, 0 if the notch is off
+
+#define NOISETRACK_STACK_SIZE (32 + 40)       // stack needs to accomodate thread control structure (40) plus room for functions (32)
+
+#endif
@@ -21,6 +21,7 @@
 */
 
 #include <string.h>   // for memset()
+#include <stddef.h>   // for offsetof()
 #include <fdserial.h>
 
 #include "eeprom.h"
@@ -30,13 +31,167 @@
 
 PREFS Prefs;
 
+#define PREFS_EEPROM_ADDR   32768
+#define EEPROM_PAGE_SIZE    64      // 24LC256 write page - PREFS_EEPROM_ADDR is page aligned
+
+static char DirtyPages;             // One bit per EEPROM page of Prefs that changed since the last write
+
+
+struct PARAM {
+  unsigned char Offset;
+  unsigned char Type;
+  short Min, Max;
+};
+
+#define PARAM(field, type, lo, hi)  { offsetof(PREFS, field), type, lo, hi }
+
+// The order here defines the param IDs - GroundStation has a matching table in prefs.cpp
+static const PARAM ParamTable[] = {
+  PARAM( DriftScale[0],  Param_Int, 0, 0 ),
+  PARAM( DriftScale[1],  Param_Int, 0, 0 ),
+  PARAM( DriftScale[2],  Param_Int, 0, 0 ),
+  PARAM( DriftOffset[0], Param_Int, 0, 0 ),
+  PARAM( DriftOffset[1], Param_Int, 0, 0 ),
+  PARAM( DriftOffset[2], Param_Int, 0, 0 ),
+  PARAM( AccelOffset[0], Param_Int, 0, 0 ),
+  PARAM( AccelOffset[1], Param_Int, 0, 0 ),
+  PARAM( AccelOffset[2], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[0], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[1], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[2], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[3], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[4], Param_Int, 0, 0 ),
+  PARAM( MagScaleOfs[5], Param_Int, 0, 0 ),
+
+  PARAM( RollCorrect[0],      Param_Float, 0, 0 ),
+  PARAM( RollCorrect[1],      Param_Float, 0, 0 ),
+  PARAM( PitchCorrect[0],     Param_Float, 0, 0 ),
+  PARAM( PitchCorrect[1],     Param_Float, 0, 0 ),
+  PARAM( AutoLevelRollPitch,  Param_Float, 0, 0 ),
+  PARAM( AutoLevelYawRate,    Param_Float, 0, 0 ),
+  PARAM( ManualRollPitchRate, Param_Float, 0, 0 ),
+  PARAM( ManualYawRate,       Param_Float, 0, 0 ),
+
+  PARAM( PitchGain,       Param_Char, 0, 255 ),
+  PARAM( RollGain,        Param_Char, 0, 255 ),
+  PARAM( YawGain,         Param_Char, 0, 255 ),
+  PARAM( AscentGain,      Param_Char, 0, 255 ),
+  PARAM( AltiGain,        Param_Char, 0, 255 ),
+  PARAM( PitchRollLocked, Param_Char, 0, 1 ),
+  PARAM( UseAdvancedPID,  Param_Char, 0, 1 ),
+  PARAM( ReceiverType,    Param_Char, 0, 4 ),
+  PARAM( UseBattMon,      Param_Char, 0, 1 ),
+  PARAM( DisableMotors,   Param_Char, 0, 1 ),
+  PARAM( LowVoltageAlarm,       Param_Char, 0, 1 ),
+  PARAM( LowVoltageAscentLimit, Param_Char, 0, 1 ),
+
+  PARAM( ThrottleTest,     Param_Short, 1000*8, 2000*8 ),
+  PARAM( MinThrottle,      Param_Short, 1000*8, 2000*8 ),
+  PARAM( MaxThrottle,      Param_Short, 1000*8, 2000*8 ),
+  PARAM( CenterThrottle,   Param_Short, 1000*8, 2000*8 ),
+  PARAM( MinThrottleArmed, Param_Short, 1000*8, 2000*8 ),
+  PARAM( ArmDelay,         Param_Short, 0, 2500 ),
+  PARAM( DisarmDelay,      Param_Short, 0, 2500 ),
+  PARAM( ThrustCorrectionScale,    Param_Short, 0, 256 ),
+  PARAM( AccelCorrectionFilter,    Param_Short, 0, 256 ),
+  PARAM( VoltageOffset,            Param_Short, -1000, 1000 ),
+  PARAM( LowVoltageAlarmThreshold, Param_Short, 0, 5000 ),
+
+  PARAM( FlightMode[0],           Param_Char, 0, 3 ),
+  PARAM( FlightMode[1],           Param_Char, 0, 3 ),
+  PARAM( FlightMode[2],           Param_Char, 0, 3 ),
+  PARAM( AccelCorrectionStrength, Param_Char, 0, 255 ),
+
+  PARAM( ThroChannel, Param_Char, 0, 7 ),
+  PARAM( AileChannel, Param_Char, 0, 7 ),
+  PARAM( ElevChannel, Param_Char, 0, 7 ),
+  PARAM( RuddChannel, Param_Char, 0, 7 ),
+  PARAM( GearChannel, Param_Char, 0, 7 ),
+  PARAM( Aux1Channel, Param_Char, 0, 7 ),
+  PARAM( Aux2Channel, Param_Char, 0, 7 ),
+  PARAM( Aux3Channel, Param_Char, 0, 7 ),
+
+  PARAM( ThroScale, Param_Short, -4096, 4096 ),
+  PARAM( AileScale, Param_Short, -4096, 4096 ),
+  PARAM( ElevScale, Param_Short, -4096, 4096 ),
+  PARAM( RuddScale, Param_Short, -4096, 4096 ),
+  PARAM( GearScale, Param_Short, -4096, 4096 ),
+  PARAM( Aux1Scale, Param_Short, -4096, 4096 ),
+  PARAM( Aux2Scale, Param_Short, -4096, 4096 ),
+  PARAM( Aux3Scale, Param_Short, -4096, 4096 ),
+
+  PARAM( ThroCenter, Param_Short, -32768, 32767 ),
+  PARAM( AileCenter, Param_Short, -32768, 32767 ),
+  PARAM( ElevCenter, Param_Short, -32768, 32767 ),
+  PARAM( RuddCenter, Param_Short, -32768, 32767 ),
+  PARAM( GearCenter, Param_Short, -32768, 32767 ),
+  PARAM( Aux1Center, Param_Short, -32768, 32767 ),
+  PARAM( Aux2Center, Param_Short, -32768, 32767 ),
+  PARAM( Aux3Center, Param_Short, -32768, 32767 ),
+
+  PARAM( GyroLowPass[0], Param_Short, -32768, 32767 ),
+  PARAM( GyroLowPass[1], Param_Short, -32768, 32767 ),
+  PARAM( GyroLowPass[2], Param_Short, -32768, 32767 ),
+  PARAM( GyroLowPass[3], Param_Short, -32768, 32767 ),
+  PARAM( GyroLowPass[4], Param_Short, -32768, 32767 ),
+  PARAM( GyroNotch[0],   Param_Short, -32768, 32767 ),
+  PARAM( GyroNotch[1],   Param_Short, -32768, 32767 ),
+  PARAM( GyroNotch[2],   Param_Short, -32768, 32767 ),
+  PARAM( GyroNotch[3],   Param_Short, -32768, 32767 ),
+  PARAM( GyroNotch[4],   Param_Short, -32768, 32767 ),
+
+  PARAM( DriftCurve[0],  Param_Int, 0, 0 ),
+  PARAM( DriftCurve[1],  Param_Int, 0, 0 ),
+  PARAM( DriftCurve[2],  Param_Int, 0, 0 ),
+};
+
+static const unsigned char ParamSize[] = { 1, 2, 4, 4 };   // Indexed by PARAM_TYPE
+
+
+// Sizes of the Prefs saved by earlier firmware.  New fields only ever go just before Checksum, so an
+// old copy is the start of the current struct with its own checksum in the last long.
+static const unsigned short OldPrefsSize[] = {
+  offsetof(PREFS, GyroLowPass) + 4,     // Before the gyro filters
+  offsetof(PREFS, DriftCurve) + 4,      // Before the drift curvature
+};
+
+
+static int ChecksumLongs( void * p, int count )
+{
+  unsigned int r = 0x55555555;            //Start with a strange, known value
+  for( int i=0; i < count; i++ )
+  {
+    r = (r << 7) | (r >> (32-7));
+    r = r ^ ((unsigned int*)p)[i];        //Jumble the bits, XOR in the prefs value
+  }
+  return (int)r;
+}
+
+
+// Keeps the calibration in prefs saved by older firmware instead of resetting everything to defaults.
+// The fields added since start out zero, which is what turns each of them off.
+static int Prefs_Upgrade(void)
+{
+  for( int i=0; i < sizeof(OldPrefsSize) / sizeof(OldPrefsSize[0]); i++ )
+  {
+    int longs = OldPrefsSize[i] / 4;
+    if( ChecksumLongs( &Prefs, longs-1 ) != ((int *)&Prefs)[longs-1] ) continue;
+
+    int start = OldPrefsSize[i] - 4;
+    memset( (char *)&Prefs + start, 0, offsetof(PREFS, Checksum) - start );
+    Prefs_Save();
+    return 1;
+  }
+  return 0;
+}
+
 
 int Prefs_Load(void)
 {
   EEPROM::ToRam( &Prefs, (char *)&Prefs + sizeof(Prefs)-1, 32768 );    //Copy from EEPROM to DAT, address 32768
 
   int testChecksum = Prefs_CalculateChecksum( Prefs );
-  if( testChecksum != Prefs.Checksum )
+  if( testChecksum != Prefs.Checksum && !Prefs_Upgrade() )
   {
     Prefs_SetDefaults();
     Prefs_Save();
@@ -49,6 +204,75 @@ void Prefs_Save(void)
 {
   Prefs.Checksum = Prefs_CalculateChecksum( Prefs );
   EEPROM::FromRam( &Prefs, (char *)&Prefs + sizeof(Prefs)-1, 32768 );  //Copy from DAT to EEPROM, address 32768
+  DirtyPages = 0;
+}
+
+
+int Prefs_ParamCount(void)
+{
+  return sizeof(ParamTable) / sizeof(ParamTable[0]);
+}
+
+
+char Prefs_GetParam( int id, int * value, char * type )
+{
+  if( id < 0 || id >= Prefs_ParamCount() ) return Param_BadID;
+
+  const PARAM & p = ParamTable[id];
+  char * field = (char *)&Prefs + p.Offset;
+  *type = p.Type;
+
+  switch( p.Type ) {
+    case Param_Char:  *value = *(unsigned char *)field; break;
+    case Param_Short: *value = *(short *)field;         break;
+    default:          *value = *(int *)field;           break;   // floats are sent as their raw bits
+  }
+  return Param_OK;
+}
+
+
+char Prefs_SetParam( int id, int value )
+{
+  if( id < 0 || id >= Prefs_ParamCount() ) return Param_BadID;
+
+  const PARAM & p = ParamTable[id];
+  char * field = (char *)&Prefs + p.Offset;
+
+  if( p.Type == Param_Char || p.Type == Param_Short ) {
+    if( value < p.Min || value > p.Max ) return Param_OutOfRange;
+  }
+
+  switch( p.Type ) {
+    case Param_Char:  *(char *)field = value;   break;
+    case Param_Short: *(short *)field = value;  break;
+    default:          *(int *)field = value;    break;
+  }
+
+  Prefs.Checksum = Prefs_CalculateChecksum( Prefs );
+
+  DirtyPages |= 1 << (p.Offset / EEPROM_PAGE_SIZE);
+  DirtyPages |= 1 << ((p.Offset + ParamSize[p.Type] - 1) / EEPROM_PAGE_SIZE);
+  DirtyPages |= 1 << (offsetof(PREFS, Checksum) / EEPROM_PAGE_SIZE);
+  return Param_OK;
+}
+
+
+char Prefs_SaveDirty(void)
+{
+  // Lowest page first, so the checksum (at the end) is written last
+  for( int page = 0; page * EEPROM_PAGE_SIZE < sizeof(Prefs); page++ )
+  {
+    if( (DirtyPages & (1 << page)) == 0 ) continue;
+    DirtyPages &= ~(1 << page);
+
+    int start = page * EEPROM_PAGE_SIZE;
+    int end = start + EEPROM_PAGE_SIZE;
+    if( end > sizeof(Prefs) ) end = sizeof(Prefs);
+
+    EEPROM::FromRam( (char *)&Prefs + start, (char *)&Prefs + end-1, PREFS_EEPROM_ADDR + start );
+    break;
+  }
+  return DirtyPages != 0;
 }
 
 #define PI  3.141592654
@@ -129,13 +353,7 @@ void Prefs_SetDefaults(void)
 
 int Prefs_CalculateChecksum(PREFS & PrefsStruct )
 {
-  unsigned int r = 0x55555555;            //Start with a strange, known value
-  for( int i=0; i < (sizeof(PrefsStruct)/4)-1; i++ )
-  {
-    r = (r << 7) | (r >> (32-7));
-    r = r ^ ((unsigned int*)&PrefsStruct)[i];     //Jumble the bits, XOR in the prefs value
-  }    
-  return (int)r;
+  return ChecksumLongs( &PrefsStruct, (sizeof(PrefsStruct)/4)-1 );
 }
 
 
@@ -50,7 +50,7 @@ typedef struct {
   char  UseAdvancedPID;
   char  unused;
 
-  char  ReceiverType;     // 0 = PWM, 1 = SBUS, 2 = PPM, 3 = RemoteRX
+  char  ReceiverType;     // 0 = PWM, 1 = SBUS, 2 = PPM, 3 = RemoteRX, 4 = CRSF
   char  unused2;
   char  UseBattMon;
   char  DisableMotors;
@@ -102,6 +102,14 @@ typedef struct {
   short Aux2Center;
   short Aux3Center;
 
+  // Fields added since the first release.  New ones only ever go here, just before Checksum, with the
+  // old size added to OldPrefsSize in prefs.cpp, so prefs saved by older firmware carry over.
+
+  short GyroLowPass[5];   // Gyro biquads, run by the sensors cog at the 952hz sample rate.  12 bit fixed point
+  short GyroNotch[5];     // b0, b1, b2, -a1, -a2 (so 4096 = 1.0).  b0 = 0 turns the filter off
+
+  int   DriftCurve[3];    // Gyro drift curvature: (temp * temp / 256) / DriftCurve is added to the drift, 0 = linear only
+
   int   Checksum;
 
   // Accessors for looping over channel assignments, scales, centers
@@ -123,4 +131,26 @@ void Prefs_Test(void);
 
 int Prefs_CalculateChecksum( PREFS & PrefsStruct );
 
+
+// Individual parameters, addressed by ID (index into the table in prefs.cpp).  IDs are shared with
+// GroundStation, so only ever add new ones to the end.
+enum PARAM_TYPE {
+  Param_Char = 0,
+  Param_Short = 1,
+  Param_Int = 2,      // Int and Float params aren't range checked
+  Param_Float = 3,
+};
+
+enum PARAM_RESULT {
+  Param_OK = 0,
+  Param_BadID = 1,
+  Param_OutOfRange = 2,
+  Param_Locked = 3,   // Not allowed while armed
+};
+
+int  Prefs_ParamCount(void);
+char Prefs_GetParam( int id, int * value, char * type );
+char Prefs_SetParam( int id, int value );   // Updates the checksum and marks the EEPROM page(s) dirty, but doesn't write them
+char Prefs_SaveDirty(void);                 // Writes one dirty EEPROM page, returns non-zero if more are waiting
+
 #endif
@@ -28,11 +28,13 @@
 #define RadToDeg (180.0 / 3.141592654)                         //Degrees per Radian
 #define GyroToDeg  (1000.0 / 70.0)                             //Gyro units per degree @ 2000 deg/sec sens = 70 mdps/bit
 #define AccToG  (float)(Const_OneG)                            //Accelerometer per G @ 8g sensitivity = ~0.24414 mg/bit 
-#define GyroScale  (GyroToDeg * RadToDeg * (float)Const_UpdateRate)
+#define GyroScale  (GyroToDeg * RadToDeg)                       //Gyro units per radian/sec - the time step is applied per update
 
 
-const float Startup_ErrScale = 1.0f/32.0f;      // Converge quickly on startup
-const float Running_ErrScale = 1.0f/512.0f;     // Converge more slowly once up & running
+const float Running_ErrScale = 1.0f/512.0f;     // Converge slowly - QuatIMU_InitOrientation() gives the starting point
+const float BiasGain = 0.1f;                    // Fraction of each correction that goes into the gyro bias estimate
+const float BiasGainArmed = BiasGain / 16.0f;   // Flying, thrust and turns skew the accelerometer, so the estimate only creeps
+const float BiasLimit = 3.0f / RadToDeg;        // Largest bias (radians/sec) the estimate can add to the gyro zero
 
 
 static int  zx, zy, zz;                          // Gyro zero readings
@@ -58,6 +60,8 @@ enum IMU_VarLabels {
     ax, ay, az,                                  // Sensor inputs
     mx, my, mz,
     alt, altRate,
+    dtCycles,                                    // Clock cycles covered by the current gyro samples
+    gyroBiasX, gyroBiasY, gyroBiasZ,             // Bias estimate in gyro units, added to the gyro zero readings
 
     // Integer constants used in computation
     const_0,
@@ -83,6 +87,9 @@ enum IMU_VarLabels {
     fwx, fwy, fwz,                               // Quaternion to matrix temp coefficients
     fxy, fxz, fyz,
 
+    dt,                                          // Seconds covered by the current gyro samples
+    gyroScaleDt, negGyroScaleDt,                 // Gyro units to radians over dt
+
     rx, ry, rz,                                  // Float versions of rotation components
     fax, fay, faz,                               // Float version of accelerometer vector
     fmx, fmy, fmz,                               // Float version of magnetometer vector
@@ -93,6 +100,8 @@ enum IMU_VarLabels {
     
     errDiffX, errDiffY, errDiffZ,                // holds difference vector between target and measured orientation
     errCorrX, errCorrY, errCorrZ,                // computed rotation correction factor
+    errIntX, errIntY, errIntZ,                   // integrated correction - the gyro bias estimate, radians/sec
+    biasGain,                                    // Fraction of each correction added to errInt, lower while armed
     
     temp,                                        // temp value for use in equations
 
@@ -151,10 +160,13 @@ enum IMU_VarLabels {
 
     const_AccErrScale,
     const_MagErrScale,
+    const_BiasLimit,
+    const_NegGyroUnits,
+    const_GyroUnits,
     const_AccScale,
     const_ThrustShift,
     const_G_mm_PerSec,
-    const_UpdateScale,
+    const_CyclesToSeconds,
 
     const_velAccScale,
     const_velAltiScale,
@@ -200,6 +212,8 @@ void QuatIMU_Start(void)
   IMU_VARS[qz] = 0.0f;
   IMU_VARS[qw] = 1.0f;
 
+  IMU_VARS[biasGain] = BiasGain;
+
   IMU_VARS[accRollCorrSin] = 0.0f;                       // used to correct the accelerometer vector angle offset
   IMU_VARS[accRollCorrCos] = 1.0f;
   IMU_VARS[accPitchCorrSin] = 0.0f;
@@ -224,12 +238,15 @@ void QuatIMU_Start(void)
   IMU_VARS[const_neghalf]           =   -0.5f;
 
 
-  IMU_VARS[const_AccErrScale]       =    Startup_ErrScale;  //How much accelerometer to fuse in each update (runs a little faster if it's a fractional power of two)
-  IMU_VARS[const_MagErrScale]       =    Startup_ErrScale;  //How much accelerometer to fuse in each update (runs a little faster if it's a fractional power of two)
+  IMU_VARS[const_AccErrScale]       =    Running_ErrScale;  //How much accelerometer to fuse in each update (runs a little faster if it's a fractional power of two)
+  IMU_VARS[const_MagErrScale]       =    Running_ErrScale;  //How much accelerometer to fuse in each update (runs a little faster if it's a fractional power of two)
   IMU_VARS[const_AccScale]          =    1.0f/(float)AccToG;//Conversion factor from accel units to G's
+  IMU_VARS[const_BiasLimit]         =    BiasLimit;
+  IMU_VARS[const_GyroUnits]         =    (float)GyroScale;  //Gyro units per radian/sec
+  IMU_VARS[const_NegGyroUnits]      =   -(float)GyroScale;
   INT_VARS[const_ThrustShift]       =    8;
   IMU_VARS[const_G_mm_PerSec]       =    9.80665f * 1000.0f;  // gravity in mm/sec^2
-  IMU_VARS[const_UpdateScale]       =    1.0f / (float)Const_UpdateRate;    //Convert units/sec to units/update
+  IMU_VARS[const_CyclesToSeconds]   =    1.0f / (float)Const_ClockFreq;     //Convert clock cycles to seconds
 
   IMU_VARS[const_velAccScale]       =    0.9995f;     // was 0.9995     - Used to generate the vertical velocity estimate
   IMU_VARS[const_velAltiScale]      =    0.0005f;     // was 0.0005
@@ -254,20 +271,6 @@ void QuatIMU_Start(void)
 }
 
 
-void QuatIMU_SetErrScaleMode( int IsStartup )
-{
-  if( IsStartup ) {
-    IMU_VARS[const_AccErrScale] = Startup_ErrScale;
-    IMU_VARS[const_MagErrScale] = Startup_ErrScale;
-  }
-  else {
-    IMU_VARS[const_AccErrScale] = Running_ErrScale;
-    IMU_VARS[const_MagErrScale] = Running_ErrScale;
-  }
-}
-
-
-
 int QuatIMU_GetYaw(void) {
   return INT_VARS[ Yaw ];
 }
@@ -392,6 +395,22 @@ void QuatIMU_SetGyroZero( int x, int y, int z )
   zx = x;
   zy = y;
   zz = z;
+
+  // A new zero reading replaces whatever bias had been learned on top of the old one
+  IMU_VARS[errIntX] = IMU_VARS[errIntY] = IMU_VARS[errIntZ] = 0.0f;
+  INT_VARS[gyroBiasX] = INT_VARS[gyroBiasY] = INT_VARS[gyroBiasZ] = 0;
+}
+
+void QuatIMU_SetArmed( bool Armed )
+{
+  IMU_VARS[biasGain] = Armed ? BiasGainArmed : BiasGain;
+}
+
+void QuatIMU_GetGyroZero( int * dest )
+{
+  dest[0] = zx + INT_VARS[gyroBiasX];
+  dest[1] = zy + INT_VARS[gyroBiasY];
+  dest[2] = zz + INT_VARS[gyroBiasZ];
 }
 
 
@@ -408,9 +427,9 @@ void QuatIMU_SetGyroZero( int x, int y, int z )
   '  http://mathinfo.univ-reims.fr/IMG/pdf/Rotating_Objects_Using_Quaternions.pdf
 
   {
-  rx = gx / GyroScale + errCorrX
-  ry = gy / GyroScale + errCorrY
-  rz = gz / GyroScale + errCorrZ
+  rx = gx * dt / GyroScale + errIntX * dt + errCorrX
+  ry = gy * dt / GyroScale + errIntY * dt + errCorrY
+  rz = gz * dt / GyroScale + errIntZ * dt + errCorrZ
 
   rmag = sqrt(rx * rx + ry * ry + rz * rz + 0.0000000001) / 2.0 
 
@@ -442,26 +461,42 @@ void QuatIMU_AdjustStreamPointers( unsigned char * p )
 
 
 
-  //fgx = gx / GyroScale + errCorrX
+  //fgx = gx * dt / GyroScale + errCorrX
               
 unsigned char QuatUpdateCommands[] = {
 
+  //--------------------------------------------------------------
+  // Compute the time step from the sample timestamps, so a late
+  // update integrates the full rotation instead of losing some
+  //--------------------------------------------------------------
+
+        F32_opFloat, dtCycles, 0, dt,                     //dt = float(dtCycles)
+        F32_opMul, dt, const_CyclesToSeconds, dt,         //dt /= ClockFreq
+        F32_opMul, dt, const_GyroScale, gyroScaleDt,      //gyroScaleDt = dt / GyroScale
+        F32_opMul, dt, const_NegGyroScale, negGyroScaleDt,//negGyroScaleDt = -dt / GyroScale
+
   //--------------------------------------------------------------
   // Convert the gyro rates to radians, add in the previous cycle error corrections
   //--------------------------------------------------------------
   
         F32_opFloat, gx, 0, rx,                           //rx = float(gx)
-        F32_opMul, rx, const_GyroScale, rx,               //rx /= GyroScale
+        F32_opMul, rx, gyroScaleDt, rx,                   //rx *= dt / GyroScale
+        F32_opMul, errIntX, dt, temp,                     //temp = errIntX * dt
+        F32_opAdd, rx, temp, rx,                          //rx += temp
         F32_opAdd, rx, errCorrX, rx,                      //rx += errCorrX
 
   //fgy = gy / GyroScale + errCorrY
         F32_opFloat, gz,  0, ry,                          //ry = float(gz)
-        F32_opMul, ry, const_NegGyroScale, ry,            //ry /= GyroScale
+        F32_opMul, ry, negGyroScaleDt, ry,                //ry *= -dt / GyroScale
+        F32_opMul, errIntY, dt, temp,                     //temp = errIntY * dt
+        F32_opAdd, ry, temp, ry,                          //ry += temp
         F32_opAdd, ry, errCorrY, ry,                      //ry += errCorrY
 
   //fgz = gz / GyroScale + errCorrZ
         F32_opFloat, gy, 0, rz,                           //rz = float(gy)
-        F32_opMul, rz, const_NegGyroScale, rz,            //rz /= GyroScale
+        F32_opMul, rz, negGyroScaleDt, rz,                //rz *= -dt / GyroScale
+        F32_opMul, errIntZ, dt, temp,                     //temp = errIntZ * dt
+        F32_opAdd, rz, temp, rz,                          //rz += temp
         F32_opAdd, rz, errCorrZ, rz,                      //rz += errCorrZ
 
 
@@ -750,6 +785,45 @@ unsigned char QuatUpdateCommands[] = {
         F32_opMul, errDiffZ,  accWeight, errCorrZ,  
 
 
+  //--------------------------------------------------------------
+  // Integrate the correction into a gyro bias estimate.  A steady
+  // correction in one direction means the gyro zero is off, so
+  // this slowly takes over from the correction above, and keeps
+  // working the whole time instead of only at startup.  Armed, the
+  // gain drops, since acceleration in flight looks like tilt.
+  //--------------------------------------------------------------
+
+  //errInt = Clamp( errInt + errCorr * biasGain, -BiasLimit, BiasLimit )
+        F32_opMul, errCorrX,  biasGain, temp,
+        F32_opAdd, errIntX,  temp, errIntX,
+        F32_opFMin, errIntX,  const_BiasLimit, errIntX,
+        F32_opNeg, errIntX,  0, errIntX,
+        F32_opFMin, errIntX,  const_BiasLimit, errIntX,
+        F32_opNeg, errIntX,  0, errIntX,
+
+        F32_opMul, errCorrY,  biasGain, temp,
+        F32_opAdd, errIntY,  temp, errIntY,
+        F32_opFMin, errIntY,  const_BiasLimit, errIntY,
+        F32_opNeg, errIntY,  0, errIntY,
+        F32_opFMin, errIntY,  const_BiasLimit, errIntY,
+        F32_opNeg, errIntY,  0, errIntY,
+
+        F32_opMul, errCorrZ,  biasGain, temp,
+        F32_opAdd, errIntZ,  temp, errIntZ,
+        F32_opFMin, errIntZ,  const_BiasLimit, errIntZ,
+        F32_opNeg, errIntZ,  0, errIntZ,
+        F32_opFMin, errIntZ,  const_BiasLimit, errIntZ,
+        F32_opNeg, errIntZ,  0, errIntZ,
+
+  //gyroBias = round( errInt * GyroScale ) - in raw gyro axes, so rx is -gx, ry is gz, rz is gy
+        F32_opMul, errIntX,  const_NegGyroUnits, temp,
+        F32_opTruncRound, temp,  const_1, gyroBiasX,
+        F32_opMul, errIntY,  const_GyroUnits, temp,
+        F32_opTruncRound, temp,  const_1, gyroBiasZ,
+        F32_opMul, errIntZ,  const_GyroUnits, temp,
+        F32_opTruncRound, temp,  const_1, gyroBiasY,
+
+
   // compute heading using Atan2 and the Z vector of the orientation matrix
         
         F32_opATan2, m20,  m22, FloatYaw,
@@ -879,8 +953,8 @@ unsigned char QuatUpdateCommands[] = {
   //forceWY *= 9.8 * 1000.0                                       //Convert to mm/sec^2
         F32_opMul, forceWY,  const_G_mm_PerSec, forceWY,
 
-        F32_opMul, forceWY,  const_UpdateScale, temp,             //temp := forceWY / UpdateRate
-        F32_opAdd, velocityEstimate,  temp, velocityEstimate,     //velEstimate += forceWY / UpdateRate
+        F32_opMul, forceWY,  dt, temp,                            //temp := forceWY * dt
+        F32_opAdd, velocityEstimate,  temp, velocityEstimate,     //velEstimate += forceWY * dt
   
   
         F32_opFloat, altRate,  0, altitudeVelocity,                //AltVelocity = float(altRate)
@@ -891,8 +965,8 @@ unsigned char QuatUpdateCommands[] = {
         F32_opMul, altitudeVelocity,  const_velAltiScale, temp,  
         F32_opAdd, velocityEstimate,  temp, velocityEstimate,   
 
-  //altitudeEstimate += velocityEstimate / UpdateRate
-        F32_opMul, velocityEstimate,  const_UpdateScale, temp,
+  //altitudeEstimate += velocityEstimate * dt
+        F32_opMul, velocityEstimate,  dt, temp,
         F32_opAdd, altitudeEstimate,  temp, altitudeEstimate,   
 
   //altitudeEstimate := (altitudeEstimate * 0.9950) * alti * 0.0050
@@ -1194,6 +1268,112 @@ unsigned char UpdateControls_ComputeOrientationChange[] = {
 };
 
 
+unsigned char InitOrientationCommands[] = {
+
+  //---------------------------------------------------------------------------
+  // Point the orientation straight at the averaged accelerometer and compass
+  // readings instead of starting level and waiting for the updates to pull it
+  // around.  Roll and pitch come from the accelerometer, the heading from the
+  // compass vector once it's rotated level.  The result is built the same way
+  // as the control quaternion - Q = Yaw * Roll * Pitch, from the half-angles.
+  //---------------------------------------------------------------------------
+
+  // Accelerometer vector in IMU axes, with the same angle offset correction as the update
+
+  F32_opFloat,  ax, 0, fax,
+  F32_opFloat,  az, 0, fay,
+  F32_opFloat,  ay, 0, faz,
+  F32_opNeg,    fax, 0, fax,
+
+  F32_opMul,    fax, accRollCorrCos, axRot,           // axRot = (fax * accRollCorrCos) - (fay * accRollCorrSin)
+  F32_opMul,    fay, accRollCorrSin, temp,
+  F32_opSub,    axRot, temp, axRot,
+  F32_opMul,    fax, accRollCorrSin, ayRot,           // ayRot = (fax * accRollCorrSin) + (fay * accRollCorrCos)
+  F32_opMul,    fay, accRollCorrCos, temp,
+  F32_opAdd,    ayRot, temp, ayRot,
+  F32_opMov,    axRot, 0, fax,
+  F32_opMov,    ayRot, 0, fay,
+
+  F32_opMul,    faz, accPitchCorrCos, axRot,          // axRot = (faz * accPitchCorrCos) - (fay * accPitchCorrSin)
+  F32_opMul,    fay, accPitchCorrSin, temp,
+  F32_opSub,    axRot, temp, axRot,
+  F32_opMul,    faz, accPitchCorrSin, ayRot,          // ayRot = (faz * accPitchCorrSin) + (fay * accPitchCorrCos)
+  F32_opMul,    fay, accPitchCorrCos, temp,
+  F32_opAdd,    ayRot, temp, ayRot,
+  F32_opMov,    axRot, 0, faz,
+  F32_opMov,    ayRot, 0, fay,
+
+  // The up vector of Yaw * Roll * Pitch in body axes is ( sin(roll), cos(roll)*cos(pitch), -cos(roll)*sin(pitch) )
+
+  F32_opNeg,    faz, 0, temp,
+  F32_opATan2,  temp, fay, rx,                        // rx = pitch = ATan2( -faz, fay )
+
+  F32_opMul,    fay, fay, rmag,                       // rmag = Sqrt( fay*fay + faz*faz )
+  F32_opMul,    faz, faz, temp,
+  F32_opAdd,    rmag, temp, rmag,
+  F32_opSqrt,   rmag, 0, rmag,
+  F32_opATan2,  fax, rmag, rz,                        // rz = roll = ATan2( fax, rmag )
+
+  // Compass vector in IMU axes, rotated by pitch then roll to take the tilt out of it
+
+  F32_opFloat,  mx, 0, fmx,
+  F32_opFloat,  mz, 0, fmy,
+  F32_opFloat,  my, 0, fmz,
+
+  F32_opSinCos, rx, snx, csx,                         // snx = Sin(pitch), csx = Cos(pitch)
+  F32_opSinCos, rz, snz, csz,                         // snz = Sin(roll), csz = Cos(roll)
+
+  F32_opMul,    fmy, snx, omz,                        // omz = fmy * snx + fmz * csx
+  F32_opMul,    fmz, csx, temp,
+  F32_opAdd,    omz, temp, omz,
+  F32_opMul,    fmy, csx, omy,                        // omy = fmy * csx - fmz * snx
+  F32_opMul,    fmz, snx, temp,
+  F32_opSub,    omy, temp, omy,
+  F32_opMul,    fmx, csz, omx,                        // omx = fmx * csz - omy * snz
+  F32_opMul,    omy, snz, temp,
+  F32_opSub,    omx, temp, omx,
+
+  // Heading that turns the level compass vector onto +Z.  The epsilon makes a missing compass read as a heading of zero
+
+  F32_opNeg,    omx, 0, temp,
+  F32_opAdd,    omz, const_epsilon, omz,
+  F32_opATan2,  temp, omz, FloatYaw,                  // FloatYaw = ATan2( -omx, omz )
+
+  // Half-angles, then the quaternion
+
+  F32_opShift,  rx, const_neg1, rx,
+  F32_opShift,  rz, const_neg1, rz,
+  F32_opShift,  FloatYaw, const_neg1, HalfYaw,
+
+  F32_opSinCos, rx, snx, csx,                         // snx = Sin(rx), csx = Cos(rx)
+  F32_opSinCos, HalfYaw, sny, csy,                    // sny = Sin(ry), csy = Cos(ry)   (ry is heading)
+  F32_opSinCos, rz, snz, csz,                         // snz = Sin(rz), csz = Cos(rz)
+
+  F32_opMul,    sny, csx, snycsx,                     // snycsx = sny * csx
+  F32_opMul,    sny, snx, snysnx,                     // snysnx = sny * snx
+  F32_opMul,    csy, csz, csycsz,                     // csycsz = csy * csz
+  F32_opMul,    csy, snz, csysnz,                     // scssnz = csy * snz
+
+  F32_opMul,    snycsx, snz, qx,                      // qx =  snycsx * snz + csycsz * snx
+  F32_opMul,    csycsz, snx, temp,
+  F32_opAdd,    qx, temp, qx,
+
+  F32_opMul,    snycsx, csz, qy,                      // qy =  snycsx * csz + csysnz * snx
+  F32_opMul,    csysnz, snx, temp,
+  F32_opAdd,    qy, temp, qy,
+
+  F32_opMul,    csysnz, csx, qz,                      // qz = -snysnx * csz + csysnz * csx
+  F32_opMul,    snysnx, csz, temp,
+  F32_opSub,    qz, temp, qz,
+
+  F32_opMul,    csycsz, csx, qw,                      // qw = -snysnx * snz + csycsz * csx
+  F32_opMul,    snysnx, snz, temp,
+  F32_opSub,    qw, temp, qw,
+
+  0, 0, 0, 0
+};
+
+
 
 void QuatIMU_InitFunctions(void)
 {
@@ -1201,13 +1381,15 @@ void QuatIMU_InitFunctions(void)
   QuatIMU_AdjustStreamPointers( UpdateControls_Manual );
   QuatIMU_AdjustStreamPointers( UpdateControlQuaternion_AutoLevel );
   QuatIMU_AdjustStreamPointers( UpdateControls_ComputeOrientationChange );
+  QuatIMU_AdjustStreamPointers( InitOrientationCommands );
 }
 
 
 
-void QuatIMU_Update( int * packetAddr )
+void QuatIMU_Update( int * packetAddr , int Cycles )
 {
   memcpy( &IMU_VARS[gx], packetAddr, 11 * sizeof(int) );
+  INT_VARS[dtCycles] = Cycles;
 
   //Subtract gyro bias.  Probably better to do this in the sensor code, and ditto for accelerometer offset
 
@@ -1218,6 +1400,23 @@ void QuatIMU_Update( int * packetAddr )
   F32::RunStream( QuatUpdateCommands , IMU_VARS );
 }
 
+void QuatIMU_InitOrientation( int * accel , int * mag )
+{
+  F32::WaitStream();
+
+  memcpy( &IMU_VARS[ax], accel, 3 * sizeof(int) );
+  memcpy( &IMU_VARS[mx], mag, 3 * sizeof(int) );
+
+  F32::RunStream( InitOrientationCommands , IMU_VARS );
+  F32::WaitStream();
+
+  // Nothing left over from the old orientation should get applied to the new one
+  IMU_VARS[errCorrX] = IMU_VARS[errCorrY] = IMU_VARS[errCorrZ] = 0.0f;
+
+  QuatIMU_ResetDesiredOrientation();
+  QuatIMU_ResetDesiredYaw();
+}
+
 inline static int abs( int v )
 {
   return (v < 0) ? -v : v;
@@ -1231,7 +1430,7 @@ static int Deadband( int v , int db )
   return 0;
 }
 
-void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual )
+void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual , int Cycles )
 {
   if( ManualMode & AutoManual ) {
     // Auto-manual mode behaves differently - manual control takes over at half throw, so compress
@@ -1246,6 +1445,14 @@ void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual )
   }
   ((int*)IMU_VARS)[In_Rudd] = Deadband( Radio->Rudd, 24 );
 
+  // This only runs when a new radio frame arrives, so the inputs that are rates (all three in manual, yaw in
+  // auto-level) are scaled up to cover every cycle since the last frame
+  ((int*)IMU_VARS)[In_Rudd] *= Cycles;
+  if( ManualMode ) {
+    ((int*)IMU_VARS)[In_Elev] *= Cycles;
+    ((int*)IMU_VARS)[In_Aile] *= Cycles;
+  }
+
   if( ManualMode ) {
     F32::RunStream( UpdateControls_Manual , IMU_VARS );
   }
@@ -1258,6 +1465,12 @@ void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual )
 }
 
 
+void QuatIMU_UpdateOrientationChange(void)
+{
+  F32::RunStream( UpdateControls_ComputeOrientationChange , IMU_VARS );
+}
+
+
 void QuatIMU_WaitForCompletion(void)
 {
   F32::WaitStream();    // Wait for the stream to complete
@@ -26,7 +26,6 @@
 
 
 void QuatIMU_Start(void);
-void QuatIMU_SetErrScaleMode( int IsStartup );
 
 //int QuatIMU_GetYaw(void);
 int QuatIMU_GetRoll(void);
@@ -65,10 +64,14 @@ void QuatIMU_SetManualRates( float RollPitchRate, float YawRate );
 
 void QuatIMU_InitFunctions(void);
 void QuatIMU_SetGyroZero( int x, int y, int z );
+void QuatIMU_GetGyroZero( int * dest );        // Zero readings plus the bias the IMU has learned since, X, Y, Z
+void QuatIMU_SetArmed( bool Armed );            // The bias estimate keeps learning while armed, just more slowly
+void QuatIMU_InitOrientation( int * accel , int * mag );   // Raw accel and compass X, Y, Z (sums are fine) - sets the orientation they give
  
 
-void QuatIMU_Update( int * packetAddr );
-void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual );
+void QuatIMU_Update( int * packetAddr , int Cycles );                                                 // Cycles = clock cycles since the last samples
+void QuatIMU_UpdateControls( RADIO * Radio , bool ManualMode , bool AutoManual , int Cycles );    // Cycles = update cycles since the last call
+void QuatIMU_UpdateOrientationChange(void);     // For cycles with no new radio frame - the desired orientation holds
 
 void QuatIMU_WaitForCompletion(void);
 
@@ -29,10 +29,15 @@ static struct DATA {
   long  InputMask;
   long  BaudDelay;
   short Channels[18];  //Last two channels are digital
+
+  volatile long FrameTime;     // Written by the cog after each good frame, FrameCount last
+  volatile long LostFrames;
+  volatile long Failsafes;
+  volatile long FrameCount;
 } data;
 
 
-void SBUS::Start( int InputPin , bool UseRemoteRX )
+void SBUS::Start( int InputPin , Protocol protocol )
 {
   data.InputMask = 1 << InputPin;
 
@@ -40,19 +45,29 @@ void SBUS::Start( int InputPin , bool UseRemoteRX )
   for( int i=1; i<18; i++ ) {
     data.Channels[i] = 1024;     // All other channels are centered
   }
+  data.FrameTime = data.LostFrames = data.Failsafes = data.FrameCount = 0;
 
-  if( UseRemoteRX == false )
+  switch( protocol )
   {
-    data.BaudDelay = Const_ClockFreq / 100000;                        // SBUS is 100,000 bps 
-    use_cog_driver(sbus_driver);
-    Cog = load_cog_driver(sbus_driver, &data) + 1;
+    default:
+    case Futaba:
+      data.BaudDelay = Const_ClockFreq / 100000;                      // SBUS is 100,000 bps 
+      use_cog_driver(sbus_driver);
+      Cog = load_cog_driver(sbus_driver, &data) + 1;
+      break;
+
+    case RemoteRX:
+      data.BaudDelay = Const_ClockFreq / 115200;                      // RemoteRX is 115,200 bps
+      use_cog_driver(remote_rx_driver);
+      Cog = load_cog_driver(remote_rx_driver, &data) + 1;
+      break;
+
+    case CRSF:
+      data.BaudDelay = Const_ClockFreq / 420000;                      // CRSF is 420,000 bps
+      use_cog_driver(crsf_driver);
+      Cog = load_cog_driver(crsf_driver, &data) + 1;
+      break;
   }
-  else 
-  {
-    data.BaudDelay = Const_ClockFreq / 115200;                        // RemoteRX is 115,200 bps
-    use_cog_driver(remote_rx_driver);
-    Cog = load_cog_driver(remote_rx_driver, &data) + 1;
-  }    
 }
 
 
@@ -68,3 +83,8 @@ void SBUS::Stop(void)
 short SBUS::GetRC( int i ) {
   return data.Channels[i] - 1024;
 }
+
+long SBUS::FrameCount(void) { return data.FrameCount; }
+long SBUS::FrameTime(void)  { return data.FrameTime; }
+long SBUS::LostFrames(void) { return data.LostFrames; }
+long SBUS::Failsafes(void)  { return data.Failsafes; }
@@ -24,11 +24,23 @@
 class SBUS
 {
 public:
-	static void Start( int InputPin , bool UseRemoteRX );
+	enum Protocol {
+		Futaba,       // S-BUS, 100,000 bps inverted
+		RemoteRX,     // DSM2/2048 satellite, 115,200 bps
+		CRSF,         // Crossfire / ExpressLRS, 420,000 bps
+	};
+
+	static void Start( int InputPin , Protocol protocol );
 	static void Stop(void);
 
 	//static short Get( int i );
 	static short GetRC( int i );
+
+	// Published by the driver cog after each good frame
+	static long FrameCount(void);   // Goes up by one per frame - check it to see if the channels are new
+	static long FrameTime(void);    // CNT when the last frame finished arriving
+	static long LostFrames(void);   // S-BUS: frames the receiver flagged as lost.  RemoteRX: the receiver's fade count.  CRSF: frames that failed the CRC
+	static long Failsafes(void);    // S-BUS frames with the failsafe flag set (always 0 for RemoteRX and CRSF)
 };
 
 #endif
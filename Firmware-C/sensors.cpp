@@ -42,14 +42,14 @@
 
 
 static struct DATA {
-  int  ins[Sensors_ParamsCount];  //Temp, GX, GY, GZ, AX, AY, AZ, MX, MY, MZ, Alt, AltRate, AltTemp, Pressure, Timer
-  int  DriftScale[3];
-  int  DriftOffset[3];            //These values will be altered in the EEPROM by the Config Tool and Propeller Eeprom code                       
+  int  ins[Sensors_ParamsCount];  //Temp, GX, GY, GZ, AX, AY, AZ, MX, MY, MZ, Alt, AltRate, AltTemp, Pressure, Timer, Samples, Stamp
+  int  Drift[3][3];               //Offset, Scale, Curve for each gyro axis - these come from the prefs
   int  AccelOffset[3];
   int  MagOffsetX, MagScaleX, MagOffsetY, MagScaleY, MagOffsetZ, MagScaleZ;
+  int  GyroFilter[2][23];         //Low-pass then notch: b0, b1, b2, -a1, -a2, then x0, x1, x2, y1, y2, rounding for each gyro axis
 } data;
 
-static int DriftBackup[6];
+static int DriftBackup[3][3];
 static int AccelBackup[3];
 static int MagBackup[6];
 
@@ -69,7 +69,7 @@ void Sensors_Start( int ipin, int opin, int cpin, int sgpin, int smpin, int apin
 //   smpin   = pin connected to CS_M
 //   apin    = pin connected to CS on altimeter
 //   LEDPin  = pin connected to WS2812B LED array
-//   LEDAddr = HUB address of RGB values for LED array (updated constantly)
+//   LEDAddr = HUB address of a change counter, followed by the RGB values for the LED array
 //   LEDCount= Number of LED values to update  
 
 	Sensors_Stop();
@@ -86,11 +86,12 @@ void Sensors_Start( int ipin, int opin, int cpin, int sgpin, int smpin, int apin
 	data.ins[9] = (long)&AltTable_000[0];       //Append the HUB address of the pressure to altitude table 
 
 
-	data.DriftScale[0] = data.DriftScale[1] = data.DriftScale[2] = 0;
-	data.DriftOffset[0] = data.DriftOffset[1] = data.DriftOffset[2] = 0;
+	memset( &data.Drift[0][0], 0, sizeof(data.Drift) );
 	data.AccelOffset[0] = data.AccelOffset[1] = data.AccelOffset[2] = 0;
 	data.MagOffsetX = data.MagOffsetY = data.MagOffsetZ = 0;
 	data.MagScaleX = data.MagScaleY = data.MagScaleZ = 1024;
+	memset( &data.GyroFilter[0][0], 0, sizeof(data.GyroFilter) );
+	data.GyroFilter[0][0] = data.GyroFilter[1][0] = 4096;           //Filters pass the gyro through unchanged until prefs are applied
 
 	// cog = cognew(@entry, @ins) + 1;
   use_cog_driver(sensors_driver);
@@ -123,14 +124,14 @@ int * Sensors_Address(void)
 void Sensors_TempZeroDriftValues(void)
 {
   //Temporarily back up the values so we can restore them with "ResetDriftValues"
-  memcpy( &DriftBackup, &data.DriftScale[0], 6*sizeof(int) );
-  memset( &data.DriftScale[0], 0, 6*sizeof(int));
+  memcpy( &DriftBackup, &data.Drift[0][0], sizeof(DriftBackup) );
+  memset( &data.Drift[0][0], 0, sizeof(DriftBackup) );
 }
 
 void Sensors_ResetDriftValues(void)
 {
   //Restore the values from our backup
-  memcpy( &data.DriftScale[0], &DriftBackup, 6*sizeof(int) );
+  memcpy( &data.Drift[0][0], &DriftBackup, sizeof(DriftBackup) );
 }
 
 
@@ -147,10 +148,15 @@ void Sensors_ResetAccelOffsetValues(void)
 }
 
 
-void Sensors_SetDriftValues( int * ScaleAndOffsetsAddr )
+void Sensors_SetDriftValues( int * ScaleAndOffsetsAddr, int * CurveAddr )
 {
-  memcpy( &data.DriftScale[0], ScaleAndOffsetsAddr, 6*sizeof(int) );
-  memcpy( &DriftBackup, ScaleAndOffsetsAddr, 6*sizeof(int) );
+  // The prefs keep the scales and offsets in separate arrays, but the cog walks one axis at a time
+  for( int i=0; i<3; i++ ) {
+    DriftBackup[i][0] = ScaleAndOffsetsAddr[3+i];
+    DriftBackup[i][1] = ScaleAndOffsetsAddr[i];
+    DriftBackup[i][2] = CurveAddr[i];
+  }
+  memcpy( &data.Drift[0][0], &DriftBackup, sizeof(DriftBackup) );
 }
 
 
@@ -170,6 +176,43 @@ void Sensors_SetMagnetometerScaleOffsets( int * MagOffsetsAndScalesAddr )
   memcpy( &data.MagOffsetX, MagOffsetsAndScalesAddr, 6*sizeof(int) );
 }
 
+void Sensors_SetGyroFilters( short * LowPass, short * Notch )
+{
+  static const short PassThrough[5] = { 4096, 0, 0, 0, 0 };    // 1.0 in 12 bit fixed point
+
+  for( int s=0; s<2; s++ )
+  {
+    const short * coef = s ? Notch : LowPass;
+    if( coef[0] == 0 ) coef = PassThrough;    // The cog always runs both stages, so "off" is a filter that does nothing
+
+    int * f = data.GyroFilter[s];
+
+    int i;
+    for( i=0; i<5 && f[i] == coef[i]; i++ )
+      ;
+    if( i == 5 ) continue;    // Unchanged - keep the history, so re-applying prefs doesn't cause a glitch
+
+    // The cog may filter a sample while these are half written, but prefs only change while disarmed
+    for( i=0; i<5; i++ ) {
+      f[i] = coef[i];
+    }
+    memset( &f[5], 0, 18*sizeof(int) );
+  }
+}
+
+volatile int * Sensors_GyroHistory(void)
+{
+  return &data.GyroFilter[0][5];
+}
+
+void Sensors_SetGyroNotchCenter( int NegA1 )
+{
+  // Only the center moves, so the history is kept.  The cog might filter one sample with the
+  // old -a1 and the new b1, which is a far smaller step than the change in noise it's tracking.
+  data.GyroFilter[1][3] = NegA1;
+  data.GyroFilter[1][1] = -NegA1;
+}
+
 
         //Table used to convert pressure to altitude.  The Pressure to Altitude conversion is complex,
         //and requires Log and Pow functions, which take a considerable length of CPU time.  A table lookup
@@ -34,11 +34,14 @@ void Sensors_ResetDriftValues(void);
 
 void Sensors_TempZeroAccelOffsetValues(void);
 void Sensors_ResetAccelOffsetValues(void);
-void Sensors_SetDriftValues( int * ScaleAndOffsetsAddr );
+void Sensors_SetDriftValues( int * ScaleAndOffsetsAddr, int * CurveAddr );   // DriftScale[3] then DriftOffset[3], and DriftCurve[3]
 
 void Sensors_SetAccelOffsetValues( int * OffsetsAddr );
 void Sensors_ZeroMagnetometerScaleOffsets(void);
 void Sensors_SetMagnetometerScaleOffsets( int * MagOffsetsAndScalesAddr );
+void Sensors_SetGyroFilters( short * LowPass, short * Notch );   // 5 coefficients each - see GyroLowPass in prefs.h
+volatile int * Sensors_GyroHistory(void);         // Low-pass history, 6 longs per axis - the first is the newest raw sample
+void Sensors_SetGyroNotchCenter( int NegA1 );     // Moves the notch by setting -a1 and b1 = a1 - see noisetrack.cpp
 
 
 struct SENS {
@@ -49,6 +52,8 @@ struct SENS {
   long Alt, AltRate;              // Computed altimeter height (mm) and rate (mm/sec)
   long AltTemp, Pressure;         // Altimeter temperature and pressure
   long SensorTime;                //How long sensors took to read (debug / optimization test value)
+  long GyroSamples;               // Number of gyro/accel samples averaged into these readings (4 or more)
+  long SampleTime;                // CNT value when these samples were read from the sensors
 };
 
 #define Sensors_ParamsSize  sizeof(SENS)
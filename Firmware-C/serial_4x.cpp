@@ -61,10 +61,10 @@
 //          other than the limits of available memory there is no upper bound on their sizes 
 //       3) Framing and overrun errors are not detected. Overruns of the receive buffer 
 //          simply over write previously received data
-//       4) Put operations, with the exception of Can_Put are blocking. They will not 
-//          return until their data has been buffered for output. Put_Bytes buffers data
-//          to the greatest extent possible and may be called with a Count that is greater
-//          than the buffer size.
+//       4) Put operations, with the exception of Can_Put, Reserve, Try_Put and Put_Partial are
+//          blocking. They will not return until their data has been buffered for output. Put_Bytes
+//          buffers data to the greatest extent possible and may be called with a Count that is
+//          greater than the buffer size.  Try_Put and Put_Partial take what fits and return.
 //       5) Flush_Output blocks until the last byte has been extracted from the buffer; but
 //          that byte has not yet been transmitted at the time Flush returns
 //       6) Get is a blocking operation; it will not return until the associated buffer has data.
@@ -155,6 +155,11 @@ struct S4_COGVARS {
 static S4_COGVARS * cv;
 static char cog;
 
+// Statistics - kept by this code, the cog knows nothing about them
+static int TxDropped[4];
+static int TxHighWater[4];
+static int RxHighWater[4];
+
 
 void S4_Initialize(void)
 {
@@ -224,10 +229,12 @@ int The_TPB;
 }
 
 
-void S4_Start(void)
+int S4_Start(void)
 {
+  // Returns false if no cog was available
   use_cog_driver(serial_4x_driver);
-  cog = load_cog_driver(serial_4x_driver, 0);
+  cog = load_cog_driver(serial_4x_driver, 0) + 1;   // load_cog_driver returns -1 on failure, so 0 means not running
+  return cog;
 }
 
 void S4_Stop(void)
@@ -251,6 +258,16 @@ void S4_Flush_Output(char The_Port)
     ;
 }
 
+static void Note_Tx_Level(char The_Port, int The_II)
+{
+  int M = The_II - cv->Tx_EI[The_Port];               // Bytes now buffered
+  if(M < 0)
+    M += cv->TxS[The_Port];
+
+  if(M > TxHighWater[The_Port])
+    TxHighWater[The_Port] = M;
+}
+
 void S4_Put(char The_Port, char The_Byte)
 {
   // Waits until buffer space is available and then buffers The_Byte for transmit
@@ -262,6 +279,7 @@ void S4_Put(char The_Port, char The_Byte)
 
   cv->TxB[The_Port][I] = The_Byte;
   cv->Tx_II[The_Port] = N;
+  Note_Tx_Level(The_Port, N);
 }
 
 
@@ -275,19 +293,96 @@ void S4_Put_Unsafe(char The_Port, char The_Byte)
 }
 
 
-char S4_Can_Put(char The_Port, int The_Count)
+int S4_Tx_Free(char The_Port)
 {
   int BC = cv->Tx_EI[The_Port] - cv->Tx_II[The_Port] - 1;
-  if(BC <= 0)
+  if(BC < 0)
     BC = BC + cv->TxS[The_Port];
 
-  return(BC >= The_Count);
+  return BC;
+}
+
+
+char S4_Can_Put(char The_Port, int The_Count)
+{
+  return(S4_Tx_Free(The_Port) >= The_Count);
+}
+
+
+char S4_Try_Put(char The_Port, char The_Byte)
+{
+  int I = cv->Tx_II[The_Port];
+  int N = (I + 1) % cv->TxS[The_Port];
+
+  if( cv->Tx_EI[The_Port] == N ) {                  // Full
+    TxDropped[The_Port]++;
+    return 0;
+  }
+
+  cv->TxB[The_Port][I] = The_Byte;
+  cv->Tx_II[The_Port] = N;
+  Note_Tx_Level(The_Port, N);
+  return 1;
+}
+
+
+int S4_Reserve(char The_Port, int The_Count)
+{
+  // A refusal isn't counted as dropped - callers usually try the same block again on the next pass,
+  // and only they know when they've given up on it, so they report that with Tx_Drop
+  if( !S4_Can_Put(The_Port, The_Count) )
+    return -1;
+
+  return cv->Tx_II[The_Port];
+}
+
+void S4_Tx_Drop(char The_Port, int The_Count)
+{
+  TxDropped[The_Port] += The_Count;
+}
+
+char * S4_Tx_Buffer(char The_Port)
+{
+  return cv->TxB[The_Port];
+}
+
+int S4_Tx_Size(char The_Port)
+{
+  return cv->TxS[The_Port];
+}
+
+void S4_Commit(char The_Port, int The_Index)
+{
+  cv->Tx_II[The_Port] = The_Index;
+  Note_Tx_Level(The_Port, The_Index);
 }
 
 
 static int min( int a, int b ) { return a < b ? a : b; }
 
 
+int S4_Put_Partial(char The_Port, void * The_Bytes, int The_Count)
+{
+  // One pass of Put_Bytes - takes as much as fits right now, and never waits for the cog
+  int Size = cv->TxS[The_Port];
+  char *B = cv->TxB[The_Port];
+  int I = cv->Tx_II[The_Port];
+
+  int M = min(S4_Tx_Free(The_Port), The_Count);       // M = Bytes to move into the buffer
+  int C = min((Size - I), M);                          // C = bytes to move into the end of the buffer
+
+  memcpy(B + I, The_Bytes, C);
+  memcpy(B, (char *)The_Bytes + C, M - C);             // Wrap to the head of the buffer - often nothing
+
+  I = (I + M) % Size;
+  cv->Tx_II[The_Port] = I;
+  Note_Tx_Level(The_Port, I);
+
+  TxDropped[The_Port] += The_Count - M;
+  return M;
+}
+
+
 
 void S4_Put_Bytes(char The_Port, void * The_Bytes, int The_Count)
 {
@@ -312,6 +407,7 @@ void S4_Put_Bytes(char The_Port, void * The_Bytes, int The_Count)
       memcpy(B,     bytes + C, M - C);                 // Fill the head of the buffer - might be nothing
     }      
     cv->Tx_II[The_Port] = (I + M) % Size;              // Update the insertion point       
+    Note_Tx_Level(The_Port, cv->Tx_II[The_Port]);
 
     bytes += M;                                        // Bump address
     The_Count -= M;                                    // decrement the bytes remaining
@@ -354,9 +450,16 @@ int S4_Check(char The_Port)
 // character is available, a value of -1 is returned.
 //
   int E = cv->Rx_EI[The_Port];
+  int I = cv->Rx_II[The_Port];
 
-  if( E == cv->Rx_II[The_Port] )
+  if( E == I )
     return -1;
+
+  int C = I - E;                                       // Bytes waiting, including this one
+  if( C < 0 )
+    C += cv->RxS[The_Port];
+  if( C > RxHighWater[The_Port] )
+    RxHighWater[The_Port] = C;
     
   char B = cv->RxB[The_Port][E];
   cv->Rx_EI[The_Port] = (E + 1) % cv->RxS[The_Port];
@@ -364,6 +467,14 @@ int S4_Check(char The_Port)
   return B;
 }
 
+int S4_Rx_Count(char The_Port)
+{
+  int C = cv->Rx_II[The_Port] - cv->Rx_EI[The_Port];
+  if( C < 0 )
+    C += cv->RxS[The_Port];
+  return C;
+}
+
 char S4_Get(char The_Port)
 {
 //
@@ -420,3 +531,30 @@ char S4_Get_Bytes_Timed(char The_Port, char * The_Buffer, int The_Count, int MS_
 
   return 0;
 }
+
+
+//__________________________________________________________________________________
+//
+// Statistics
+//
+int S4_Tx_Dropped(char The_Port)
+{
+  return TxDropped[The_Port];
+}
+
+int S4_Tx_High_Water(char The_Port)
+{
+  return TxHighWater[The_Port];
+}
+
+int S4_Rx_High_Water(char The_Port)
+{
+  return RxHighWater[The_Port];
+}
+
+void S4_Reset_Stats(char The_Port)
+{
+  TxDropped[The_Port] = 0;
+  TxHighWater[The_Port] = 0;
+  RxHighWater[The_Port] = 0;
+}
@@ -73,7 +73,7 @@ void S4_Initialize(void);
 
 void S4_Define_Port(char The_Port, int The_Baud, char The_TxP, char * The_TxB, char The_TxS, char The_RxP, char * The_RxB, char The_RxS);
     
-void S4_Start(void);
+int  S4_Start(void);    // Returns false if no cog was available
 void S4_Stop(void);
 
 
@@ -85,9 +85,23 @@ void S4_Flush_Output(char The_Port);
 
 void S4_Put(char The_Port, char The_Byte);
 void S4_Put_Unsafe(char The_Port, char The_Byte);
-char S4_Can_Put(char The_Port, char The_Count);
+char S4_Can_Put(char The_Port, int The_Count);
 void S4_Put_Bytes(char The_Port, void * The_Bytes, int The_Count);
 
+// Non-blocking transmit.  These never wait for the cog - anything that doesn't fit is counted as dropped.
+int  S4_Tx_Free(char The_Port);                                       // Bytes that can be buffered right now
+char S4_Try_Put(char The_Port, char The_Byte);                        // Returns 1 if the byte was buffered
+int  S4_Put_Partial(char The_Port, void * The_Bytes, int The_Count);  // Returns the number of bytes buffered
+
+// Zero-copy transmit.  Reserve returns the insertion index if The_Count bytes are free, or -1 without
+// waiting.  The caller writes straight into Tx_Buffer (wrapping at Tx_Size), then Commit hands the new
+// insertion index to the cog in a single write, so a partially written block is never transmitted.
+int    S4_Reserve(char The_Port, int The_Count);
+char * S4_Tx_Buffer(char The_Port);
+int    S4_Tx_Size(char The_Port);
+void   S4_Commit(char The_Port, int The_Index);
+void   S4_Tx_Drop(char The_Port, int The_Count);    // Counts a block the caller gave up on after Reserve refused it
+
 
 // The Receive primitives
 //
@@ -97,10 +111,19 @@ void S4_Expunge_Input(char The_Port);
 int  S4_Peek(char The_Port);
 
 int  S4_Check(char The_Port);
+int  S4_Rx_Count(char The_Port);
 
 char S4_Get(char The_Port);
 int  S4_Get_Timed(char The_Port, int MS_Timer);
 char S4_Get_Bytes_Timed(char The_Port, char * The_Buffer, int The_Count, int MS_Timer);
 
 
+// Per-port statistics, since the last Reset_Stats
+//
+int  S4_Tx_Dropped(char The_Port);      // Bytes refused by Try_Put or Put_Partial because the buffer was full, plus Tx_Drop
+int  S4_Tx_High_Water(char The_Port);   // Most bytes ever waiting in the Tx buffer
+int  S4_Rx_High_Water(char The_Port);   // Most bytes ever waiting in the Rx buffer, as seen by Check
+void S4_Reset_Stats(char The_Port);
+
+
 #endif
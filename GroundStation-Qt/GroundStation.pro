@@ -18,6 +18,7 @@ SOURCES += main.cpp\
     connection.cpp \
     packet.cpp \
     prefs.cpp \
+    driftfit.cpp \
     widgets/altimeter_widget.cpp \
     widgets/angle_widget.cpp \
     widgets/gauge_widget.cpp \
@@ -38,6 +39,7 @@ HEADERS  += mainwindow.h \
     packet.h \
     elev8data.h \
     prefs.h \
+    driftfit.h \
     widgets/altimeter_widget.h \
     widgets/angle_widget.h \
     widgets/gauge_widget.h \
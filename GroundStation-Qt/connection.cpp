@@ -2,6 +2,7 @@
 #include <QtSerialPort/QSerialPortInfo>
 #include <QtDebug>
 #include "connection.h"
+#include <math.h>
 
 Connection::Connection(QObject *parent) : QThread(parent)
 {
@@ -17,6 +18,19 @@ Connection::Connection(QObject *parent) : QThread(parent)
     currentPacket = 0;
     head = tail = 0;
     memset( packetsArray, 0, packetCount * sizeof(void*) );
+
+	pingToken = 0;
+	memset( pingTokens, 0, sizeof(pingTokens) );
+	lastPingNs = 0;
+	linkType = Link_USB;
+	baud = slowBaud;
+	baudState = Baud_Fixed;
+	baudRetries = 0;
+	baudRequestNs = lastGoodNs = errorWindowNs = 0;
+	goodPackets = badPackets = 0;
+	linkStats[Link_USB].Reset();
+	linkStats[Link_XBee].Reset();
+	clock.start();
 }
 
 Connection::~Connection()
@@ -123,6 +137,13 @@ void Connection::Update(void)
 		//serial->waitForBytesWritten(1);
 	}
 
+	qint64 now = clock.nsecsElapsed();
+	UpdateBaud( now );
+
+	if( now - lastPingNs >= pingIntervalMs * 1000000LL ) {
+		SendPing( now );
+	}
+
 	while( serial->waitForReadyRead(1) )
 	{
 		QByteArray bytes = serial->readAll();
@@ -260,7 +281,27 @@ void Connection::ProcessByte( quint8 b )
         quint16 check = Checksum( currentChecksum, (quint8*)currentPacket->data.data(), len );
         quint16 sourceCheck = (quint16)((quint8)currentPacket->data[len] | (currentPacket->data[len + 1] << 8));
 
-        if(check == sourceCheck)
+        if(check == sourceCheck) {
+			lastGoodNs = clock.nsecsElapsed();
+			goodPackets++;
+        }
+        else {
+			badPackets++;
+        }
+
+        if(check == sourceCheck && currentPacket->mode == 0x1B)
+        {
+			ReceivePong( currentPacket, clock.nsecsElapsed() );	// Handled here to get the arrival time as exactly as possible
+			delete currentPacket;
+			currentPacket = 0;
+        }
+        else if(check == sourceCheck && currentPacket->mode == 0x1C)
+        {
+			ReceiveBaud( currentPacket, clock.nsecsElapsed() );	// The rate has to change before the next byte from the FC is read
+			delete currentPacket;
+			currentPacket = 0;
+        }
+        else if(check == sourceCheck)
         {
             mutex.lock();
             if( packetsArray[head] != 0 ) {
@@ -324,6 +365,158 @@ void Connection::Send( quint8 * bytes , int count )
     toSend.append( (char*)bytes, count);
 }
 
+void LinkStats::Reset(void)
+{
+	sent = received = 0;
+	lastRtt = minRtt = maxRtt = avgRtt = 0.0;
+	fcHold = oneWay = jitter = 0.0;
+	memset( histogram, 0, sizeof(histogram) );
+}
+
+
+LinkStats Connection::GetLinkStats( int link )
+{
+	QMutexLocker lock(&mutex);
+	return linkStats[link];
+}
+
+
+// Pings are written directly, not queued in toSend, so the send time is as close to the wire as we can get
+void Connection::SendPing( qint64 now )
+{
+	quint32 token = ++pingToken;
+	char buf[8] = { 'P', 'i', 'n', 'g', (char)token, (char)(token >> 8), (char)(token >> 16), (char)(token >> 24) };
+
+	serial->write( buf, 8 );
+	lastPingNs = now;
+
+	int slot = token % pingSlots;
+	pingTokens[slot] = token;
+	pingSentNs[slot] = now;
+
+	QMutexLocker lock(&mutex);
+	linkStats[linkType].sent++;
+}
+
+
+void Connection::ReceivePong( packet * p, qint64 now )
+{
+	quint32 token = (quint32)p->GetInt();
+	quint32 fcReceive = (quint32)p->GetInt();
+	quint32 fcSend = (quint32)p->GetInt();
+
+	int slot = token % pingSlots;
+	if( pingTokens[slot] != token ) return;		// too old, or garbage
+	pingTokens[slot] = 0;
+
+	double rtt = (now - pingSentNs[slot]) / 1000000.0;
+	double hold = (quint32)(fcSend - fcReceive) / 80000.0;	// FC clock is 80MHz
+
+	QMutexLocker lock(&mutex);
+	LinkStats & s = linkStats[linkType];
+
+	if( s.received == 0 ) {
+		s.minRtt = s.maxRtt = s.avgRtt = rtt;
+		s.fcHold = hold;
+	}
+	else {
+		s.jitter += (fabs(rtt - s.lastRtt) - s.jitter) / 16.0;
+		if( rtt < s.minRtt ) s.minRtt = rtt;
+		if( rtt > s.maxRtt ) s.maxRtt = rtt;
+		s.avgRtt += (rtt - s.avgRtt) / 16.0;
+		s.fcHold += (hold - s.fcHold) / 16.0;
+	}
+	s.lastRtt = rtt;
+	s.oneWay = (s.avgRtt - s.fcHold) * 0.5;
+	s.received++;
+
+	int bin = (int)rtt;
+	if( bin >= LinkStats::HistogramBins ) bin = LinkStats::HistogramBins-1;
+	s.histogram[bin]++;
+}
+
+
+void Connection::SendBaudRequest( int rate )
+{
+	char buf[8] = { 'B', 'a', 'u', 'd', (char)rate, (char)(rate >> 8), (char)(rate >> 16), (char)(rate >> 24) };
+	serial->write( buf, 8 );
+}
+
+
+void Connection::ReceiveBaud( packet * p, qint64 now )
+{
+	int rate = p->GetInt();
+	if( baudState != Baud_Request ) return;		// Late answer to a request we've given up on, or the FC confirming a fall back
+
+	if( rate <= baud ) {
+		baudState = Baud_Fixed;		// The FC can't go any faster
+		return;
+	}
+
+	serial->setBaudRate( rate );
+	baud = rate;
+	baudState = Baud_Fast;
+	lastGoodNs = errorWindowNs = now;
+	goodPackets = badPackets = 0;
+}
+
+
+void Connection::UpdateBaud( qint64 now )
+{
+	const qint64 Second = 1000000000LL;
+
+	switch( baudState )
+	{
+	case Baud_Request:
+		if( now - baudRequestNs < Second / 2 ) break;	// The answer comes back well inside the ping interval
+		if( ++baudRetries > 3 ) {
+			baudState = Baud_Fixed;		// Older firmware doesn't know the command - stay at the normal rate
+			break;
+		}
+		SendBaudRequest( fastBaud );
+		baudRequestNs = now;
+		break;
+
+	case Baud_Fast:
+		// The FC answers pings every 250ms, so a quiet second means one side didn't make the switch
+		if( now - lastGoodNs > Second ) {
+			FallBack( false );
+			break;
+		}
+
+		if( now - errorWindowNs >= Second )
+		{
+			if( badPackets >= 5 && badPackets * 50 > goodPackets ) {	// More than 2% of packets failing
+				FallBack( true );
+				break;
+			}
+			goodPackets = badPackets = 0;
+			errorWindowNs = now;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+// Back to the normal rate for the rest of this connection.  If we can't tell the FC, it falls back on its own
+// once it stops hearing pings it can read.
+void Connection::FallBack( bool tellFC )
+{
+	if( tellFC ) {
+		SendBaudRequest( slowBaud );
+		serial->waitForBytesWritten( 50 );
+	}
+
+	serial->setBaudRate( slowBaud );
+	baud = slowBaud;
+	baudState = Baud_Fixed;
+	lastGoodNs = clock.nsecsElapsed();
+}
+
+
 void Connection::Reset(void)
 {
 	if( connected == false ) return;
@@ -411,6 +604,17 @@ void Connection::AttemptConnect(void)
 								//FoundElev8 = true;
 								commStat = CS_Connected;
 								connected = true;
+
+								mutex.lock();
+								linkType = rateType;
+								linkStats[linkType].Reset();
+								mutex.unlock();
+
+								baud = (rateType == 0) ? slowBaud : 57600;
+								baudState = (rateType == 0) ? Baud_Request : Baud_Fixed;
+								baudRetries = 0;
+								baudRequestNs = 0;
+
 								emit connectionMade();
 								return;
 							}
@@ -6,6 +6,7 @@
 #include <QVector>
 #include <QThread>
 #include <QMutex>
+#include <QElapsedTimer>
 
 #include "packet.h"
 
@@ -19,6 +20,39 @@ enum CommStatus
 };
 
 
+enum LinkType
+{
+	Link_USB = 0,		// 115200 baud, or faster once negotiated
+	Link_XBee = 1,		// 57600 baud
+};
+
+
+// USB connections start at 115200 and ask the FC for a faster rate.  The link drops back if it goes quiet
+// or too many packets fail their checksum.
+enum BaudState
+{
+	Baud_Fixed,			// Not asking - XBee, already fell back once, or the FC said no
+	Baud_Request,		// Waiting for the FC to answer a Baud command
+	Baud_Fast,			// Running at the negotiated rate
+};
+
+
+// Round trip timing for one kind of link, measured with Ping commands and the FC's 0x1B replies
+struct LinkStats
+{
+	static const int HistogramBins = 32;	// 1ms per bin, the last one holds everything longer
+
+	int    sent, received;
+	double lastRtt, minRtt, maxRtt, avgRtt;	// ms, from writing the ping to reading the reply
+	double fcHold;		// ms between the FC parsing the ping and sending the reply (average)
+	double oneWay;		// (avgRtt - fcHold) / 2 - assumes the link is about as fast in both directions
+	double jitter;		// smoothed difference between consecutive round trips, as in RFC 3550
+	int    histogram[HistogramBins];
+
+	void Reset(void);
+};
+
+
 class Connection : public QThread
 {
     Q_OBJECT  // only need this if adding slots
@@ -49,6 +83,10 @@ public:
 
     packet * GetPacket(void);
 
+	int Link(void) const { return linkType; }
+	int Baud(void) const { return baud; }
+	LinkStats GetLinkStats( int link );
+
 
 protected:
     quint16 Checksum( quint16 checksum, const quint8 * buf, int Length );
@@ -59,6 +97,14 @@ protected:
     void AttemptConnect(void);
     void Disconnect(void);
 
+	void SendPing( qint64 now );
+	void ReceivePong( packet * p, qint64 now );
+
+	void UpdateBaud( qint64 now );
+	void SendBaudRequest( int rate );
+	void ReceiveBaud( packet * p, qint64 now );
+	void FallBack( bool tellFC );
+
 
 private:
     QSerialPort * serial;
@@ -81,6 +127,29 @@ private:
 
     packet * currentPacket;
     quint16 currentChecksum;
+
+	static const int pingSlots = 16;		// Pings can be outstanding for up to 4 seconds
+	static const int pingIntervalMs = 250;
+
+	QElapsedTimer clock;
+	quint32 pingToken;
+	quint32 pingTokens[pingSlots];
+	qint64  pingSentNs[pingSlots];
+	qint64  lastPingNs;
+
+	int linkType;
+	LinkStats linkStats[2];
+
+	static const int fastBaud = 921600;		// What we ask for - the FC answers with the fastest it can do up to this
+	static const int slowBaud = 115200;
+
+	volatile int baud;
+	int baudState;
+	int baudRetries;
+	qint64 baudRequestNs;
+	qint64 lastGoodNs;		// Last packet with a good checksum
+	qint64 errorWindowNs;	// Start of the current error rate window
+	int goodPackets, badPackets;
 };
 
 #endif
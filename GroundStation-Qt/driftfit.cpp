@@ -0,0 +1,90 @@
+#include "driftfit.h"
+#include <math.h>
+
+
+void DriftFit_AddSample( double * sumT, double (*sumY)[3], int axes, int t, const int * y )
+{
+	double u = t / 256.0, un = 1.0;
+	for( int k = 0; k < 5; k++ )
+	{
+		sumT[k] += un;
+		if( k < 3 ) {
+			for( int axis = 0; axis < axes; axis++ ) sumY[axis][k] += un * y[axis];
+		}
+		un *= u;
+	}
+}
+
+
+// Solves the normal equations for the first (terms) coefficients of a + b*u + c*u*u, using
+// Gauss-Jordan elimination.  Returns false if the samples can't pin them down.
+static bool SolveFit( const double * sumT, const double * sumY, int terms, double * coef )
+{
+	double m[3][4];
+	for( int r = 0; r < terms; r++ ) {
+		for( int c = 0; c < terms; c++ ) m[r][c] = sumT[r+c];
+		m[r][terms] = sumY[r];
+	}
+
+	for( int i = 0; i < terms; i++ )
+	{
+		int pivot = i;
+		for( int r = i+1; r < terms; r++ ) {
+			if( fabs(m[r][i]) > fabs(m[pivot][i]) ) pivot = r;
+		}
+		if( fabs(m[pivot][i]) < sumT[0] * 1.0e-9 ) return false;
+
+		for( int c = 0; c <= terms; c++ ) {
+			double tmp = m[i][c];  m[i][c] = m[pivot][c];  m[pivot][c] = tmp;
+		}
+
+		for( int r = 0; r < terms; r++ )
+		{
+			if( r == i ) continue;
+			double f = m[r][i] / m[i][i];
+			for( int c = i; c <= terms; c++ ) m[r][c] -= f * m[i][c];
+		}
+	}
+
+	for( int i = 0; i < 3; i++ ) {
+		coef[i] = (i < terms) ? m[i][terms] / m[i][i] : 0.0;
+	}
+	return true;
+}
+
+
+void DriftFit_Compute( const double * sumT, const double * sumY, int terms, double & intercept, double & slope, double & curve )
+{
+	double coef[3];
+	if( !SolveFit( sumT, sumY, terms, coef ) && !SolveFit( sumT, sumY, 2, coef ) ) {
+		coef[0] = sumY[0] / sumT[0];		// Only one temperature - the best we can do is the average
+		coef[1] = coef[2] = 0.0;
+	}
+
+	// Convert from u = t / 256 back to temperature units
+	intercept = coef[0];
+	slope = coef[1] / 256.0;
+	curve = coef[2] / (256.0 * 256.0);
+}
+
+
+// The sensors cog adds temp / DriftScale, so a slope that flat is better left out entirely
+int DriftScaleFromFit( double slope )
+{
+	if( fabs(slope) <= 0.00001 ) return 0;
+
+	int scale = (int)round( 1.0 / slope );
+	if( scale >= 1024 ) scale = 0;
+	return scale;
+}
+
+// The sensors cog adds (temp * temp / 256) / DriftCurve to the drift, so DriftCurve = 1 / (256 * c).
+// Its divider needs |DriftCurve| < 65536, and anything flatter than that is under a tenth of a unit.
+int DriftCurveFromFit( double curve )
+{
+	if( fabs(curve) * 256.0 * 65536.0 <= 1.0 ) return 0;
+
+	int result = (int)round( 1.0 / (256.0 * curve) );
+	if( result == 0 ) result = (curve < 0.0) ? -1 : 1;
+	return result;
+}
@@ -0,0 +1,19 @@
+#ifndef DRIFTFIT_H_
+#define DRIFTFIT_H_
+
+// Least-squares fit of gyro drift against temperature, and the conversion to the DriftScale,
+// DriftOffset and DriftCurve prefs the sensors cog uses.  Kept free of Qt so the host tests can
+// check it against the firmware's fixed-point drift model.
+
+// The sums are kept in u = t / 256 so the fourth powers stay in range.  sumT holds u^0 .. u^4, and
+// is shared by all the axes.  sumY holds y, u*y, u*u*y for each axis.
+void DriftFit_AddSample( double * sumT, double (*sumY)[3], int axes, int t, const int * y );
+
+// Fits y = intercept + slope * t + curve * t * t, in temperature units.  Terms is 2 for a line,
+// 3 for the curve.  If the samples can't pin those down it falls back to a line, then the average.
+void DriftFit_Compute( const double * sumT, const double * sumY, int terms, double & intercept, double & slope, double & curve );
+
+int DriftScaleFromFit( double slope );
+int DriftCurveFromFit( double curve );
+
+#endif
@@ -3,6 +3,7 @@
 #define ELEV8DATA_H_
 
 #include "packet.h"
+#include <string.h>
 
 
 class RadioData
@@ -12,6 +13,13 @@ public:
     short Gear, Aux1, Aux2, Aux3;						// Radio values = 16 bytes
     short BatteryVolts;                                  // Battery Monitor = 2 bytes
 
+    // Receiver frame tracking - only sent by newer firmware, zero otherwise
+    quint16 FrameCount;                                  // Low 16 bits of the S-BUS / RemoteRX frame counter
+    short LostFrames, Failsafes;                         // As reported by the receiver
+    short LatencyUs;                                     // From a frame arriving at the FC to the motor outputs that used it
+
+    RadioData() { memset( this, 0, sizeof(*this) ); }
+
     // Array index operator, allowing access to the channels by index value
     short operator[](int i) const
     {
@@ -44,6 +52,15 @@ public:
         Aux2 = p->GetShort();
         Aux3 = p->GetShort();
         BatteryVolts = p->GetShort();
+
+        FrameCount = 0;
+        LostFrames = Failsafes = LatencyUs = 0;
+        if( p->data.length() - 2 >= p->index + 8 ) {
+            FrameCount = (quint16)p->GetShort();
+            LostFrames = p->GetShort();
+            Failsafes = p->GetShort();
+            LatencyUs = p->GetShort();
+        }
     }
 };
 
@@ -68,6 +85,7 @@ public:
     short Temp, GyroX, GyroY, GyroZ;
     short AccelX, AccelY, AccelZ;						// IMU sensors = 20 bytes
     short MagX, MagY, MagZ;
+    int Counter;                // FC main loop counter when sent (250 per second), 0 from firmware that doesn't send it
 
     void ReadFrom( packet * p )
     {
@@ -81,9 +99,85 @@ public:
         MagX =   p->GetShort();
         MagY =   p->GetShort();
         MagZ =   p->GetShort();
+        Counter = (p->len - 2 >= 24) ? p->GetInt() : 0;    // len includes the checksum
+    }
+
+    // Compact packets carry deltas from the previous packet, with a keyframe every so often.
+    // Returns false if a packet was lost, until the next keyframe arrives.
+    bool ReadCompactFrom( packet * p )
+    {
+        quint8 seq = p->GetByte();
+        quint8 key = p->GetByte();
+
+        if( !key && (!Valid || seq != (quint8)(Seq + 1)) ) {
+            Valid = false;
+            return false;
+        }
+        Seq = seq;
+        Valid = true;
+
+        short * v = &Temp;
+        for( int i=0; i<10; i++ ) {
+            v[i] = (short)((key ? 0 : v[i]) + p->GetVarInt());
+        }
+
+        // Older firmware stops at the values - at most a zero pad byte follows, which leaves Counter at 0
+        int counter = (p->index < p->len - 2) ? p->GetVarInt() : 0;
+        Counter = (key ? 0 : Counter) + counter;
+        return true;
+    }
+
+    quint8 Seq;
+    bool Valid;
+
+    SensorData() {
+        Seq = 0;
+        Valid = false;
+        Counter = 0;
+    }
+};
+
+// One full-rate gyro & accel sample, unpacked from an IMU batch packet
+struct IMUSample
+{
+    int Counter;        // FC main loop counter when the sample was taken (250 per second)
+    short GyroX, GyroY, GyroZ;
+    short AccelX, AccelY, AccelZ;
+};
+
+class IMUBatch
+{
+public:
+    IMUSample Samples[16];
+    int Count;
+
+    // The FC sends the counter of the first sample, then consecutive samples - one per update cycle
+    void ReadFrom( packet * p )
+    {
+        int counter = p->GetInt();
+        Count = (p->len - 2 - 4) / 12;      // len includes the checksum
+        if( Count > 16 ) Count = 16;
+
+        for( int i=0; i<Count; i++ )
+        {
+            IMUSample & s = Samples[i];
+            s.Counter = counter + i;
+            s.GyroX =  p->GetShort();
+            s.GyroY =  p->GetShort();
+            s.GyroZ =  p->GetShort();
+            s.AccelX = p->GetShort();
+            s.AccelY = p->GetShort();
+            s.AccelZ = p->GetShort();
+        }
     }
 };
 
+// Parts of the FC's Initialize(), in the order the boot times are sent - matches BOOT_PHASE in the firmware
+enum BootPhase {
+    Boot_Cogs, Boot_Prefs, Boot_Receiver, Boot_Outputs, Boot_PIDs, Boot_GyroZero, Boot_Orientation,
+    Boot_Count
+};
+
 class DebugValues
 {
 public:
@@ -91,6 +185,9 @@ public:
     short MinCycles, MaxCycles, AvgCycles;
     int Counter;
 
+    int BootCycles[Boot_Count];		// Clock cycles each part of the FC boot took, from the first packet after connecting
+    bool BootValid;
+
     void ReadFrom( packet * p )
     {
         Version   = p->GetShort();
@@ -98,6 +195,17 @@ public:
         MaxCycles = p->GetShort();
         AvgCycles = p->GetShort();
         Counter =   p->GetInt();		// basically a sequence value
+
+        if( p->len - 2 >= 12 + Boot_Count * 4 ) {	// len includes the checksum
+            for( int i=0; i<Boot_Count; i++ ) {
+                BootCycles[i] = p->GetInt();
+            }
+            BootValid = true;
+        }
+    }
+
+    DebugValues() {
+        BootValid = false;
     }
 };
 
@@ -121,6 +229,35 @@ public:
 };
 
 
+// Telemetry stream IDs - these have to match the STREAM enum in Elev8-Main.h in the firmware
+enum StreamID
+{
+	Stream_Radio = 0,
+	Stream_Debug = 1,
+	Stream_Sensors = 2,
+	Stream_Quat = 3,
+	Stream_Motors = 4,
+	Stream_Computed = 5,
+	Stream_DesiredQuat = 6,
+	Stream_IMUBatch = 7,
+
+	Stream_ResetAll = 0xFF,		// Restores the firmware default rates for the port
+};
+
+
+// Preferences upload - these have to match PREFS_CHUNK_MAX and the UPLOAD_STATUS enum in Elev8-Main.h in the firmware
+const int PrefsChunkMax = 24;
+
+enum UploadStatus
+{
+	Upload_ChunkOK = 0,
+	Upload_Resend = 1,
+	Upload_Complete = 2,
+	Upload_Failed = 3,
+	Upload_Restart = 4,
+};
+
+
 // Used during channel scale / offset calibration
 struct ChannelData
 {
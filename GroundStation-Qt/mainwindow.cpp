@@ -4,10 +4,14 @@
 #include <QCoreApplication>
 #include "aboutbox.h"
 #include "quatutil.h"
+#include "driftfit.h"
 #include <math.h>
 
 static char beatString[] = "BEAT";
 
+// Update cycles between sensor packets on each link at the firmware's default rates (DefaultStreamPeriod)
+static const int DefaultSensorPeriod[2] = { 8, 16 };
+
 AHRS ahrs;
 
 MainWindow::MainWindow(QWidget *parent) :
@@ -19,6 +23,16 @@ MainWindow::MainWindow(QWidget *parent) :
 	CalibrateTimer = 0;
 	RadioMode = 2;		// Mode 2 by default - check to see if there's a config file with a different setting
 	currentMode = None;
+	LastIMUCounter = 0;
+	LastSensorCounter = 0;
+	IMUBatchSinceSensors = false;
+	IMUBatchRequested = false;
+	UploadSeq = UploadOffset = 0;
+	UploadTimer = UploadRetries = 0;
+	UploadPending = false;
+	prefsOnFCValid = false;
+	ParamInFlight = -1;
+	LinkStatsTimer = 0;
 
     ui->setupUi(this);
 
@@ -159,6 +173,7 @@ MainWindow::MainWindow(QWidget *parent) :
     ui->cbReceiverType->addItem(QString("S-Bus"));
     ui->cbReceiverType->addItem(QString("PPM"));
 	ui->cbReceiverType->addItem(QString("RemoteRX"));
+	ui->cbReceiverType->addItem(QString("CRSF"));
 
 	ui->cbArmingDelay->addItem(QString("1.00 sec"));
 	ui->cbArmingDelay->addItem(QString("0.50 sec"));
@@ -187,23 +202,27 @@ MainWindow::MainWindow(QWidget *parent) :
 	labelStatus = new QLabel(this);
 	labelGSVersion = new QLabel(this);
 	labelFWVersion = new QLabel(this);
+	labelLink = new QLabel(this);
 
     // set text for the label
 	labelStatus->setText("Connecting...");
 	labelStatus->setContentsMargins( 5, 1, 5, 1 );
 	labelGSVersion->setText("GroundStation Version 2.0.1");
 	labelFWVersion->setText( "Firmware Version -.-.-");
+	labelLink->setText( "Link: -" );
 
 	// add the controls to the status bar
 	ui->statusBar->addPermanentWidget(labelStatus, 1);
 	ui->statusBar->addPermanentWidget(labelGSVersion, 1);
 	ui->statusBar->addPermanentWidget(labelFWVersion, 1);
+	ui->statusBar->addPermanentWidget(labelLink, 2);
 
 	ui->statusBar->setStyleSheet( "QStatusBar::item { border: 0px solid black }; ");
 
 	labelStatus->setFrameStyle(QFrame::NoFrame);
 	labelGSVersion->setFrameStyle(QFrame::NoFrame);
 	labelFWVersion->setFrameStyle(QFrame::NoFrame);
+	labelLink->setFrameStyle(QFrame::NoFrame);
 
 	AdjustFonts();
 
@@ -304,6 +323,9 @@ void MainWindow::AdjustFonts(void)
 	ui->lblAccelCorrection->setFont(smallFont);
 	ui->lblAccelCorrectionFilter->setFont(smallFont);
 	ui->lblThrustCorrection->setFont(smallFont);
+	ui->lblGyroLowPass->setFont(smallFont);
+	ui->lblGyroNotch->setFont(smallFont);
+	ui->lblGyroNotchWidth->setFont(smallFont);
 
 	ui->btnReceiverReset->setFont(smallFont);
 	ui->btnReceiverCalibrate->setFont(smallFont);
@@ -325,6 +347,7 @@ void MainWindow::AdjustFonts(void)
 	labelStatus->setFont(smallFont);
 	labelGSVersion->setFont(smallFont);
 	labelFWVersion->setFont(smallFont);
+	labelLink->setFont(smallFont);
 }
 
 
@@ -383,7 +406,19 @@ void MainWindow::FillChannelComboBox(QComboBox *cb, int defaultIndex )
 
 void MainWindow::on_connectionMade()
 {
+	prefsUpload.clear();	// Anything in flight went to the old connection
+	UploadPending = false;
+	prefsOnFCValid = false;
+	ParamInFlight = -1;
+
 	SendCommand( "QPRF" );
+	SendCommand( "Cmpt" );	// Ask for compact sensor & quaternion packets (older firmware ignores this and sends the originals)
+	SetStreamRate( Stream_ResetAll, 0 );	// Don't inherit rates requested by a previous session
+
+	IMUBatchRequested = (ui->tabWidget->currentWidget() == ui->tpSensors);
+	if( IMUBatchRequested ) {
+		SetStreamRate( Stream_IMUBatch, 1 );	// The sensors tab wants full rate gyro & accel data
+	}
 }
 
 void MainWindow::timerEvent(QTimerEvent * e)
@@ -399,6 +434,7 @@ void MainWindow::timerEvent(QTimerEvent * e)
 	}
 
 	ProcessPackets();
+	CheckPrefsUpload();
 	CheckCalibrateControls();
 }
 
@@ -428,6 +464,70 @@ void MainWindow::UpdateStatus(void)
             break;
         }
     }
+
+	if( ++LinkStatsTimer >= 10 ) {	// 4 times a second
+		LinkStatsTimer = 0;
+		UpdateLinkStats();
+	}
+}
+
+
+static const char * LinkNames[2] = { "USB", "XBee" };
+
+// Round trip numbers for the current link in the status bar, and histograms for both links in its tooltip
+void MainWindow::UpdateLinkStats(void)
+{
+	if( stat != CS_Connected ) {
+		labelLink->setText( "Link: -" );
+		return;
+	}
+
+	int link = comm.Link();
+	LinkStats s = comm.GetLinkStats( link );
+
+	if( s.received == 0 ) {
+		labelLink->setText( QString("%1 %2: waiting for ping reply").arg( LinkNames[link] ).arg( comm.Baud() ) );
+	}
+	else {
+		int lost = s.sent - s.received - 1;		// one is usually still in flight
+		if( lost < 0 ) lost = 0;
+
+		labelLink->setText( QString("%1 %2: RTT %3 ms (%4-%5), one-way ~%6 ms, jitter %7 ms, lost %8/%9")
+			.arg( LinkNames[link] ).arg( comm.Baud() )
+			.arg( s.avgRtt, 0, 'f', 1 ).arg( s.minRtt, 0, 'f', 1 ).arg( s.maxRtt, 0, 'f', 1 )
+			.arg( s.oneWay, 0, 'f', 1 ).arg( s.jitter, 0, 'f', 2 )
+			.arg( lost ).arg( s.sent ) );
+	}
+
+	QString tip = "<pre>";
+	for( int l=0; l<2; l++ )
+	{
+		LinkStats ls = comm.GetLinkStats( l );
+		tip += QString("%1 round trip, %2 replies\n").arg( LinkNames[l] ).arg( ls.received );
+		if( ls.received == 0 ) {
+			tip += "  no data\n\n";
+			continue;
+		}
+
+		int peak = 1;
+		for( int b=0; b<LinkStats::HistogramBins; b++ ) peak = qMax( peak, ls.histogram[b] );
+
+		for( int b=0; b<LinkStats::HistogramBins; b++ )
+		{
+			if( ls.histogram[b] == 0 ) continue;
+			QString range = (b == LinkStats::HistogramBins-1) ? QString(" %1+ ms").arg(b, 3) : QString(" %1 ms ").arg(b, 3);
+			tip += range + QString( ls.histogram[b] * 40 / peak, '#' ) + QString(" %1\n").arg( ls.histogram[b] );
+		}
+		tip += "\n";
+	}
+
+	if( radio.FrameCount != 0 ) {
+		tip += QString("Receiver: frame %1, %2 lost, %3 failsafe, stick to motor %4 ms\n")
+			.arg( radio.FrameCount ).arg( radio.LostFrames ).arg( radio.Failsafes )
+			.arg( radio.LatencyUs / 1000.0, 0, 'f', 1 );
+	}
+	tip += "</pre>";
+	labelLink->setToolTip( tip );
 }
 
 
@@ -442,6 +542,14 @@ void MainWindow::SendCommand( QString command )
     comm.Send( (quint8*)arr.constData(), arr.length() );
 }
 
+// Ask the flight controller to send a telemetry stream every 'period' update cycles (0 == off).
+// The FC still limits the total to what the link can carry, so this is a request, not a guarantee
+void MainWindow::SetStreamRate(int stream, int period)
+{
+	quint8 bytes[6] = { 'R', 'a', 't', 'e', (quint8)stream, (quint8)period };
+	comm.Send( bytes, 6 );
+}
+
 void MainWindow::SetRadioMode(int mode)
 {
 	if( mode != 1 && mode != 2 ) return;
@@ -519,8 +627,14 @@ void MainWindow::ProcessPackets(void)
 					bRadioChanged = true;
                     break;
 
-                case 2:	// Sensor values
-                    sensors.ReadFrom( p );
+                case 2:		// Sensor values
+                case 0x12:	// Sensor values, compact encoding
+                    if( p->mode == 2 ) {
+                        sensors.ReadFrom( p );
+                    }
+                    else if( !sensors.ReadCompactFrom( p ) ) {
+                        break;	// lost a packet - the deltas are useless until the next keyframe
+                    }
 
 					AddGraphSample( 0, sensors.GyroX );
 					AddGraphSample( 1, sensors.GyroY );
@@ -533,17 +647,37 @@ void MainWindow::ProcessPackets(void)
 					AddGraphSample( 8, sensors.MagZ );
 					AddGraphSample( 9, sensors.Temp );
 
-					ahrs.Update( sensors , (1.0/250.f) * 8.0f , false );
+					// Sensor packets are every few samples - only use them when full rate samples aren't arriving.
+					// The counter gives the true time step.  Older firmware doesn't send one, so assume the
+					// default period for the link, which is what Stream_ResetAll left it at.
+					{
+					int cycles = sensors.Counter - LastSensorCounter;
+					if( LastSensorCounter == 0 || cycles < 1 || cycles > 250 ) cycles = DefaultSensorPeriod[comm.Link()];
+					LastSensorCounter = sensors.Counter;
+
+					if( !IMUBatchSinceSensors ) {
+						ahrs.Update( sensors , (float)cycles / 250.0f , false );
+					}
+					}
+					IMUBatchSinceSensors = false;
 
 					bSensorsChanged = true;
                     break;
 
-                case 3:	// Quaternion
+                case 3:		// Quaternion
+                case 0x13:	// Quaternion, compact encoding
                     {
-					q.setX(      p->GetFloat() );
-					q.setY(      p->GetFloat() );
-					q.setZ(      p->GetFloat() );
-					q.setScalar( p->GetFloat() );
+					float f[4];
+					if( p->mode == 3 ) {
+						for( int i=0; i<4; i++ ) f[i] = p->GetFloat();
+					}
+					else {
+						p->GetCompactQuat( f );
+					}
+					q.setX(      f[0] );
+					q.setY(      f[1] );
+					q.setZ(      f[2] );
+					q.setScalar( f[3] );
 
 					// TEST CODE
 					//q = ahrs.quat;
@@ -577,11 +711,21 @@ void MainWindow::ProcessPackets(void)
                     bMotorsChanged = true;
                     break;
 
-                case 6:	// Control quaternion
-					cq.setX      ( p->GetFloat() );
-					cq.setY      ( p->GetFloat() );
-					cq.setZ      ( p->GetFloat() );
-					cq.setScalar ( p->GetFloat() );
+                case 6:		// Control quaternion
+                case 0x16:	// Control quaternion, compact encoding
+					{
+					float f[4];
+					if( p->mode == 6 ) {
+						for( int i=0; i<4; i++ ) f[i] = p->GetFloat();
+					}
+					else {
+						p->GetCompactQuat( f );
+					}
+					cq.setX      ( f[0] );
+					cq.setY      ( f[1] );
+					cq.setZ      ( f[2] );
+					cq.setScalar ( f[3] );
+					}
                     bTargetQuatChanged = true;
 
 					// this is actually the last packet sent by the quad, so use this to advance the sample index
@@ -593,6 +737,39 @@ void MainWindow::ProcessPackets(void)
 					break;
 
 
+                case 8:	// Full rate IMU batch
+                    {
+					imuBatch.ReadFrom( p );
+
+					for( int i=0; i<imuBatch.Count; i++ )
+					{
+						const IMUSample & s = imuBatch.Samples[i];
+
+						// Use the true time step - a batch dropped by the FC shows up as a gap in the counter
+						int cycles = s.Counter - LastIMUCounter;
+						if( LastIMUCounter == 0 || cycles < 1 || cycles > 250 ) cycles = 1;
+						LastIMUCounter = s.Counter;
+
+						SensorData sd = sensors;	// mag & temperature come from the regular sensor packets
+						sd.GyroX = s.GyroX;
+						sd.GyroY = s.GyroY;
+						sd.GyroZ = s.GyroZ;
+						sd.AccelX = s.AccelX;
+						sd.AccelY = s.AccelY;
+						sd.AccelZ = s.AccelZ;
+						ahrs.Update( sd , (float)cycles / 250.0f , false );
+
+						imuCapture.append( s );
+					}
+
+					const int MaxCapture = 250 * 60;	// keep the last minute
+					if( imuCapture.size() > MaxCapture ) {
+						imuCapture.remove( 0, imuCapture.size() - MaxCapture );
+					}
+					IMUBatchSinceSensors = true;
+                    }
+                    break;
+
                 case 7:	// Debug data
                     debugData.ReadFrom( p );
                     bDebugChanged = true;
@@ -613,12 +790,70 @@ void MainWindow::ProcessPackets(void)
 							//PrefsReceived = true;	// Global indicator of valid prefs
 							bPrefsChanged = true;	// local indicator, just to set up the UI
 							prefs = tempPrefs;
+							prefsOnFC = tempPrefs;
+							prefsOnFCValid = true;
 						}
 						else {
 							SendCommand( "QPRF" );	// reqeust them again because the checksum failed
 						}
 					}
 					break;
+
+				case 0x1A:	// Single param value, in reply to PSet or PGet
+					{
+						int id = p->GetByte();
+						int result = p->GetByte();
+						p->GetShort();	// type, padding
+						qint32 value = p->GetInt();
+
+						if( id != ParamInFlight ) break;
+						ParamInFlight = -1;
+
+						if( result == Param_OK && id < PrefsParamCount ) {
+							memcpy( (char *)&prefsOnFC + PrefsParams[id].offset, &value, PrefsParams[id].Size() );	// little endian, like the FC
+							UpdateElev8Preferences();	// send the next changed param, if any
+						}
+						else {
+							UploadPending = false;
+							SendCommand( "QPRF" );	// rejected - get the FC's real settings back into the UI
+						}
+					}
+					break;
+
+				case 0x19:	// Prefs upload acknowledge
+					{
+						int seq = p->GetByte();
+						int status = p->GetByte();
+						int received = (quint16)p->GetShort();
+
+						if( prefsUpload.isEmpty() || seq != UploadSeq ) break;	// stale ack
+
+						switch( status )
+						{
+						case Upload_ChunkOK:
+							UploadOffset = received;
+							UploadSeq = (UploadSeq + 1) & 255;
+							UploadRetries = 0;
+							SendPrefsChunk();
+							break;
+
+						case Upload_Resend:
+							SendPrefsChunk();
+							break;
+
+						case Upload_Restart:
+							prefsUpload.clear();
+							UploadPending = true;	// FC lost track of the upload - start it over
+							break;
+
+						case Upload_Complete:
+						case Upload_Failed:
+							prefsUpload.clear();
+							SendCommand( "QPRF" );	// Query prefs (forces to be applied to UI)
+							break;
+						}
+					}
+					break;
             }
             delete p;
         }
@@ -775,24 +1010,18 @@ void MainWindow::ProcessPackets(void)
 
 			if( bDoRedraw == false )
 			{
-				int scaleX = 0, scaleY = 0, scaleZ = 0;
-
-				if(fabs(ui->lfGyroGraph->dSlope.x ) > 0.00001)
-					scaleX = (int)round( 1.0 / ui->lfGyroGraph->dSlope.x );
-				if( scaleX >= 1024 ) scaleX = 0;
-
-				if(fabs( ui->lfGyroGraph->dSlope.y ) > 0.00001)
-					scaleY = (int)round( 1.0 / ui->lfGyroGraph->dSlope.y );
-				if( scaleY >= 1024 ) scaleY = 0;
-
-				if(fabs( ui->lfGyroGraph->dSlope.z ) > 0.00001)
-					scaleZ = (int)round( 1.0 / ui->lfGyroGraph->dSlope.z );
-				if( scaleZ >= 1024 ) scaleZ = 0;
+				int scaleX = DriftScaleFromFit( ui->lfGyroGraph->dSlope.x );
+				int scaleY = DriftScaleFromFit( ui->lfGyroGraph->dSlope.y );
+				int scaleZ = DriftScaleFromFit( ui->lfGyroGraph->dSlope.z );
 
 				int offsetX = (int)round( ui->lfGyroGraph->dIntercept.x );
 				int offsetY = (int)round( ui->lfGyroGraph->dIntercept.y );
 				int offsetZ = (int)round( ui->lfGyroGraph->dIntercept.z );
 
+				ui->lblGxCurve->setText( QString::number( DriftCurveFromFit( ui->lfGyroGraph->dCurve.x ) ) );
+				ui->lblGyCurve->setText( QString::number( DriftCurveFromFit( ui->lfGyroGraph->dCurve.y ) ) );
+				ui->lblGzCurve->setText( QString::number( DriftCurveFromFit( ui->lfGyroGraph->dCurve.z ) ) );
+
 				QString str;
 				str = QString::number( scaleX );
 				ui->lblGxScale->setText(str);
@@ -851,8 +1080,27 @@ void MainWindow::ProcessPackets(void)
 
 		labelFWVersion->setText( QString( "Firmware Version %1.%2.%3" ).arg(verHigh).arg(verMid).arg(verLow) );
 
-		ui->lblCycles->setText( QString(
-			"CPU time (uS): %1 (min), %2 (max), %3 (avg)" ).arg( debugData.MinCycles * 64/80 ).arg( debugData.MaxCycles * 64/80 ).arg( debugData.AvgCycles * 64/80 ) );
+		QString cycles = QString( "CPU time (uS): %1 (min), %2 (max), %3 (avg)" )
+				.arg( debugData.MinCycles * 64/80 ).arg( debugData.MaxCycles * 64/80 ).arg( debugData.AvgCycles * 64/80 );
+
+		if( debugData.BootValid )
+		{
+			// Boot times are in clock cycles, 80 per uS
+			static const char * phaseNames[Boot_Count] = { "Cogs", "Prefs", "Receiver", "Outputs", "PIDs", "Gyro zero", "Orientation" };
+
+			QString tip = "Boot time (mS):";
+			double total = 0.0;
+			for( int i=0; i<Boot_Count; i++ ) {
+				double ms = (quint32)debugData.BootCycles[i] / 80000.0;
+				tip += QString( "\n%1: %2" ).arg( phaseNames[i] ).arg( ms, 0, 'f', 2 );
+				total += ms;
+			}
+
+			cycles += QString( ", boot %1 mS" ).arg( total, 0, 'f', 0 );
+			ui->lblCycles->setToolTip( tip );
+		}
+
+		ui->lblCycles->setText( cycles );
     }
 
     if( bComputedChanged ) {
@@ -922,6 +1170,13 @@ void MainWindow::on_tabWidget_currentChanged(int index)
 		newMode = SensorTest;
 	}
 
+	// The sensors tab wants full rate gyro & accel data, everything else is fine with the default rates
+	bool wantBatch = (ui->tabWidget->currentWidget() == ui->tpSensors);
+	if(wantBatch != IMUBatchRequested) {
+		SetStreamRate( Stream_IMUBatch, wantBatch ? 1 : 0 );
+		IMUBatchRequested = wantBatch;
+	}
+
 	if(newMode == currentMode) {
 		return;
 	}
@@ -1137,6 +1392,12 @@ void MainWindow::ConfigureUIFromPreferences(void)
 	ui->hsAccelCorrection->setValue( prefs.AccelCorrectionStrength );
 	ui->hsThrustCorrection->setValue( prefs.ThrustCorrectionScale );
 
+	AttemptSetValue( ui->hsGyroLowPass, Prefs_GyroLowPass(prefs) );
+	AttemptSetValue( ui->hsGyroNotch, Prefs_GyroNotchCenter(prefs) );
+	if( prefs.GyroNotch[0] != 0 ) {
+		AttemptSetValue( ui->hsGyroNotchWidth, Prefs_GyroNotchWidth(prefs) );
+	}
+
 
 	// System Setup
 	//----------------------------------------------------------------------------
@@ -1243,22 +1504,112 @@ void MainWindow::UpdateElev8Preferences(void)
 {
 	// Send prefs
 	prefs.Checksum = Prefs_CalculateChecksum( prefs );
+
+	if( !prefsUpload.isEmpty() || ParamInFlight >= 0 ) {
+		UploadPending = true;	// Sent when the current upload finishes, so only the latest prefs go out
+		return;
+	}
+	UploadPending = false;
+
+	if( SendChangedParams() ) return;
+
+	prefsUpload = QByteArray( (const char *)&prefs, sizeof(prefs) );
+	UploadSeq = 0;
+	UploadOffset = 0;
+	UploadRetries = 0;
+
 	SendCommand( "UPrf" );	// Update preferences
+	SendPrefsChunk();
+}
+
+// Most UI changes only touch one or two settings, so just send those, one at a time - the next goes out
+// when the FC echoes the last.  The FC writes only the EEPROM pages that changed.  Returns false if the
+// FC's settings aren't known or too much changed, and the whole struct should be uploaded instead.
+bool MainWindow::SendChangedParams(void)
+{
+	if( !prefsOnFCValid ) return false;
+
+	int changed = 0, first = -1;
+	for( int id=0; id<PrefsParamCount; id++ )
+	{
+		const PrefsParam & p = PrefsParams[id];
+		if( memcmp( (char *)&prefs + p.offset, (char *)&prefsOnFC + p.offset, p.Size() ) != 0 ) {
+			if( first < 0 ) first = id;
+			changed++;
+		}
+	}
+	if( changed > 8 ) return false;		// a full upload is quicker at this point
+	if( first < 0 ) return true;		// nothing to do
+
+	const PrefsParam & p = PrefsParams[first];
+	const char * field = (const char *)&prefs + p.offset;
 
-	QThread::msleep( 10 );	// Sleep a moment to let the Elev8-FC get ready
+	qint32 value;
+	switch( p.type ) {
+	case Param_Char:	value = *(const quint8 *)field;	break;
+	case Param_Short:	value = *(const qint16 *)field;	break;
+	default:			memcpy( &value, field, 4 );		break;
+	}
+
+	quint8 bytes[9] = { 'P', 'S', 'e', 't', (quint8)first,
+						(quint8)value, (quint8)(value >> 8), (quint8)(value >> 16), (quint8)(value >> 24) };
+	comm.Send( bytes, 9 );
 
-	quint8 * prefBytes = (quint8 *)&prefs;
+	ParamInFlight = first;
+	UploadTimer = 0;
+	return true;
+}
 
-	// Have to slow this down a little during transmission because the buffer
-	// on the other end is small to save ram, and we don't have flow control
-	for(int i = 0; i < (int)sizeof(prefs); i+=4)
+// The FC acknowledges every chunk, and the next one is only sent after that, so
+// its small receive buffer can't overflow and the flight loop never has to wait
+void MainWindow::SendPrefsChunk(void)
+{
+	int len = prefsUpload.size() - UploadOffset;
+	if( len > PrefsChunkMax ) len = PrefsChunkMax;
+
+	QByteArray chunk( "PChk" );
+	chunk.append( (char)UploadSeq );
+	chunk.append( (char)len );
+
+	quint8 sum = (quint8)(UploadSeq + len);
+	for( int i=0; i<len; i++ )
 	{
-		comm.Send( prefBytes + i, 4 );	// send 4 bytes at a time (assumes the struct is a multiple of 4 bytes)
-		QThread::msleep( 5 );			// sleep for a moment to let the Prop commit them
+		char c = prefsUpload[UploadOffset + i];
+		chunk.append( c );
+		sum += (quint8)c;
 	}
+	chunk.append( (char)sum );
 
-	// Query prefs (forces to be applied to UI)
-	SendCommand( "QPRF" );
+	comm.Send( (quint8 *)chunk.constData(), chunk.size() );
+	UploadTimer = 0;
+}
+
+// Called from the UI timer - resends a chunk if the ack doesn't show up
+void MainWindow::CheckPrefsUpload(void)
+{
+	if( ParamInFlight >= 0 )
+	{
+		if( ++UploadTimer >= 8 ) {	// 200ms - the echo got lost, so work out what still needs sending
+			ParamInFlight = -1;
+			UpdateElev8Preferences();
+		}
+		return;
+	}
+
+	if( prefsUpload.isEmpty() )
+	{
+		if( UploadPending ) UpdateElev8Preferences();
+		return;
+	}
+
+	if( ++UploadTimer < 8 ) return;		// 200ms
+
+	if( ++UploadRetries > 10 ) {
+		prefsUpload.clear();	// give up - the FC will drop the partial upload on its own
+		SendCommand( "QPRF" );
+		return;
+	}
+	SendPrefsChunk();
 }
 
 
@@ -1582,6 +1933,25 @@ void MainWindow::on_hsThrustCorrection_valueChanged(int value)
 }
 
 
+void MainWindow::on_hsGyroLowPass_valueChanged(int value)
+{
+	QString str = value == 0 ? QString("Off") : QString("%1 Hz").arg( value );
+	ui->lblGyroLowPass->setText( str );
+}
+
+void MainWindow::on_hsGyroNotch_valueChanged(int value)
+{
+	QString str = value == 0 ? QString("Off") : QString("%1 Hz").arg( value );
+	ui->lblGyroNotch->setText( str );
+}
+
+void MainWindow::on_hsGyroNotchWidth_valueChanged(int value)
+{
+	QString str = QString("%1 Hz").arg( value );
+	ui->lblGyroNotchWidth->setText( str );
+}
+
+
 // -----------------------------------------------
 // Flight control setup code
 // -----------------------------------------------
@@ -1655,6 +2025,9 @@ void MainWindow::on_btnUploadFlightChanges_clicked()
 	prefs.AccelCorrectionStrength = (unsigned char)ui->hsAccelCorrection->value();
 	prefs.ThrustCorrectionScale = (short)ui->hsThrustCorrection->value();
 
+	Prefs_SetGyroLowPass( prefs, ui->hsGyroLowPass->value() );
+	Prefs_SetGyroNotch( prefs, ui->hsGyroNotch->value(), ui->hsGyroNotchWidth->value() );
+
 	// Apply the prefs to the elev-8
 	UpdateElev8Preferences();
 }
@@ -1699,12 +2072,15 @@ void MainWindow::on_btnRestartCalibration_clicked()
 
 void MainWindow::on_btnUploadGyroCalibration_clicked()
 {
-	prefs.DriftScaleX =  (int)round( 1.0 / ui->lfGyroGraph->dSlope.x );
-	prefs.DriftScaleY =  (int)round( 1.0 / ui->lfGyroGraph->dSlope.y );
-	prefs.DriftScaleZ =  (int)round( 1.0 / ui->lfGyroGraph->dSlope.z );
+	prefs.DriftScaleX =  DriftScaleFromFit( ui->lfGyroGraph->dSlope.x );
+	prefs.DriftScaleY =  DriftScaleFromFit( ui->lfGyroGraph->dSlope.y );
+	prefs.DriftScaleZ =  DriftScaleFromFit( ui->lfGyroGraph->dSlope.z );
 	prefs.DriftOffsetX = (int)round( ui->lfGyroGraph->dIntercept.x );
 	prefs.DriftOffsetY = (int)round( ui->lfGyroGraph->dIntercept.y );
 	prefs.DriftOffsetZ = (int)round( ui->lfGyroGraph->dIntercept.z );
+	prefs.DriftCurveX =  DriftCurveFromFit( ui->lfGyroGraph->dCurve.x );
+	prefs.DriftCurveY =  DriftCurveFromFit( ui->lfGyroGraph->dCurve.y );
+	prefs.DriftCurveZ =  DriftCurveFromFit( ui->lfGyroGraph->dCurve.z );
 
 	UpdateElev8Preferences();
 }
@@ -1877,6 +2253,10 @@ void MainWindow::WriteSettings( QIODevice *file )
 	WritePref( writer, "DriftOffsetY", prefs.DriftOffsetY );
 	WritePref( writer, "DriftOffsetZ", prefs.DriftOffsetZ );
 
+	WritePref( writer, "DriftCurveX", prefs.DriftCurveX );
+	WritePref( writer, "DriftCurveY", prefs.DriftCurveY );
+	WritePref( writer, "DriftCurveZ", prefs.DriftCurveZ );
+
 	WritePref( writer, "AccelOffsetX", prefs.AccelOffsetX );
 	WritePref( writer, "AccelOffsetY", prefs.AccelOffsetY );
 	WritePref( writer, "AccelOffsetZ", prefs.AccelOffsetZ );
@@ -1928,6 +2308,17 @@ void MainWindow::WriteSettings( QIODevice *file )
 	WritePref( writer, "ThrustCorrectionScale", prefs.ThrustCorrectionScale );
 	WritePref( writer, "AccelCorrectionFilter", prefs.AccelCorrectionFilter );
 
+	WritePref( writer, "GyroLowPass0", prefs.GyroLowPass[0] );
+	WritePref( writer, "GyroLowPass1", prefs.GyroLowPass[1] );
+	WritePref( writer, "GyroLowPass2", prefs.GyroLowPass[2] );
+	WritePref( writer, "GyroLowPass3", prefs.GyroLowPass[3] );
+	WritePref( writer, "GyroLowPass4", prefs.GyroLowPass[4] );
+	WritePref( writer, "GyroNotch0", prefs.GyroNotch[0] );
+	WritePref( writer, "GyroNotch1", prefs.GyroNotch[1] );
+	WritePref( writer, "GyroNotch2", prefs.GyroNotch[2] );
+	WritePref( writer, "GyroNotch3", prefs.GyroNotch[3] );
+	WritePref( writer, "GyroNotch4", prefs.GyroNotch[4] );
+
 	WritePref( writer, "VoltageOffset", prefs.VoltageOffset );
 	WritePref( writer, "LowVoltageAlarmThreshold", prefs.LowVoltageAlarmThreshold );
 
@@ -2073,6 +2464,9 @@ void MainWindow::ReadSettingsContents( QXmlStreamReader & reader )
 			else if( reader.name() == "DriftOffsetX")			ReadInt(reader, prefs.DriftOffsetX);
 			else if( reader.name() == "DriftOffsetY")			ReadInt(reader, prefs.DriftOffsetY);
 			else if( reader.name() == "DriftOffsetZ")			ReadInt(reader, prefs.DriftOffsetZ);
+			else if( reader.name() == "DriftCurveX")			ReadInt(reader, prefs.DriftCurveX);
+			else if( reader.name() == "DriftCurveY")			ReadInt(reader, prefs.DriftCurveY);
+			else if( reader.name() == "DriftCurveZ")			ReadInt(reader, prefs.DriftCurveZ);
 
 			else if( reader.name() == "AccelOffsetX")			ReadInt(reader, prefs.AccelOffsetX);
 			else if( reader.name() == "AccelOffsetY")			ReadInt(reader, prefs.AccelOffsetY);
@@ -2118,6 +2512,16 @@ void MainWindow::ReadSettingsContents( QXmlStreamReader & reader )
 			else if( reader.name() == "DisarmDelay")			ReadInt(reader, prefs.DisarmDelay);
 			else if( reader.name() == "ThrustCorrectionScale")	ReadInt(reader, prefs.ThrustCorrectionScale);
 			else if( reader.name() == "AccelCorrectionFilter")	ReadInt(reader, prefs.AccelCorrectionFilter);
+			else if( reader.name() == "GyroLowPass0")			ReadInt(reader, prefs.GyroLowPass[0]);
+			else if( reader.name() == "GyroLowPass1")			ReadInt(reader, prefs.GyroLowPass[1]);
+			else if( reader.name() == "GyroLowPass2")			ReadInt(reader, prefs.GyroLowPass[2]);
+			else if( reader.name() == "GyroLowPass3")			ReadInt(reader, prefs.GyroLowPass[3]);
+			else if( reader.name() == "GyroLowPass4")			ReadInt(reader, prefs.GyroLowPass[4]);
+			else if( reader.name() == "GyroNotch0")				ReadInt(reader, prefs.GyroNotch[0]);
+			else if( reader.name() == "GyroNotch1")				ReadInt(reader, prefs.GyroNotch[1]);
+			else if( reader.name() == "GyroNotch2")				ReadInt(reader, prefs.GyroNotch[2]);
+			else if( reader.name() == "GyroNotch3")				ReadInt(reader, prefs.GyroNotch[3]);
+			else if( reader.name() == "GyroNotch4")				ReadInt(reader, prefs.GyroNotch[4]);
 			else if( reader.name() == "VoltageOffset")			ReadInt(reader, prefs.VoltageOffset);
 			else if( reader.name() == "LowVoltageAlarmThreshold")	ReadInt(reader, prefs.LowVoltageAlarmThreshold);
 
@@ -35,12 +35,17 @@ public:
 	void timerEvent(QTimerEvent *event) Q_DECL_OVERRIDE;
 
 	void UpdateStatus(void);
+	void UpdateLinkStats(void);
 	void SendCommand(const char *command);
 	void SendCommand(QString command);
+	void SetStreamRate(int stream, int period);
 	void ProcessPackets(void);
 
 	void ConfigureUIFromPreferences(void);
 	void UpdateElev8Preferences(void);
+	bool SendChangedParams(void);
+	void SendPrefsChunk(void);
+	void CheckPrefsUpload(void);
 
 
 protected:
@@ -91,6 +96,9 @@ private slots:
 	void on_hsAccelCorrectionFilter_valueChanged(int value);
 	void on_hsAccelCorrection_valueChanged(int value);
 	void on_hsThrustCorrection_valueChanged(int value);
+	void on_hsGyroLowPass_valueChanged(int value);
+	void on_hsGyroNotch_valueChanged(int value);
+	void on_hsGyroNotchWidth_valueChanged(int value);
 	void on_btnUploadSystemSetup_clicked();
 
 	void on_actionReset_Flight_Controller_triggered();
@@ -190,6 +198,8 @@ private:
 	QLabel * labelStatus;
 	QLabel * labelGSVersion;
 	QLabel * labelFWVersion;
+	QLabel * labelLink;
+	int LinkStatsTimer;
 
 	int Heartbeat;
 	int RadioMode;	// Mode == 1 or 2
@@ -199,6 +209,12 @@ private:
 
 	RadioData radio;
 	SensorData sensors;
+	IMUBatch imuBatch;
+	QVector<IMUSample> imuCapture;	// Most recent full rate gyro & accel samples, oldest first
+	int LastIMUCounter;
+	int LastSensorCounter;
+	bool IMUBatchSinceSensors;		// AHRS is being fed from the full rate samples
+	bool IMUBatchRequested;
 	QQuaternion q;
 	QQuaternion cq;
 	MotorData motors;
@@ -223,6 +239,14 @@ private:
 	QCustomPlot * sg;
 
 	PREFS prefs;
+	PREFS prefsOnFC;			// Last prefs the FC reported, kept current as single params are acknowledged
+	bool prefsOnFCValid;
+
+	QByteArray prefsUpload;		// Prefs being sent to the FC in acknowledged chunks, empty when idle
+	int UploadSeq, UploadOffset;
+	int UploadTimer, UploadRetries;
+	bool UploadPending;			// Prefs changed again during an upload - send them when it finishes
+	int ParamInFlight;			// ID of the single param sent and not yet acknowledged, or -1
 };
 
 #endif // MAINWINDOW_H
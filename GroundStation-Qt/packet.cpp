@@ -1,4 +1,5 @@
 #include "packet.h"
+#include <math.h>
 
 packet::packet()
 {
@@ -49,3 +50,40 @@ float packet::GetFloat(void)
     i = GetInt();
     return f;
 }
+
+
+qint32 packet::GetVarInt(void)
+{
+    quint32 v = 0;
+    int shift = 0;
+    quint8 b;
+
+    do {
+        if( index >= data.length() ) break;    // truncated - return what we have rather than reading past the end
+        b = data[index++];
+        v |= (quint32)(b & 0x7f) << shift;
+        shift += 7;
+    } while( (b & 0x80) && shift < 35 );
+
+    return (qint32)(v >> 1) ^ -(qint32)(v & 1);    // undo the zig-zag
+}
+
+
+void packet::GetCompactQuat(float * q)
+{
+    // The FC sends the index of the largest component, then the other three scaled by sqrt(2) to fill
+    // 16 bits.  The largest is always sent as positive, and is rebuilt from the unit length.
+    const float Scale = 1.0f / (32767.0f * 1.41421356f);
+
+    int largest = GetShort() & 3;
+    float sum = 0.0f;
+
+    for( int i=0; i<4; i++ )
+    {
+        if( i == largest ) continue;
+        q[i] = (float)GetShort() * Scale;
+        sum += q[i] * q[i];
+    }
+
+    q[largest] = (sum < 1.0f) ? sqrtf( 1.0f - sum ) : 0.0f;
+}
@@ -19,6 +19,10 @@ public:
     qint16 GetShort(void);
     qint32 GetInt(void);
     float  GetFloat(void);
+
+    // Compact encodings
+    qint32 GetVarInt(void);             // Zig-zag varint
+    void   GetCompactQuat(float * q);   // "Smallest three" quaternion, 8 bytes - q receives x, y, z, w
 };
 
 #endif // PACKET_H
@@ -21,6 +21,8 @@
 */
 
 #include <string.h>   // for memset()
+#include <stddef.h>   // for offsetof()
+#include <math.h>
 #include "prefs.h"
 
 
@@ -43,3 +45,200 @@ int Prefs_CalculateChecksum( PREFS & PrefsStruct )
 {
 	return Prefs_CalculateChecksum( (unsigned int *)&PrefsStruct , sizeof(PrefsStruct) );
 }
+
+
+// The order here defines the param IDs, and has to match ParamTable in prefs.cpp in the firmware
+const PrefsParam PrefsParams[] = {
+	{ offsetof(PREFS, DriftScaleX), Param_Int },
+	{ offsetof(PREFS, DriftScaleY), Param_Int },
+	{ offsetof(PREFS, DriftScaleZ), Param_Int },
+	{ offsetof(PREFS, DriftOffsetX), Param_Int },
+	{ offsetof(PREFS, DriftOffsetY), Param_Int },
+	{ offsetof(PREFS, DriftOffsetZ), Param_Int },
+	{ offsetof(PREFS, AccelOffsetX), Param_Int },
+	{ offsetof(PREFS, AccelOffsetY), Param_Int },
+	{ offsetof(PREFS, AccelOffsetZ), Param_Int },
+	{ offsetof(PREFS, MagOfsX), Param_Int },
+	{ offsetof(PREFS, MagScaleX), Param_Int },
+	{ offsetof(PREFS, MagOfsY), Param_Int },
+	{ offsetof(PREFS, MagScaleY), Param_Int },
+	{ offsetof(PREFS, MagOfsZ), Param_Int },
+	{ offsetof(PREFS, MagScaleZ), Param_Int },
+
+	{ offsetof(PREFS, RollCorrectSin), Param_Float },
+	{ offsetof(PREFS, RollCorrectCos), Param_Float },
+	{ offsetof(PREFS, PitchCorrectSin), Param_Float },
+	{ offsetof(PREFS, PitchCorrectCos), Param_Float },
+	{ offsetof(PREFS, AutoLevelRollPitch), Param_Float },
+	{ offsetof(PREFS, AutoLevelYawRate), Param_Float },
+	{ offsetof(PREFS, ManualRollPitchRate), Param_Float },
+	{ offsetof(PREFS, ManualYawRate), Param_Float },
+
+	{ offsetof(PREFS, PitchGain), Param_Char },
+	{ offsetof(PREFS, RollGain), Param_Char },
+	{ offsetof(PREFS, YawGain), Param_Char },
+	{ offsetof(PREFS, AscentGain), Param_Char },
+	{ offsetof(PREFS, AltiGain), Param_Char },
+	{ offsetof(PREFS, PitchRollLocked), Param_Char },
+	{ offsetof(PREFS, UseAdvancedPID), Param_Char },
+	{ offsetof(PREFS, ReceiverType), Param_Char },
+	{ offsetof(PREFS, UseBattMon), Param_Char },
+	{ offsetof(PREFS, DisableMotors), Param_Char },
+	{ offsetof(PREFS, LowVoltageAlarm), Param_Char },
+	{ offsetof(PREFS, LowVoltageAscentLimit), Param_Char },
+
+	{ offsetof(PREFS, ThrottleTest), Param_Short },
+	{ offsetof(PREFS, MinThrottle), Param_Short },
+	{ offsetof(PREFS, MaxThrottle), Param_Short },
+	{ offsetof(PREFS, CenterThrottle), Param_Short },
+	{ offsetof(PREFS, MinThrottleArmed), Param_Short },
+	{ offsetof(PREFS, ArmDelay), Param_Short },
+	{ offsetof(PREFS, DisarmDelay), Param_Short },
+	{ offsetof(PREFS, ThrustCorrectionScale), Param_Short },
+	{ offsetof(PREFS, AccelCorrectionFilter), Param_Short },
+	{ offsetof(PREFS, VoltageOffset), Param_Short },
+	{ offsetof(PREFS, LowVoltageAlarmThreshold), Param_Short },
+
+	{ offsetof(PREFS, FlightMode[0]), Param_Char },
+	{ offsetof(PREFS, FlightMode[1]), Param_Char },
+	{ offsetof(PREFS, FlightMode[2]), Param_Char },
+	{ offsetof(PREFS, AccelCorrectionStrength), Param_Char },
+
+	{ offsetof(PREFS, ThroChannel), Param_Char },
+	{ offsetof(PREFS, AileChannel), Param_Char },
+	{ offsetof(PREFS, ElevChannel), Param_Char },
+	{ offsetof(PREFS, RuddChannel), Param_Char },
+	{ offsetof(PREFS, GearChannel), Param_Char },
+	{ offsetof(PREFS, Aux1Channel), Param_Char },
+	{ offsetof(PREFS, Aux2Channel), Param_Char },
+	{ offsetof(PREFS, Aux3Channel), Param_Char },
+
+	{ offsetof(PREFS, ThroScale), Param_Short },
+	{ offsetof(PREFS, AileScale), Param_Short },
+	{ offsetof(PREFS, ElevScale), Param_Short },
+	{ offsetof(PREFS, RuddScale), Param_Short },
+	{ offsetof(PREFS, GearScale), Param_Short },
+	{ offsetof(PREFS, Aux1Scale), Param_Short },
+	{ offsetof(PREFS, Aux2Scale), Param_Short },
+	{ offsetof(PREFS, Aux3Scale), Param_Short },
+
+	{ offsetof(PREFS, ThroCenter), Param_Short },
+	{ offsetof(PREFS, AileCenter), Param_Short },
+	{ offsetof(PREFS, ElevCenter), Param_Short },
+	{ offsetof(PREFS, RuddCenter), Param_Short },
+	{ offsetof(PREFS, GearCenter), Param_Short },
+	{ offsetof(PREFS, Aux1Center), Param_Short },
+	{ offsetof(PREFS, Aux2Center), Param_Short },
+	{ offsetof(PREFS, Aux3Center), Param_Short },
+
+	{ offsetof(PREFS, GyroLowPass[0]), Param_Short },
+	{ offsetof(PREFS, GyroLowPass[1]), Param_Short },
+	{ offsetof(PREFS, GyroLowPass[2]), Param_Short },
+	{ offsetof(PREFS, GyroLowPass[3]), Param_Short },
+	{ offsetof(PREFS, GyroLowPass[4]), Param_Short },
+	{ offsetof(PREFS, GyroNotch[0]), Param_Short },
+	{ offsetof(PREFS, GyroNotch[1]), Param_Short },
+	{ offsetof(PREFS, GyroNotch[2]), Param_Short },
+	{ offsetof(PREFS, GyroNotch[3]), Param_Short },
+	{ offsetof(PREFS, GyroNotch[4]), Param_Short },
+
+	{ offsetof(PREFS, DriftCurveX), Param_Int },
+	{ offsetof(PREFS, DriftCurveY), Param_Int },
+	{ offsetof(PREFS, DriftCurveZ), Param_Int },
+};
+
+const int PrefsParamCount = sizeof(PrefsParams) / sizeof(PrefsParams[0]);
+
+
+// Gyro filters are standard "cookbook" biquads.  The denominator is rounded first, then the
+// numerator is adjusted so the DC gain is exactly 1 in fixed point - otherwise rounding would
+// scale the gyro readings slightly, and that shows up as drift.
+
+static const double GyroSampleRate = 952.0;   // LSM9DS1 output data rate, set in sensors_driver.spin
+static const double FixedOne = 4096.0;
+static const double PI = 3.14159265358979323846;
+
+static short ToFixed( double v )
+{
+	return (short)floor( v * FixedOne + 0.5 );
+}
+
+
+// Shared denominator: a0 = 1 + alpha, a1 = -2cos(w0), a2 = 1 - alpha
+static void SetDenominator( short * coef, double w0, double alpha )
+{
+	double a0 = 1.0 + alpha;
+	coef[3] = ToFixed( 2.0 * cos(w0) / a0 );       // -a1
+	coef[4] = ToFixed( -(1.0 - alpha) / a0 );      // -a2
+}
+
+
+// Recovers w0 and alpha from the denominator, so the UI can show what's on the flight controller
+static void GetDenominator( const short * coef, double & w0, double & alpha )
+{
+	double na1 = coef[3] / FixedOne, na2 = coef[4] / FixedOne;
+	alpha = (1.0 + na2) / (1.0 - na2);
+	double c = na1 * (1.0 + alpha) * 0.5;
+	w0 = acos( c < -1.0 ? -1.0 : (c > 1.0 ? 1.0 : c) );
+}
+
+
+void Prefs_SetGyroLowPass( PREFS & prefs, int cutoff )
+{
+	short * coef = prefs.GyroLowPass;
+	memset( coef, 0, 5 * sizeof(short) );
+	if( cutoff <= 0 || cutoff >= GyroSampleRate / 2 ) return;
+
+	double w0 = 2.0 * PI * cutoff / GyroSampleRate;
+	SetDenominator( coef, w0, sin(w0) / (2.0 * 0.7071) );       // Q of 0.7071 is Butterworth
+
+	int sum = (int)FixedOne - coef[3] - coef[4];   // b0 + b1 + b2 for unity gain, split 1 : 2 : 1
+	coef[0] = coef[2] = (short)((sum + 2) / 4);
+	coef[1] = (short)(sum - coef[0] * 2);
+}
+
+
+void Prefs_SetGyroNotch( PREFS & prefs, int center, int width )
+{
+	short * coef = prefs.GyroNotch;
+	memset( coef, 0, 5 * sizeof(short) );
+	if( center <= 0 || center >= GyroSampleRate / 2 || width <= 0 || width >= GyroSampleRate / 2 ) return;
+
+	// alpha = tan(bandwidth / 2) puts the -3dB points exactly width apart at any center.  The cookbook
+	// Q = center / width only does that well below the Nyquist rate, and gets far too narrow up high.
+	double w0 = 2.0 * PI * center / GyroSampleRate;
+	SetDenominator( coef, w0, tan( PI * width / GyroSampleRate ) );
+
+	coef[1] = (short)-coef[3];                     // b1 = a1, so the zeros sit on the center frequency
+	coef[0] = coef[2] = (short)(((int)FixedOne - coef[4] + 1) / 2);
+}
+
+
+int Prefs_GyroLowPass( const PREFS & prefs )
+{
+	if( prefs.GyroLowPass[0] == 0 ) return 0;
+
+	double w0, alpha;
+	GetDenominator( prefs.GyroLowPass, w0, alpha );
+	return (int)floor( w0 * GyroSampleRate / (2.0 * PI) + 0.5 );
+}
+
+
+int Prefs_GyroNotchCenter( const PREFS & prefs )
+{
+	if( prefs.GyroNotch[0] == 0 ) return 0;
+
+	double w0, alpha;
+	GetDenominator( prefs.GyroNotch, w0, alpha );
+	return (int)floor( w0 * GyroSampleRate / (2.0 * PI) + 0.5 );
+}
+
+
+int Prefs_GyroNotchWidth( const PREFS & prefs )
+{
+	if( prefs.GyroNotch[0] == 0 ) return 0;
+
+	double w0, alpha;
+	GetDenominator( prefs.GyroNotch, w0, alpha );
+	return (int)floor( atan(alpha) * GyroSampleRate / PI + 0.5 );
+}
@@ -53,7 +53,7 @@ typedef struct {
 	byte  UseAdvancedPID;
 	byte  unused;
 
-	byte  ReceiverType;     // 0 = PWM, 1 = SBUS, 2 = PPM
+	byte  ReceiverType;     // 0 = PWM, 1 = SBUS, 2 = PPM, 3 = RemoteRX, 4 = CRSF
 	byte  unused2;
 	byte  UseBattMon;
 	byte  DisableMotors;
@@ -105,6 +105,11 @@ typedef struct {
 	short Aux2Center;
 	short Aux3Center;
 
+	short GyroLowPass[5];   // Gyro biquads, run by the sensors cog at the 952hz sample rate.  12 bit fixed point
+	short GyroNotch[5];     // b0, b1, b2, -a1, -a2 (so 4096 = 1.0).  b0 = 0 turns the filter off
+
+	int DriftCurveX, DriftCurveY, DriftCurveZ;    // Gyro drift curvature: (temp * temp / 256) / DriftCurve is added to the drift, 0 = linear only
+
 	int   Checksum;
 
 	// Accessors for looping over channel assignments, scales, centers
@@ -117,4 +122,37 @@ typedef struct {
 
 int Prefs_CalculateChecksum( PREFS & PrefsStruct );
 
+// Gyro filter design - frequencies are in hz, and 0 turns the filter off
+void Prefs_SetGyroLowPass( PREFS & prefs, int cutoff );
+void Prefs_SetGyroNotch( PREFS & prefs, int center, int width );
+int  Prefs_GyroLowPass( const PREFS & prefs );
+int  Prefs_GyroNotchCenter( const PREFS & prefs );
+int  Prefs_GyroNotchWidth( const PREFS & prefs );
+
+
+// Individual parameters, addressed by ID - these have to match the table and enums in prefs.cpp / prefs.h in the firmware
+enum ParamType {
+	Param_Char = 0,
+	Param_Short = 1,
+	Param_Int = 2,
+	Param_Float = 3,
+};
+
+enum ParamResult {
+	Param_OK = 0,
+	Param_BadID = 1,
+	Param_OutOfRange = 2,
+	Param_Locked = 3,
+};
+
+struct PrefsParam {
+	byte offset;
+	byte type;
+
+	int Size(void) const { return type == Param_Char ? 1 : (type == Param_Short ? 2 : 4); }
+};
+
+extern const PrefsParam PrefsParams[];
+extern const int PrefsParamCount;
+
 #endif
@@ -1,6 +1,12 @@
 #include "linefit_widget.h"
+#include "../driftfit.h"
 #include <QPainter>
 #include <QBitmap>
+#include <math.h>
+#include <string.h>
+
+
+static const int CurveMinSpan = 10 * 16;	// Temperature range needed before fitting a curve - 10 degrees C, 16 units per degree
 
 
 //! [0]
@@ -11,8 +17,10 @@ LineFit_Widget::LineFit_Widget(QWidget * parent) : QWidget(parent)
 	ymin = -1000.0f;
 	ymax =  2000.0f;
 
-	samplesUsed = sampleIndex = 0;
+	Reset();
 	dSlope.x = dSlope.y = dSlope.z = dSlope.t = 1.0;
+	dIntercept.x = dIntercept.y = dIntercept.z = dIntercept.t = 0.0;
+	dCurve.x = dCurve.y = dCurve.z = dCurve.t = 0.0;
 
 	rPen = QPen(QColor::fromRgb(255, 0, 0, 128));
 	gPen = QPen(QColor::fromRgb(0, 255, 0, 128));
@@ -33,6 +41,10 @@ void LineFit_Widget::Reset(void)
 {
 	samplesUsed = 0;
 	sampleIndex = 0;
+
+	memset( sumT, 0, sizeof(sumT) );
+	memset( sumY, 0, sizeof(sumY) );
+	tmin = tmax = 0;
 }
 
 /*static int clamp(int v, int mn, int mx)
@@ -48,6 +60,15 @@ void LineFit_Widget::AddSample( LFSample &newSample , bool bRedraw )
 	sampleIndex = (sampleIndex+1) & 4095;
 	if( samplesUsed < 4096 ) samplesUsed++;
 
+	if( sumT[0] == 0.0 ) {
+		tmin = tmax = newSample.t;
+	}
+	tmin = qMin( tmin, newSample.t );
+	tmax = qMax( tmax, newSample.t );
+
+	int y[3] = { newSample.x, newSample.y, newSample.z };
+	DriftFit_AddSample( sumT, sumY, 3, newSample.t, y );
+
 	if(bRedraw) {
 		ComputeLine();
 		update();
@@ -95,90 +116,36 @@ void LineFit_Widget::paintEvent(QPaintEvent * event)
 
 	p.setRenderHint(QPainter::Antialiasing, true);
 
-	double sy, sx = xmin;
-	double ey, ex = xmax;
-
-	sy = dSlope.x * sx + dIntercept.x;
-	ey = dSlope.x * ex + dIntercept.x;
-	DrawInterceptLine( p, (float)sx, (float)sy, (float)ex, (float)ey, xs, ys, rPen );
-
-	sy = dSlope.y * sx + dIntercept.y;
-	ey = dSlope.y * ex + dIntercept.y;
-	DrawInterceptLine( p, (float)sx, (float)sy, (float)ex, (float)ey, xs, ys, gPen );
-
-	sy = dSlope.z * sx + dIntercept.z;
-	ey = dSlope.z * ex + dIntercept.z;
-	DrawInterceptLine( p, (float)sx, (float)sy, (float)ex, (float)ey, xs, ys, bPen );
+	DrawFitCurve( p, dIntercept.x, dSlope.x, dCurve.x, xs, ys, rPen );
+	DrawFitCurve( p, dIntercept.y, dSlope.y, dCurve.y, xs, ys, gPen );
+	DrawFitCurve( p, dIntercept.z, dSlope.z, dCurve.z, xs, ys, bPen );
 }
 
-void LineFit_Widget::DrawInterceptLine( QPainter &p, float sx, float sy, float ex, float ey, float xs, float ys, QPen & pen )
+void LineFit_Widget::DrawFitCurve( QPainter &p, double a, double b, double c, float xs, float ys, QPen & pen )
 {
-	sx = (sx - xmin) * xs;
-	sy = height() - (sy - ymin) * ys;
+	const int Segments = 32;
 
-	ex = (ex - xmin) * xs;
-	ey = height() - (ey - ymin) * ys;
-
-	QPointF p1(sx, sy);
-	QPointF p2(ex, ey);
+	QPolygonF curve;
+	for( int i = 0; i <= Segments; i++ )
+	{
+		double t = xmin + (xmax - xmin) * i / Segments;
+		double v = a + b * t + c * t * t;
+		curve << QPointF( (t - xmin) * xs, height() - (v - ymin) * ys );
+	}
 
 	p.setPen( pen );
-	p.drawLine( p1, p2 );
+	p.drawPolyline( curve );
 }
 
 
 void LineFit_Widget::ComputeLine(void)
 {
-	LFSampleD s, st;
-	//LFSample minS, maxS;
-
-	//xMin = yMin = 1000000.0f;
-	//xMax = yMax = -1000000.0f;
-
-	//if(samplesUsed > 0) {
-	//	minS = samples[0];
-	//	maxS = samples[0];
-	//}
-
-	s.x = s.y = s.z = s.t = 0.0;
-	st.t = st.x = st.y = st.z = 1.0;
-
-	for( int i = 0; i < samplesUsed; ++i )
-	{
-		s.t += samples[i].t;
-		s.x += samples[i].x;
-		s.y += samples[i].y;
-		s.z += samples[i].z;
-
-		//if(samples[i].t < minS.t) minS = samples[i];
-		//if(samples[i].t > maxS.t) maxS = samples[i];
-
-		/*	this code is only if you want the graph to auto-range
-		xMin = Math.Min( xMin, Samples[i].t );
-		xMax = Math.Max( xMax, Samples[i].t );
-		yMin = Math.Min( yMin, Samples[i].x );
-		yMax = Math.Max( yMax, Samples[i].x );
-		yMin = Math.Min( yMin, Samples[i].y );
-		yMax = Math.Max( yMax, Samples[i].y );
-		yMin = Math.Min( yMin, Samples[i].z );
-		yMax = Math.Max( yMax, Samples[i].z );
-		//*/
-	}
-
-	for( int i = 0; i < samplesUsed; ++i )
-	{
-		double t = samples[i].t - s.t / (double)samplesUsed;
-		st.t += t * t;
-		st.x += t * samples[i].x;
-		st.y += t * samples[i].y;
-		st.z += t * samples[i].z;
-	}
+	if( sumT[0] == 0.0 ) return;
 
-	dSlope.x = st.x / st.t;
-	dSlope.y = st.y / st.t;
-	dSlope.z = st.z / st.t;
+	// Over a narrow temperature range the curvature is mostly noise, so only fit a line
+	int terms = (tmax - tmin >= CurveMinSpan) ? 3 : 2;
 
-	dIntercept.x = (s.x - s.t * dSlope.x) / (double)samplesUsed;
-	dIntercept.y = (s.y - s.t * dSlope.y) / (double)samplesUsed;
-	dIntercept.z = (s.z - s.t * dSlope.z) / (double)samplesUsed;
+	DriftFit_Compute( sumT, sumY[0], terms, dIntercept.x, dSlope.x, dCurve.x );
+	DriftFit_Compute( sumT, sumY[1], terms, dIntercept.y, dSlope.y, dCurve.y );
+	DriftFit_Compute( sumT, sumY[2], terms, dIntercept.z, dSlope.z, dCurve.z );
 }
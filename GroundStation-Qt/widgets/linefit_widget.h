@@ -26,8 +26,10 @@ public:
 	void Reset(void);
 	void AddSample( LFSample &newSample , bool bRedraw );
 
+	// Least-squares fit of value = dIntercept + dSlope * t + dCurve * t * t over every sample since Reset()
 	LFSampleD	dSlope;
 	LFSampleD	dIntercept;
+	LFSampleD	dCurve;
 
 public slots:
 
@@ -35,12 +37,16 @@ protected:
     void paintEvent(QPaintEvent *event) Q_DECL_OVERRIDE;
 
 private:
-	void DrawInterceptLine( QPainter &p, float sx, float sy, float ex, float ey, float xs, float ys, QPen &pen );
+	void DrawFitCurve( QPainter &p, double a, double b, double c, float xs, float ys, QPen &pen );
 	void ComputeLine(void);
 
 
-	LFSample	samples[4096];
+	LFSample	samples[4096];		// Only the most recent samples are drawn, but all of them are fit
 	int			samplesUsed, sampleIndex;
+
+	double		sumT[5];			// Sums of u^0 .. u^4, where u = t / 256 keeps the powers in range
+	double		sumY[3][3];			// Sums of y, u*y, u*u*y for each axis
+	int			tmin, tmax;
 	float		xmin, xmax;
 	float		ymin, ymax;
 
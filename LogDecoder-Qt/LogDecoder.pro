@@ -0,0 +1,22 @@
+#-------------------------------------------------
+#
+# Command line decoder / analyzer for the binary
+# blackbox logs written by the Elev8-FC firmware
+#
+#-------------------------------------------------
+
+QT       += core concurrent
+QT       -= gui
+
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TARGET = logdecoder
+TEMPLATE = app
+
+SOURCES += main.cpp \
+    blackboxlog.cpp \
+    analysis.cpp
+
+HEADERS  += blackboxlog.h \
+    analysis.h
@@ -0,0 +1,196 @@
+#include "analysis.h"
+
+#include <complex>
+#include <algorithm>
+#include <math.h>
+
+typedef std::complex<double> Complex;
+
+static const double PI = 3.14159265358979323846;
+
+
+// In-place radix-2 FFT - size must be a power of two
+static void FFT( QVector<Complex> & a, bool inverse )
+{
+	int n = a.size();
+
+	for( int i=1, j=0; i<n; i++ )		// bit reversal permutation
+	{
+		int bit = n >> 1;
+		for( ; j & bit; bit >>= 1 ) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if( i < j ) std::swap( a[i], a[j] );
+	}
+
+	for( int len = 2; len <= n; len <<= 1 )
+	{
+		double ang = 2.0 * PI / len * (inverse ? 1.0 : -1.0);
+		Complex wlen( cos(ang), sin(ang) );
+
+		for( int i=0; i<n; i += len )
+		{
+			Complex w( 1.0, 0.0 );
+			for( int j=0; j < len/2; j++ )
+			{
+				Complex u = a[i+j];
+				Complex v = a[i+j+len/2] * w;
+				a[i+j] = u + v;
+				a[i+j+len/2] = u - v;
+				w *= wlen;
+			}
+		}
+	}
+
+	if( inverse ) {
+		for( int i=0; i<n; i++ ) a[i] /= (double)n;
+	}
+}
+
+
+static QVector<double> HannWindow( int n )
+{
+	QVector<double> w(n);
+	for( int i=0; i<n; i++ ) {
+		w[i] = 0.5 - 0.5 * cos( 2.0 * PI * i / (n - 1) );
+	}
+	return w;
+}
+
+
+// Copies one segment with the mean removed and the window applied
+static void LoadSegment( QVector<Complex> & dest, const QVector<double> & src, int start, const QVector<double> & window )
+{
+	int n = window.size();
+	double mean = 0.0;
+	for( int i=0; i<n; i++ ) mean += src[start+i];
+	mean /= n;
+
+	for( int i=0; i<n; i++ ) {
+		dest[i] = Complex( (src[start+i] - mean) * window[i], 0.0 );
+	}
+}
+
+
+LoopStats ComputeLoopStats( const QVector<qint32> & cycles, int rate )
+{
+	LoopStats stats;
+	stats.samples = cycles.size();
+	stats.minUs = stats.maxUs = stats.meanUs = stats.p99Us = 0.0;
+	stats.overruns = 0;
+	if( cycles.isEmpty() ) return stats;
+
+	const double UsPerUnit = 64.0 / 80.0;		// 64 clocks per unit at 80MHz
+	const double PeriodUs = 1000000.0 / rate;
+
+	QVector<double> us( cycles.size() );
+	double sum = 0.0;
+	for( int i=0; i<cycles.size(); i++ )
+	{
+		us[i] = cycles[i] * UsPerUnit;
+		sum += us[i];
+		if( us[i] > PeriodUs ) stats.overruns++;
+	}
+
+	stats.meanUs = sum / us.size();
+	stats.minUs = *std::min_element( us.begin(), us.end() );
+	stats.maxUs = *std::max_element( us.begin(), us.end() );
+
+	int p99 = (int)(us.size() * 0.99);
+	if( p99 >= us.size() ) p99 = us.size() - 1;
+	std::nth_element( us.begin(), us.begin() + p99, us.end() );
+	stats.p99Us = us[p99];
+
+	return stats;
+}
+
+
+QVector<double> PowerSpectrum( const QVector<double> & signal, int segment, double rate )
+{
+	QVector<double> psd( segment/2 + 1, 0.0 );
+	if( signal.size() < segment ) return psd;
+
+	QVector<double> window = HannWindow( segment );
+	double windowPower = 0.0;
+	for( int i=0; i<segment; i++ ) windowPower += window[i] * window[i];
+
+	QVector<Complex> buf( segment );
+	int count = 0;
+
+	for( int start = 0; start + segment <= signal.size(); start += segment/2 )
+	{
+		LoadSegment( buf, signal, start, window );
+		FFT( buf, false );
+
+		for( int k=0; k<psd.size(); k++ ) {
+			psd[k] += std::norm( buf[k] );
+		}
+		count++;
+	}
+
+	for( int k=0; k<psd.size(); k++ )
+	{
+		psd[k] /= count * rate * windowPower;
+		if( k != 0 && k != segment/2 ) psd[k] *= 2.0;		// one-sided
+	}
+	return psd;
+}
+
+
+QVector<double> StepResponse( const QVector<double> & setpoint, const QVector<double> & measured, int segment, int length )
+{
+	QVector<double> step( length, 0.0 );
+	int n = qMin( setpoint.size(), measured.size() );
+	if( n < segment ) return step;
+
+	// Only use windows where the setpoint is actually moving - hovering windows are all noise
+	double mean = 0.0, var = 0.0;
+	for( int i=0; i<n; i++ ) mean += setpoint[i];
+	mean /= n;
+	for( int i=0; i<n; i++ ) var += (setpoint[i] - mean) * (setpoint[i] - mean);
+	var /= n;
+
+	QVector<double> window = HannWindow( segment );
+	QVector<Complex> x( segment ), y( segment );
+	QVector<double> sxx( segment, 0.0 );
+	QVector<Complex> sxy( segment, Complex(0.0, 0.0) );
+	int used = 0;
+
+	for( int start = 0; start + segment <= n; start += segment/2 )
+	{
+		double segMean = 0.0, segVar = 0.0;
+		for( int i=0; i<segment; i++ ) segMean += setpoint[start+i];
+		segMean /= segment;
+		for( int i=0; i<segment; i++ ) segVar += (setpoint[start+i] - segMean) * (setpoint[start+i] - segMean);
+		segVar /= segment;
+		if( segVar < var * 0.25 ) continue;
+
+		LoadSegment( x, setpoint, start, window );
+		LoadSegment( y, measured, start, window );
+		FFT( x, false );
+		FFT( y, false );
+
+		for( int k=0; k<segment; k++ ) {
+			sxx[k] += std::norm( x[k] );
+			sxy[k] += y[k] * std::conj( x[k] );
+		}
+		used++;
+	}
+	if( used == 0 ) return step;
+
+	// Regularized division, so frequencies the pilot never excited don't blow up
+	double peak = *std::max_element( sxx.begin(), sxx.end() );
+	QVector<Complex> h( segment );
+	for( int k=0; k<segment; k++ ) {
+		h[k] = sxy[k] / (sxx[k] + peak * 1e-3);
+	}
+	FFT( h, true );		// impulse response
+
+	double sum = 0.0;
+	for( int i=0; i<length && i<segment; i++ ) {
+		sum += h[i].real();
+		step[i] = sum;
+	}
+	return step;
+}
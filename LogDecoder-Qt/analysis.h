@@ -0,0 +1,28 @@
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+#include <QVector>
+
+
+struct LoopStats
+{
+	qint64 samples;
+	double minUs, maxUs, meanUs, p99Us;
+	qint64 overruns;		// loops longer than the update period
+};
+
+// Loop times are logged in units of 64 clocks at 80MHz
+LoopStats ComputeLoopStats( const QVector<qint32> & cycles, int rate );
+
+
+// Welch power spectral density - Hann window, 50% overlap.  Returns segment/2+1 bins, from 0 to rate/2,
+// in (input units)^2 / Hz.  Segment must be a power of two.
+QVector<double> PowerSpectrum( const QVector<double> & signal, int segment, double rate );
+
+
+// Estimates the step response from setpoint to measured rate by averaging the transfer function over
+// windows where the setpoint is moving, then integrating the impulse response.  Returns 'length' samples,
+// where 1.0 is a perfect match to the setpoint.  Segment must be a power of two.
+QVector<double> StepResponse( const QVector<double> & setpoint, const QVector<double> & measured, int segment, int length );
+
+#endif // ANALYSIS_H
@@ -0,0 +1,275 @@
+#include "blackboxlog.h"
+
+#include <QtConcurrent>
+#include <QList>
+#include <string.h>
+
+
+static const char HeaderTag[] = "E8BB ";	// Every log starts with a text line: E8BB <version> <rate> <frame size> <fields>
+static const int  HeaderTagLen = 5;
+
+static const uchar SyncLow = 0x55, SyncHigh = 0xBB;		// BLACKBOX_SYNC, little-endian
+
+
+// Must match Checksum() in the firmware CommLink module - done on little-endian u16's
+static quint16 Checksum( const uchar * buf, int words )
+{
+	quint16 checksum = 0;
+	for( int i=0; i<words; i++ )
+	{
+		quint16 w = (quint16)(buf[i*2] | (buf[i*2+1] << 8));
+		checksum = (quint16)((checksum << 5) | (checksum >> (16-5))) ^ w;
+	}
+	return checksum;
+}
+
+
+BlackboxLog::BlackboxLog()
+{
+	version = rate = frameSize = 0;
+	checksumOffset = -1;
+	frames = badFrames = droppedFrames = 0;
+	flights = 0;
+}
+
+
+int BlackboxLog::Column( const char * name ) const
+{
+	return columnNames.indexOf( QByteArray(name) );
+}
+
+
+bool BlackboxLog::ParseHeader( const char * text, int length )
+{
+	QList<QByteArray> parts = QByteArray( text, length ).trimmed().split(' ');
+	if( parts.size() != 5 ) return false;
+
+	version = parts[1].toInt();
+	rate = parts[2].toInt();
+	frameSize = parts[3].toInt();
+	if( rate <= 0 || frameSize <= 4 ) return false;
+
+	fields.clear();
+	columnNames.clear();
+	checksumOffset = -1;
+
+	int offset = 0;
+	foreach( const QByteArray & desc, parts[4].split(',') )
+	{
+		int colon = desc.indexOf(':');
+		if( colon < 0 ) return false;
+
+		LogField f;
+		f.name = desc.left(colon);
+		f.count = 1;
+
+		QByteArray type = desc.mid(colon+1);
+		int bracket = type.indexOf('[');
+		if( bracket >= 0 ) {
+			f.count = type.mid( bracket+1, type.indexOf(']') - bracket - 1 ).toInt();
+			type = type.left(bracket);
+		}
+
+		if( type == "s16" )      f.type = LogField::S16;
+		else if( type == "u16" ) f.type = LogField::U16;
+		else if( type == "s32" ) f.type = LogField::S32;
+		else return false;
+
+		if( f.count < 1 ) return false;
+
+		// Fields are naturally aligned, as in the firmware struct
+		offset = (offset + f.Size() - 1) & ~(f.Size() - 1);
+		f.offset = offset;
+		offset += f.Size() * f.count;
+
+		if( f.name == "checksum" ) {
+			checksumOffset = f.offset;
+		}
+		else if( f.name != "sync" ) {
+			for( int i=0; i<f.count; i++ ) {
+				columnNames.append( f.count == 1 ? f.name : f.name + "_" + QByteArray::number(i) );
+			}
+		}
+		fields.append(f);
+	}
+
+	offset = (offset + 3) & ~3;		// The firmware struct is padded to a multiple of 4
+	return offset == frameSize && checksumOffset > 0;
+}
+
+
+bool BlackboxLog::IsHeader( const uchar * data, qint64 length, qint64 pos ) const
+{
+	return pos + HeaderTagLen <= length && memcmp( data + pos, HeaderTag, HeaderTagLen ) == 0;
+}
+
+
+bool BlackboxLog::IsFrame( const uchar * data, qint64 length, qint64 pos ) const
+{
+	if( pos + frameSize > length ) return false;
+	if( data[pos] != SyncLow || data[pos+1] != SyncHigh ) return false;
+
+	const uchar * check = data + pos + checksumOffset;
+	quint16 sourceCheck = (quint16)(check[0] | (check[1] << 8));
+	return Checksum( data + pos, checksumOffset / 2 ) == sourceCheck;
+}
+
+
+void BlackboxLog::DecodeChunk( const uchar * data, qint64 length, qint64 begin, qint64 end, Chunk * out ) const
+{
+	out->frames = out->badFrames = 0;
+	out->columns.resize( columnNames.size() );
+	for( int c=0; c<out->columns.size(); c++ ) {
+		out->columns[c].reserve( (int)((end - begin) / frameSize + 1) );
+	}
+
+	bool synced = false;
+	qint64 pos = begin;
+
+	while( pos < end )
+	{
+		if( IsHeader( data, length, pos ) )
+		{
+			const void * newline = memchr( data + pos, '\n', (size_t)(length - pos) );
+			pos = newline ? ((const uchar *)newline - data) + 1 : length;
+			synced = false;
+			continue;
+		}
+
+		if( !IsFrame( data, length, pos ) )
+		{
+			if( synced ) out->badFrames++;		// expected a frame here
+			synced = false;
+			pos++;
+			continue;
+		}
+
+		// When searching for sync, the sync bytes could just be frame data, so insist the next frame lines up too
+		if( !synced && pos + frameSize < length &&
+			!IsFrame( data, length, pos + frameSize ) && !IsHeader( data, length, pos + frameSize ) )
+		{
+			pos++;
+			continue;
+		}
+
+		const uchar * frame = data + pos;
+		int column = 0;
+		for( int i=0; i<fields.size(); i++ )
+		{
+			const LogField & f = fields[i];
+			if( f.name == "sync" || f.name == "checksum" ) continue;
+
+			const uchar * v = frame + f.offset;
+			for( int e=0; e<f.count; e++, v += f.Size() )
+			{
+				qint32 value;
+				switch( f.type ) {
+				case LogField::S16: value = (qint16)(v[0] | (v[1] << 8));	break;
+				case LogField::U16: value = (quint16)(v[0] | (v[1] << 8));	break;
+				default:            value = (qint32)(v[0] | (v[1] << 8) | (v[2] << 16) | ((quint32)v[3] << 24));	break;
+				}
+				out->columns[column++].append( value );
+			}
+		}
+
+		out->frames++;
+		synced = true;
+		pos += frameSize;
+	}
+}
+
+
+bool BlackboxLog::Decode( const uchar * data, qint64 length, int threads )
+{
+	// Headers are short text lines, so finding them is a quick scan.  The frame layout comes from
+	// the first one, and every flight in one file has to use the same layout.
+	QByteArray firstHeader;
+	flights = 0;
+
+	for( qint64 pos = 0; pos < length; )
+	{
+		const void * hit = memchr( data + pos, HeaderTag[0], (size_t)(length - pos) );
+		if( hit == 0 ) break;
+		pos = (const uchar *)hit - data;
+
+		if( IsHeader( data, length, pos ) )
+		{
+			const void * newline = memchr( data + pos, '\n', (size_t)(length - pos) );
+			qint64 lineEnd = newline ? (const uchar *)newline - data : length;
+			QByteArray header( (const char *)data + pos, (int)(lineEnd - pos) );
+
+			if( flights == 0 ) {
+				if( !ParseHeader( header.constData(), header.length() ) ) {
+					error = "Unrecognized log header: " + header;
+					return false;
+				}
+				firstHeader = header;
+			}
+			else if( header != firstHeader ) {
+				error = "Log contains flights with different frame layouts";
+				return false;
+			}
+			flights++;
+			pos = lineEnd;
+		}
+		else pos++;
+	}
+
+	if( flights == 0 ) {
+		error = "No blackbox header found";
+		return false;
+	}
+
+	// Split the rest into one chunk per thread.  Each chunk decodes the frames that start inside it.
+	if( threads < 1 ) threads = 1;
+	qint64 chunkSize = (length + threads - 1) / threads;
+	const qint64 MinChunk = 1 << 20;
+	if( chunkSize < MinChunk ) chunkSize = MinChunk;
+
+	QVector<Chunk> chunks( (int)((length + chunkSize - 1) / chunkSize) );
+	QList< QFuture<void> > jobs;
+
+	for( int i=0; i<chunks.size(); i++ )
+	{
+		qint64 begin = i * chunkSize;
+		qint64 end = qMin( begin + chunkSize, length );
+		jobs.append( QtConcurrent::run( this, &BlackboxLog::DecodeChunk, data, length, begin, end, &chunks[i] ) );
+	}
+	foreach( QFuture<void> job, jobs ) {
+		job.waitForFinished();
+	}
+
+	// Join the chunks back together, in order
+	frames = badFrames = 0;
+	for( int i=0; i<chunks.size(); i++ ) {
+		frames += chunks[i].frames;
+		badFrames += chunks[i].badFrames;
+	}
+
+	columns.resize( columnNames.size() );
+	for( int c=0; c<columns.size(); c++ )
+	{
+		columns[c].clear();
+		columns[c].reserve( (int)frames );
+		for( int i=0; i<chunks.size(); i++ ) {
+			columns[c] += chunks[i].columns[c];
+			chunks[i].columns[c].clear();
+		}
+	}
+
+	// Gaps in the counter within a flight are dropped frames.  Gaps longer than a second are a new flight.
+	droppedFrames = 0;
+	int counter = Column( "counter" );
+	if( counter >= 0 )
+	{
+		const QVector<qint32> & c = columns[counter];
+		for( int i=1; i<c.size(); i++ )
+		{
+			int gap = (c[i] - c[i-1]) & 0xffff;
+			if( gap > 1 && gap <= rate ) {
+				droppedFrames += gap - 1;
+			}
+		}
+	}
+	return true;
+}
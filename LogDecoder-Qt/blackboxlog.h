@@ -0,0 +1,61 @@
+#ifndef BLACKBOXLOG_H
+#define BLACKBOXLOG_H
+
+#include <QByteArray>
+#include <QVector>
+
+
+// One field of a blackbox frame, as described by the text header at the start of each log
+struct LogField
+{
+	enum Type { S16, U16, S32 };
+
+	QByteArray name;
+	Type type;
+	int count;		// array length, 1 for plain values
+	int offset;		// byte offset of the first element in the frame
+
+	int Size() const { return (type == S32) ? 4 : 2; }
+};
+
+
+// Decodes the binary flight logs written to serial port 3 by the firmware blackbox module.
+// The log is split into chunks that are decoded in parallel, then joined back in order.
+class BlackboxLog
+{
+public:
+	BlackboxLog();
+
+	bool Decode( const uchar * data, qint64 length, int threads );
+
+	int Column( const char * name ) const;		// Index into columns, or -1 if there is no such column
+
+	// Frame layout, from the first header in the log
+	int version, rate, frameSize;
+	QVector<LogField> fields;
+	int checksumOffset;
+
+	// Decoded values - one vector per column, arrays are expanded to name_0, name_1, etc
+	QVector<QByteArray> columnNames;
+	QVector< QVector<qint32> > columns;
+
+	// Decode statistics
+	qint64 frames;
+	qint64 badFrames;		// corrupt or missing frames where one was expected (after sync)
+	qint64 droppedFrames;	// gaps in the frame counter within a flight
+	int flights;			// number of headers found
+	QByteArray error;
+
+private:
+	struct Chunk {
+		QVector< QVector<qint32> > columns;
+		qint64 frames, badFrames;
+	};
+
+	bool ParseHeader( const char * text, int length );
+	bool IsHeader( const uchar * data, qint64 length, qint64 pos ) const;
+	bool IsFrame( const uchar * data, qint64 length, qint64 pos ) const;
+	void DecodeChunk( const uchar * data, qint64 length, qint64 begin, qint64 end, Chunk * out ) const;
+};
+
+#endif // BLACKBOXLOG_H
@@ -0,0 +1,250 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+#include <QtConcurrent>
+#include <stdio.h>
+
+#include "analysis.h"
+#include "blackboxlog.h"
+
+
+static const double GyroToDPS = 0.07;		// 70 mdps per bit at 2000 deg/sec full scale
+static const int    SpectrumSegment = 512;	// ~0.5hz resolution at 250hz
+static const int    CsvBlockRows = 65536;
+
+
+static int IntToAscii( qint32 value, char * dest )
+{
+	char tmp[12];
+	int len = 0;
+	quint32 v = value < 0 ? (quint32)(-(qint64)value) : (quint32)value;
+
+	do {
+		tmp[len++] = (char)('0' + v % 10);
+		v /= 10;
+	} while( v );
+
+	int out = 0;
+	if( value < 0 ) dest[out++] = '-';
+	while( len ) dest[out++] = tmp[--len];
+	return out;
+}
+
+
+static QByteArray FormatRows( const BlackboxLog * log, int first, int last )
+{
+	int numColumns = log->columns.size();
+	QByteArray out;
+	out.reserve( (last - first) * numColumns * 7 );
+
+	char buf[16];
+	for( int r = first; r < last; r++ ) {
+		for( int c = 0; c < numColumns; c++ ) {
+			out.append( buf, IntToAscii( log->columns[c][r], buf ) );
+			out.append( c+1 < numColumns ? ',' : '\n' );
+		}
+	}
+	return out;
+}
+
+
+static bool WriteCsv( const BlackboxLog & log, const QString & path, int threads )
+{
+	QFile file( path );
+	if( !file.open( QIODevice::WriteOnly ) ) return false;
+
+	file.write( log.columnNames.toList().join(',') + "\n" );
+
+	// Format blocks of rows in parallel, then write them in order
+	int rows = (int)log.frames;
+	for( int first = 0; first < rows; first += CsvBlockRows * threads )
+	{
+		QList< QFuture<QByteArray> > blocks;
+		for( int b = 0; b < threads; b++ )
+		{
+			int start = first + b * CsvBlockRows;
+			if( start >= rows ) break;
+			blocks.append( QtConcurrent::run( FormatRows, &log, start, qMin( start + CsvBlockRows, rows ) ) );
+		}
+		foreach( QFuture<QByteArray> block, blocks ) {
+			file.write( block.result() );
+		}
+	}
+	return true;
+}
+
+
+// One raw little-endian int32 file per column, plus a schema - loads straight into numpy, pandas, etc
+static bool WriteColumns( const BlackboxLog & log, const QString & path )
+{
+	QDir dir;
+	if( !dir.mkpath( path ) ) return false;
+
+	QFile schema( path + "/schema.txt" );
+	if( !schema.open( QIODevice::WriteOnly | QIODevice::Text ) ) return false;
+	schema.write( QString( "rows %1 rate %2\n" ).arg( log.frames ).arg( log.rate ).toLatin1() );
+
+	for( int c = 0; c < log.columns.size(); c++ )
+	{
+		QString name = QString::fromLatin1( log.columnNames[c] );
+		QFile file( path + "/" + name + ".i32" );
+		if( !file.open( QIODevice::WriteOnly ) ) return false;
+
+		file.write( (const char *)log.columns[c].constData(), log.columns[c].size() * sizeof(qint32) );
+		schema.write( (name + " int32\n").toLatin1() );
+	}
+	return true;
+}
+
+
+static QVector<double> Scaled( const QVector<qint32> & src, double scale )
+{
+	QVector<double> out( src.size() );
+	for( int i = 0; i < src.size(); i++ ) out[i] = src[i] * scale;
+	return out;
+}
+
+
+static bool WriteSpectrum( const BlackboxLog & log, const QString & path )
+{
+	int gx = log.Column( "gyro_0" ), gy = log.Column( "gyro_1" ), gz = log.Column( "gyro_2" );
+	if( gx < 0 || gy < 0 || gz < 0 ) return false;
+
+	QFuture< QVector<double> > axis[3] = {
+		QtConcurrent::run( PowerSpectrum, Scaled( log.columns[gx], GyroToDPS ), SpectrumSegment, (double)log.rate ),
+		QtConcurrent::run( PowerSpectrum, Scaled( log.columns[gy], GyroToDPS ), SpectrumSegment, (double)log.rate ),
+		QtConcurrent::run( PowerSpectrum, Scaled( log.columns[gz], GyroToDPS ), SpectrumSegment, (double)log.rate ),
+	};
+
+	QFile file( path );
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) ) return false;
+
+	QTextStream out( &file );
+	out << "freq_hz,gyro_x,gyro_y,gyro_z\n";		// (deg/sec)^2 / hz
+
+	QVector<double> x = axis[0].result(), y = axis[1].result(), z = axis[2].result();
+	for( int k = 0; k < x.size(); k++ ) {
+		out << (double)k * log.rate / SpectrumSegment << "," << x[k] << "," << y[k] << "," << z[k] << "\n";
+	}
+	return true;
+}
+
+
+static bool WriteStepResponse( const BlackboxLog & log, const QString & path )
+{
+	int gx = log.Column( "gyro_0" ), gy = log.Column( "gyro_1" ), gz = log.Column( "gyro_2" );
+	int roll = log.Column( "pid_roll_0" ), pitch = log.Column( "pid_pitch_0" ), yaw = log.Column( "pid_yaw_0" );
+	if( gx < 0 || gy < 0 || gz < 0 || roll < 0 || pitch < 0 || yaw < 0 ) return false;
+
+	// These have to match the axis mapping in UpdateFlightLoop() in the firmware.  The PIDs log the
+	// proportional error (setpoint - measured), so the setpoint is the error plus the measured rate.
+	QVector<double> measured[3] = {
+		Scaled( log.columns[gy],  1.0 ),
+		Scaled( log.columns[gx], -1.0 ),
+		Scaled( log.columns[gz], -1.0 ),
+	};
+	int error[3] = { roll, pitch, yaw };
+
+	QFuture< QVector<double> > axis[3];
+	int length = log.rate / 2;		// half a second
+	for( int a = 0; a < 3; a++ )
+	{
+		QVector<double> setpoint = measured[a];
+		for( int i = 0; i < setpoint.size(); i++ ) setpoint[i] += log.columns[error[a]][i];
+
+		axis[a] = QtConcurrent::run( StepResponse, setpoint, measured[a], SpectrumSegment, length );
+	}
+
+	QFile file( path );
+	if( !file.open( QIODevice::WriteOnly | QIODevice::Text ) ) return false;
+
+	QTextStream out( &file );
+	out << "time_ms,roll,pitch,yaw\n";
+
+	QVector<double> r = axis[0].result(), p = axis[1].result(), y = axis[2].result();
+	for( int i = 0; i < length; i++ ) {
+		out << i * 1000.0 / log.rate << "," << r[i] << "," << p[i] << "," << y[i] << "\n";
+	}
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication app( argc, argv );
+	QCoreApplication::setApplicationName( "logdecoder" );
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription( "Decodes and analyzes Elev8-FC blackbox flight logs" );
+	parser.addHelpOption();
+	parser.addPositionalArgument( "log", "Binary log file captured from serial port 3" );
+
+	QCommandLineOption csvOption( QStringList() << "c" << "csv", "Write all decoded values as CSV.", "file" );
+	QCommandLineOption columnsOption( QStringList() << "d" << "columns", "Write one raw int32 file per column into <dir>.", "dir" );
+	QCommandLineOption spectrumOption( QStringList() << "s" << "spectrum", "Write the gyro noise spectrum as CSV.", "file" );
+	QCommandLineOption stepOption( QStringList() << "r" << "step", "Write the roll/pitch/yaw step response estimate as CSV.", "file" );
+	QCommandLineOption threadsOption( QStringList() << "j" << "threads", "Number of decode threads (default: all cores).", "n" );
+	parser.addOption( csvOption );
+	parser.addOption( columnsOption );
+	parser.addOption( spectrumOption );
+	parser.addOption( stepOption );
+	parser.addOption( threadsOption );
+	parser.process( app );
+
+	if( parser.positionalArguments().size() != 1 ) {
+		parser.showHelp( 1 );
+	}
+
+	int threads = QThread::idealThreadCount();
+	if( parser.isSet( threadsOption ) ) threads = parser.value( threadsOption ).toInt();
+	if( threads < 1 ) threads = 1;
+	QThreadPool::globalInstance()->setMaxThreadCount( threads );
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QFile file( parser.positionalArguments()[0] );
+	if( !file.open( QIODevice::ReadOnly ) ) {
+		fprintf( stderr, "Unable to open %s\n", qPrintable( file.fileName() ) );
+		return 1;
+	}
+
+	const uchar * data = file.map( 0, file.size() );
+	if( data == 0 ) {
+		fprintf( stderr, "Unable to map %s\n", qPrintable( file.fileName() ) );
+		return 1;
+	}
+
+	BlackboxLog log;
+	if( !log.Decode( data, file.size(), threads ) ) {
+		fprintf( stderr, "%s\n", log.error.constData() );
+		return 1;
+	}
+
+	printf( "Log version %d, %d hz, %d byte frames, %d flight(s)\n", log.version, log.rate, log.frameSize, log.flights );
+	printf( "Frames: %lld decoded, %lld bad, %lld dropped\n", log.frames, log.badFrames, log.droppedFrames );
+
+	int cycles = log.Column( "cycles" );
+	if( cycles >= 0 ) {
+		LoopStats stats = ComputeLoopStats( log.columns[cycles], log.rate );
+		printf( "Loop time (uS): %.1f min, %.1f avg, %.1f 99%%, %.1f max, %lld overruns\n",
+				stats.minUs, stats.meanUs, stats.p99Us, stats.maxUs, stats.overruns );
+	}
+
+	bool ok = true;
+	if( parser.isSet( csvOption ) )      ok &= WriteCsv( log, parser.value( csvOption ), threads );
+	if( parser.isSet( columnsOption ) )  ok &= WriteColumns( log, parser.value( columnsOption ) );
+	if( parser.isSet( spectrumOption ) ) ok &= WriteSpectrum( log, parser.value( spectrumOption ) );
+	if( parser.isSet( stepOption ) )     ok &= WriteStepResponse( log, parser.value( stepOption ) );
+
+	printf( "Done in %.2f sec\n", timer.elapsed() / 1000.0 );
+
+	if( !ok ) {
+		fprintf( stderr, "One or more outputs could not be written\n" );
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,59 @@
+#-------------------------------------------------
+#
+# Host-built checks of the firmware and GroundStation
+# code that doesn't need a Propeller to run.  Run the
+# result - it prints each failure and returns nonzero
+# if there were any.
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG   += console c++11
+CONFIG   -= app_bundle
+
+TARGET = elev8tests
+TEMPLATE = app
+
+# Firmware files find <propeller.h> here instead of in propgcc
+INCLUDEPATH += stubs
+
+# PASM drivers are assembled from the source at run time
+DEFINES += FIRMWARE_DIR=\\\"$$PWD/../Firmware-C/\\\"
+
+SOURCES += main.cpp \
+    biquad_test.cpp \
+    commlink_test.cpp \
+    crsf_test.cpp \
+    drift_test.cpp \
+    f32cog.cpp \
+    fwprefs_test.cpp \
+    noisetrack_test.cpp \
+    pasmcog.cpp \
+    quatimu_test.cpp \
+    s4cog.cpp \
+    serial4x_test.cpp \
+    stubs/propeller.cpp \
+    ../Firmware-C/commlink.cpp \
+    ../Firmware-C/quatimu.cpp \
+    ../Firmware-C/serial_4x.cpp \
+    ../GroundStation-Qt/driftfit.cpp \
+    ../GroundStation-Qt/packet.cpp \
+    ../GroundStation-Qt/prefs.cpp
+
+HEADERS  += tests.h \
+    pasmcog.h \
+    s4cog.h \
+    stubs/fdserial.h \
+    stubs/propeller.h \
+    ../Firmware-C/commlink.h \
+    ../Firmware-C/f32.h \
+    ../Firmware-C/noisetrack.h \
+    ../Firmware-C/prefs.h \
+    ../Firmware-C/quatimu.h \
+    ../Firmware-C/serial_4x.h \
+    ../GroundStation-Qt/driftfit.h \
+    ../GroundStation-Qt/elev8data.h \
+    ../GroundStation-Qt/packet.h \
+    ../GroundStation-Qt/prefs.h
@@ -0,0 +1,180 @@
+#include <math.h>
+#include <string.h>
+#include "tests.h"
+#include "../GroundStation-Qt/prefs.h"
+
+// Gyro filtering.  The biquads run as PASM (FilterGyro in sensors_driver.spin), so this is a fixed
+// point model of it, step for step, run with the coefficients the GroundStation computes.
+
+static const double SampleRate = 952.0;
+static const double PI = 3.14159265358979323846;
+
+
+// One stage for one axis: the 5 coefficients, then the 6 longs of history FilterGyro keeps in the hub
+class BIQUAD_MODEL
+{
+public:
+	BIQUAD_MODEL( const short * coef ) {
+		for( int i = 0; i < 5; i++ ) c[i] = coef[i];
+		memset( hist, 0, sizeof(hist) );
+	}
+
+	int Filter( int x )
+	{
+		hist[0] = x;							// wrlong fX, fState
+
+		// Each history value is replaced with the one before it as it's read
+		int acc = 0, t2 = x;
+		for( int term = 0; term < 5; term++ )
+		{
+			int v = hist[term];
+			hist[term] = t2;
+			t2 = v;
+			acc += c[term] * v;					// The low 32 bits of multiply
+		}
+
+		acc += hist[5];							// The fraction dropped last time
+		hist[5] = acc & 0xFFF;
+
+		acc >>= 12;								// sar fAcc, #12
+		hist[3] = acc;							// y1 = y
+		return acc;
+	}
+
+private:
+	int c[5];
+	int hist[6];		// x0, x1, x2, y1, y2, rounding
+};
+
+
+// Ratio of output to input RMS for a tone, once the filter has settled
+static double Gain( const short * coef, double hz )
+{
+	BIQUAD_MODEL f( coef );
+	const double Amplitude = 2000.0;
+
+	double in = 0.0, out = 0.0;
+	for( int n = 0; n < 6000; n++ )
+	{
+		int x = (int)floor( Amplitude * sin( 2.0 * PI * hz * n / SampleRate ) + 0.5 );
+		int y = f.Filter( x );
+		if( n >= 2000 ) {
+			in += (double)x * x;
+			out += (double)y * y;
+		}
+	}
+	return sqrt( out / in );
+}
+
+
+// Finds where the gain crosses 1/sqrt(2) between two frequencies, by bisection
+static double HalfPowerPoint( const short * coef, double lo, double hi )
+{
+	bool loInside = Gain( coef, lo ) < 0.70710678;
+	for( int i = 0; i < 16; i++ ) {
+		double mid = (lo + hi) * 0.5;
+		if( (Gain( coef, mid ) < 0.70710678) == loInside ) lo = mid; else hi = mid;
+	}
+	return (lo + hi) * 0.5;
+}
+
+
+// The same filter in floating point, with the same coefficients - the fixed point version should
+// only differ from it by the rounding, which the poles amplify the closer they are to the unit circle
+static int WorstRounding( const short * coef )
+{
+	BIQUAD_MODEL f( coef );
+	double b0 = coef[0] / 4096.0, b1 = coef[1] / 4096.0, b2 = coef[2] / 4096.0;
+	double na1 = coef[3] / 4096.0, na2 = coef[4] / 4096.0;
+	double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+
+	// Gyro-like input - slow motion plus motor noise
+	int worst = 0;
+	for( int n = 0; n < 20000; n++ )
+	{
+		int x = (int)floor( 1500.0 * sin( 2.0 * PI * 3.0 * n / SampleRate ) + 400.0 * sin( 2.0 * PI * 170.0 * n / SampleRate ) + 0.5 );
+		double y = b0 * x + b1 * x1 + b2 * x2 + na1 * y1 + na2 * y2;
+		x2 = x1;  x1 = x;
+		y2 = y1;  y1 = y;
+
+		int diff = (int)ceil( fabs( f.Filter( x ) - y ) );
+		if( diff > worst ) worst = diff;
+	}
+	return worst;
+}
+
+
+// A constant input has to come out unchanged on average, or the filter would add to the gyro drift.
+// The carried rounding makes the output dither by a count or so, but it can't build into an offset.
+static double Settled( const short * coef, int x )
+{
+	BIQUAD_MODEL f( coef );
+	double sum = 0.0;
+	for( int n = 0; n < 6000; n++ ) {
+		int y = f.Filter( x );
+		if( n >= 2000 ) sum += y;
+	}
+	return sum / 4000.0;
+}
+
+
+void Test_GyroFilters(void)
+{
+	PREFS prefs;
+	memset( &prefs, 0, sizeof(prefs) );
+
+	// Pass-through, which is what the firmware loads for a stage that's turned off
+	static const short PassThrough[5] = { 4096, 0, 0, 0, 0 };
+	BIQUAD_MODEL pass( PassThrough );
+	for( int x = -3000; x <= 3000; x += 7 ) CHECK( pass.Filter( x ) == x );
+
+	// Low-pass
+	static const int Cutoffs[] = { 30, 80, 150, 300 };
+	for( unsigned i = 0; i < sizeof(Cutoffs) / sizeof(Cutoffs[0]); i++ )
+	{
+		int cutoff = Cutoffs[i];
+		Prefs_SetGyroLowPass( prefs, cutoff );
+		CHECK( Prefs_GyroLowPass( prefs ) == cutoff );
+
+		CHECK_NEAR( Gain( prefs.GyroLowPass, cutoff / 10.0 ), 1.0, 0.02 );
+		CHECK_NEAR( Gain( prefs.GyroLowPass, cutoff ), 0.7071, 0.03 );			// -3dB at the cutoff
+		if( cutoff * 3 < SampleRate / 2 ) CHECK( Gain( prefs.GyroLowPass, cutoff * 3 ) < 0.15 );
+
+		CHECK( Settled( prefs.GyroLowPass, 1234 ) == 1234.0 );		// The low-pass coefficients sum to exactly 1
+		CHECK( Settled( prefs.GyroLowPass, -777 ) == -777.0 );
+		CHECK( WorstRounding( prefs.GyroLowPass ) <= 3 );
+	}
+
+	// Notch
+	static const int Notches[][2] = { { 60, 20 }, { 100, 30 }, { 180, 40 }, { 250, 60 }, { 400, 80 } };
+	for( unsigned i = 0; i < sizeof(Notches) / sizeof(Notches[0]); i++ )
+	{
+		int center = Notches[i][0], width = Notches[i][1];
+		Prefs_SetGyroNotch( prefs, center, width );
+		CHECK( Prefs_GyroNotchCenter( prefs ) == center );
+		CHECK_NEAR( Prefs_GyroNotchWidth( prefs ), width, 1 );
+
+		CHECK( Gain( prefs.GyroNotch, center ) < 0.03 );
+
+		// The -3dB points are width apart - not quite centered, since the response isn't symmetric in Hz
+		double lower = HalfPowerPoint( prefs.GyroNotch, center / 4.0, center );
+		double upper = HalfPowerPoint( prefs.GyroNotch, center, SampleRate / 2 - 1.0 );
+		CHECK_NEAR( upper - lower, width, 1.5 );
+		CHECK( lower < center && upper > center );
+
+		CHECK_NEAR( Gain( prefs.GyroNotch, center / 8.0 ), 1.0, 0.02 );
+		if( center + 2 * width < SampleRate / 2 ) CHECK( Gain( prefs.GyroNotch, center + 2 * width ) > 0.85 );
+
+		CHECK_NEAR( Settled( prefs.GyroNotch, 1234 ), 1234.0, 0.5 );	// Rounding b0 can leave the DC gain 1/4096 high
+		CHECK_NEAR( Settled( prefs.GyroNotch, -777 ), -777.0, 0.5 );
+		CHECK( WorstRounding( prefs.GyroNotch ) <= 8 );
+	}
+
+	// Settings the filters can't do turn them off, which the firmware sees as b0 = 0
+	Prefs_SetGyroLowPass( prefs, 0 );
+	CHECK( prefs.GyroLowPass[0] == 0 && Prefs_GyroLowPass( prefs ) == 0 );
+	Prefs_SetGyroLowPass( prefs, 500 );
+	CHECK( prefs.GyroLowPass[0] == 0 );
+	Prefs_SetGyroNotch( prefs, 200, 0 );
+	CHECK( prefs.GyroNotch[0] == 0 && Prefs_GyroNotchCenter( prefs ) == 0 );
+}
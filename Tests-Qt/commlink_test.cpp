@@ -0,0 +1,204 @@
+#include <math.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "tests.h"
+#include "s4cog.h"
+#include "../Firmware-C/commlink.h"
+#include "../GroundStation-Qt/packet.h"
+#include "../GroundStation-Qt/elev8data.h"
+
+// Builds compact telemetry packets with the firmware's COMMLINK, and decodes them with the
+// GroundStation's packet class, to check the encodings survive the round trip
+
+
+// Finishes the packet COMMLINK is building, sends it through port 0, and reads it back the way
+// Connection does - the type from the header, and everything after the header into data
+static bool ReceivePacket( packet & p )
+{
+	COMMLINK::EndPacket();
+	COMMLINK::SendPacket( 0 );
+
+	unsigned char buf[64];
+	int count = S4Cog_Transmit( 0, buf, sizeof(buf) );
+
+	CHECK( count == COMMLINK::PacketLength() );
+	CHECK( (count & 1) == 0 );
+	CHECK( buf[0] == 0x55 && buf[1] == 0xAA );
+	if( count < 8 || buf[0] != 0x55 ) return false;
+
+	int len = buf[4] | (buf[5] << 8);
+	CHECK( len == count );
+
+	p.mode = buf[2];
+	p.len = len - 6;
+	p.data = QByteArray( (const char *)buf + 6, count - 6 );
+	p.index = 0;
+	return true;
+}
+
+
+static void TestVarInts(void)
+{
+	static const int Values[] = {
+		0, 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, -8193,
+		32767, -32768, 1 << 20, -(1 << 20), INT_MAX, INT_MIN,
+	};
+	static const int Bytes[] = {
+		1, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3,
+		3, 3, 4, 3, 5, 5,
+	};
+	const int Count = sizeof(Values) / sizeof(Values[0]);
+
+	// A packet only holds 56 bytes of payload, so send them a few at a time
+	for( int first = 0; first < Count; first += 8 )
+	{
+		int last = (first + 8 < Count) ? first + 8 : Count;
+
+		COMMLINK::StartPacket( 0x12, 0 );
+		int expectedLength = 6;
+		for( int i = first; i < last; i++ ) {
+			COMMLINK::AddPacketVarInt( Values[i] );
+			expectedLength += Bytes[i];
+		}
+
+		packet p;
+		if( !ReceivePacket( p ) ) continue;
+		CHECK( p.mode == 0x12 );
+
+		for( int i = first; i < last; i++ ) {
+			int start = p.index;
+			CHECK( p.GetVarInt() == Values[i] );
+			CHECK( p.index - start == Bytes[i] );
+		}
+		CHECK( (expectedLength + 1) / 2 * 2 + 2 == p.len + 6 );		// Padded to even, plus the checksum
+	}
+
+	// Sensor deltas are mostly small, so check a run of those round trip too
+	srand( 27 );
+	COMMLINK::StartPacket( 0x12, 0 );
+	int deltas[10];
+	for( int i = 0; i < 10; i++ ) {
+		deltas[i] = rand() % 4001 - 2000;
+		COMMLINK::AddPacketVarInt( deltas[i] );
+	}
+	packet p;
+	if( ReceivePacket( p ) ) {
+		for( int i = 0; i < 10; i++ ) CHECK( p.GetVarInt() == deltas[i] );
+	}
+}
+
+
+static void RandomQuat( float * q )
+{
+	double sum;
+	do {
+		sum = 0.0;
+		for( int i = 0; i < 4; i++ ) {
+			q[i] = (float)(rand() / (double)RAND_MAX * 2.0 - 1.0);
+			sum += q[i] * q[i];
+		}
+	} while( sum < 0.01 || sum > 1.0 );
+
+	for( int i = 0; i < 4; i++ ) q[i] = (float)(q[i] / sqrt(sum));
+}
+
+
+static void TestQuats(void)
+{
+	static const float Fixed[][4] = {
+		{ 0.0f, 0.0f, 0.0f, 1.0f },
+		{ 0.0f, 0.0f, 0.0f, -1.0f },
+		{ 0.5f, 0.5f, 0.5f, 0.5f },		// Every component is the largest
+		{ -0.5f, 0.5f, -0.5f, -0.5f },
+		{ 0.70710678f, 0.0f, 0.0f, -0.70710678f },	// Two largest, at the edge of the scaled range
+		{ 0.0f, -1.0f, 0.0f, 0.0f },
+	};
+	const int FixedCount = sizeof(Fixed) / sizeof(Fixed[0]);
+
+	srand( 13 );
+	double worst = 0.0;
+	for( int n = 0; n < FixedCount + 10000; n++ )
+	{
+		float q[4];
+		if( n < FixedCount ) {
+			for( int i = 0; i < 4; i++ ) q[i] = Fixed[n][i];
+		}
+		else {
+			RandomQuat( q );
+		}
+
+		COMMLINK::StartPacket( 0x13, 8 );
+		COMMLINK::AddPacketQuat( q );
+
+		packet p;
+		if( !ReceivePacket( p ) ) continue;
+		CHECK( p.len == 10 );		// 8 byte payload and the checksum
+
+		float r[4];
+		p.GetCompactQuat( r );
+
+		// q and -q are the same rotation, and the encoding is free to send either
+		double dot = 0.0;
+		for( int i = 0; i < 4; i++ ) dot += q[i] * r[i];
+		double sign = (dot < 0.0) ? -1.0 : 1.0;
+
+		for( int i = 0; i < 4; i++ ) {
+			double err = fabs( q[i] - sign * r[i] );
+			if( err > worst ) worst = err;
+		}
+	}
+
+	// Each of the three is truncated to 1 / (32767 * sqrt(2)), about 2.2e-5, and the largest is rebuilt from them
+	CHECK( worst < 1.0e-4 );
+	if( worst >= 1.0e-4 ) printf( "  worst quaternion component error %g\n", worst );
+}
+
+
+// A compact sensor packet as SendStream builds it - the loop counter after the values is optional,
+// since older firmware doesn't send it
+static bool SensorPacket( packet & p, char seq, char key, const short * values, int counter, bool withCounter )
+{
+	char hdr[2] = { seq, key };
+	COMMLINK::StartPacket( 0x12, 0 );
+	COMMLINK::AddPacketData( hdr, 2 );
+	for( int i = 0; i < 10; i++ ) COMMLINK::AddPacketVarInt( values[i] );
+	if( withCounter ) COMMLINK::AddPacketVarInt( counter );
+	return ReceivePacket( p );
+}
+
+
+static void TestSensors(void)
+{
+	static const short Key[10] = { 300, -12, 7, 0, 100, -50, 4096, 210, -340, 95 };
+	static const short Delta[10] = { 1, -2, 0, 0, 3, 0, -4, 0, 0, 1 };
+
+	// Keyframes carry the counter, and the packets after it a delta
+	SensorData s;
+	packet p;
+	if( SensorPacket( p, 0, 1, Key, 123456, true ) ) CHECK( s.ReadCompactFrom( &p ) );
+	CHECK( s.Counter == 123456 && s.Temp == 300 && s.MagZ == 95 );
+
+	if( SensorPacket( p, 1, 0, Delta, 8, true ) ) CHECK( s.ReadCompactFrom( &p ) );
+	CHECK( s.Counter == 123464 && s.Temp == 301 && s.AccelZ == 4092 );
+
+	// Older firmware's packets leave it at zero, with or without the pad byte after the values
+	SensorData old;
+	if( SensorPacket( p, 0, 1, Key, 0, false ) ) CHECK( old.ReadCompactFrom( &p ) );
+	CHECK( old.Counter == 0 && old.MagZ == 95 );
+
+	short odd[10];
+	memcpy( odd, Key, sizeof(odd) );
+	odd[0] = 30;			// One byte shorter, so the other padding
+	if( SensorPacket( p, 1, 1, odd, 0, false ) ) CHECK( old.ReadCompactFrom( &p ) );
+	CHECK( old.Counter == 0 && old.Temp == 30 );
+}
+
+
+void Test_CompactTelemetry(void)
+{
+	S4Cog_Start( 100, 16 );		// Define_Port takes the sizes as chars
+
+	TestVarInts();
+	TestQuats();
+	TestSensors();
+}
@@ -0,0 +1,202 @@
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "tests.h"
+#include "pasmcog.h"
+
+// CRSF receiver decoding.  The decoder is the PASM in crsf_driver.spin, run by the cog stand-in in
+// pasmcog.cpp, with captured frames turned back into the bits on the receiver pin.
+
+
+// The hub block the driver writes, as laid out in sbus.cpp, with the Propeller's 32 bit longs
+struct CRSF_HUB {
+	int32_t		InputMask;
+	int32_t		BaudDelay;
+	uint16_t	Channels[18];
+	int32_t		FrameTime;
+	int32_t		LostFrames;
+	int32_t		Failsafes;
+	int32_t		FrameCount;
+};
+
+static const int InputPin = 7;
+static const double BitTime = 80000000.0 / 420000.0;	// Clocks
+static const uint64_t Gap = 80000;						// 1ms between frames, as a receiver sends them
+
+
+// Drives the receiver pin - idle high, 8N1, LSB first
+class CRSF_LINE
+{
+public:
+	CRSF_LINE( PASM_COG & cog ) : cog(cog), t(0.0), level(true) {}
+
+	void Send( const unsigned char * bytes, int count, double rate = 1.0 )
+	{
+		double bit = BitTime / rate;
+		for( int i = 0; i < count; i++ )
+		{
+			Set( false );						// Start bit
+			t += bit;
+			for( int b = 0; b < 8; b++ ) {
+				Set( ((bytes[i] >> b) & 1) != 0 );
+				t += bit;
+			}
+			Set( true );						// Stop bit
+			t += bit;
+		}
+	}
+
+	uint64_t Idle( uint64_t clocks ) {
+		t += (double)clocks;
+		return Now();
+	}
+
+	uint64_t Now(void) const { return (uint64_t)t; }
+
+private:
+	void Set( bool high ) {
+		if( high == level ) return;
+		level = high;
+		cog.SetIna( (uint64_t)t, high ? 0xFFFFFFFF : ~(1u << InputPin) );
+	}
+
+	PASM_COG & cog;
+	double t;
+	bool level;
+};
+
+
+// Captured frames.  Every channel centered, as a receiver sends with the sticks at rest:
+static const unsigned char CenterFrame[] = {
+	0xC8, 0x18, 0x16, 0xE0, 0x03, 0x1F, 0xF8, 0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F, 0x7C, 0xE0, 0x03,
+	0x1F, 0xF8, 0xC0, 0x07, 0x3E, 0xF0, 0x81, 0x0F, 0x7C, 0xAD,
+};
+
+// Sticks and switches moved
+static const unsigned char StickFrame[] = {
+	0xC8, 0x18, 0x16, 0xAC, 0x98, 0x38, 0xF8, 0xB8, 0xFB, 0x0B, 0x80, 0x83, 0x0F, 0x7C, 0xAC, 0x98,
+	0x38, 0x7D, 0xD0, 0x07, 0x4B, 0xBC, 0x02, 0x19, 0x7C, 0xCD,
+};
+static const int StickChannels[16] = {
+	172, 1811, 992, 1500, 191, 1792, 992, 992, 172, 1811, 500, 1000, 1200, 1400, 1600, 992,
+};
+
+// Link statistics - checked and skipped
+static const unsigned char LinkStatsFrame[] = {
+	0xC8, 0x0C, 0x14, 0xE7, 0xE5, 0x64, 0x00, 0x02, 0x00, 0x03, 0xF0, 0x64, 0x09, 0x69,
+};
+
+
+static uint32_t Hub[8192];				// 32K of hub RAM
+static const int HubBlock = 0x4000;
+
+
+// Sends a frame, then idles long enough for the driver to resync, and runs the cog through all of it
+static void SendFrame( PASM_COG & cog, CRSF_LINE & line, const unsigned char * bytes, int count, double rate = 1.0 )
+{
+	line.Send( bytes, count, rate );
+	cog.RunUntil( line.Idle( Gap ) );
+}
+
+
+void Test_CrsfReceiver(void)
+{
+	// The cog writes the stats 36 bytes past the channels, so the hub layout has to match
+	CHECK( offsetof(CRSF_HUB, Channels) == 8 );
+	CHECK( offsetof(CRSF_HUB, FrameTime) == 8 + 36 );
+	CHECK( offsetof(CRSF_HUB, FrameCount) == 8 + 48 );
+
+	memset( Hub, 0, sizeof(Hub) );
+	CRSF_HUB & hub = *(CRSF_HUB *)((uint8_t *)Hub + HubBlock);
+	hub.InputMask = 1 << InputPin;
+	hub.BaudDelay = 80000000 / 420000;			// CRSF::Start
+
+	PASM_COG cog( (uint8_t *)Hub, sizeof(Hub) );
+	if( !cog.Load( FIRMWARE_DIR "crsf_driver.spin" ) ) {
+		CHECK( false );
+		return;
+	}
+	int lostReg = cog.Label( "LostFrames" );
+	CHECK( lostReg > 0 );
+	#define LOST  ((int)cog.Reg( lostReg ))
+
+	CRSF_LINE line( cog );
+	cog.Start( HubBlock, 0 );
+
+	// Nothing counts until the line has been idle, even a good frame that started mid-stream
+	line.Idle( 1000 );
+	line.Send( StickFrame + 5, sizeof(StickFrame) - 5 );
+	line.Send( CenterFrame, sizeof(CenterFrame) );
+	cog.RunUntil( line.Idle( Gap ) );
+	CHECK( hub.FrameCount == 0 && LOST == 0 );
+
+	SendFrame( cog, line, CenterFrame, sizeof(CenterFrame) );
+	CHECK( hub.FrameCount == 1 );
+	for( int ch = 0; ch < 16; ch++ ) CHECK( hub.Channels[ch] - 1024 == 0 );		// SBUS::GetRC
+
+	// FrameTime is taken as the last data bit of the CRC arrives
+	uint64_t end = line.Now() - Gap;
+	CHECK( (uint32_t)hub.FrameTime <= (uint32_t)end );
+	CHECK( (uint32_t)hub.FrameTime > (uint32_t)(end - 3 * BitTime) );
+
+	SendFrame( cog, line, StickFrame, sizeof(StickFrame) );
+	CHECK( hub.FrameCount == 2 );
+	for( int ch = 0; ch < 16; ch++ ) CHECK( hub.Channels[ch] == StickChannels[ch] + 32 );
+	CHECK( (short)(hub.Channels[0] - 1024) == 172 - 992 );		// Full low is -820, full high +819
+	CHECK( (short)(hub.Channels[1] - 1024) == 1811 - 992 );
+
+	// Link statistics pass the CRC but aren't channels
+	SendFrame( cog, line, LinkStatsFrame, sizeof(LinkStatsFrame) );
+	SendFrame( cog, line, CenterFrame, sizeof(CenterFrame) );
+	CHECK( hub.FrameCount == 3 && LOST == 0 );
+	CHECK( hub.Channels[0] == 1024 );
+
+	// Checking and unpacking a frame takes a few byte times, so a frame right behind another, with no
+	// gap, is missed.  The decoder resyncs and counts it.
+	line.Send( StickFrame, sizeof(StickFrame) );
+	SendFrame( cog, line, CenterFrame, sizeof(CenterFrame) );
+	CHECK( hub.FrameCount == 4 && LOST == 1 );
+	CHECK( hub.Channels[0] == 172 + 32 );
+
+	// A corrupted byte fails the CRC, counts as lost, and leaves the channels alone
+	unsigned char bad[sizeof(StickFrame)];
+	memcpy( bad, CenterFrame, sizeof(bad) );
+	bad[10] ^= 0x04;
+	SendFrame( cog, line, bad, sizeof(bad) );
+	CHECK( hub.FrameCount == 4 && LOST == 2 );
+	CHECK( hub.Channels[0] == 172 + 32 );
+
+	// A bad CRC byte on its own is caught the same way
+	memcpy( bad, CenterFrame, sizeof(bad) );
+	bad[sizeof(bad) - 1] ^= 0x80;
+	SendFrame( cog, line, bad, sizeof(bad) );
+	CHECK( hub.FrameCount == 4 && LOST == 3 );
+
+	// Frames addressed elsewhere, and impossible lengths, are dropped to resync and counted too
+	static const unsigned char OtherAddress[] = { 0xEE, 0x04, 0x28, 0x00, 0xEA, 0x54 };
+	static const unsigned char TooLong[] = { 0xC8, 0x40, 0x16 };
+	static const unsigned char TooShort[] = { 0xC8, 0x01, 0x16 };
+	SendFrame( cog, line, OtherAddress, sizeof(OtherAddress) );
+	SendFrame( cog, line, TooLong, sizeof(TooLong) );
+	SendFrame( cog, line, TooShort, sizeof(TooShort) );
+	CHECK( LOST == 6 );
+
+	// The hub copy of the count catches up with the next good frame
+	SendFrame( cog, line, CenterFrame, sizeof(CenterFrame) );
+	CHECK( hub.FrameCount == 5 && hub.LostFrames == 6 );
+
+	// The CRC is CRC-8/DVB-S2, which has a published check value
+	static const unsigned char CheckFrame[] = { 0xC8, 10, '1', '2', '3', '4', '5', '6', '7', '8', '9', 0xBC };
+	SendFrame( cog, line, CheckFrame, sizeof(CheckFrame) );
+	CHECK( hub.FrameCount == 5 && LOST == 6 );
+
+	// Receivers' clocks are only so good - a frame 1.5% either side of 420k still decodes
+	SendFrame( cog, line, StickFrame, sizeof(StickFrame), 1.015 );
+	CHECK( hub.FrameCount == 6 && hub.Channels[0] == 172 + 32 );
+	SendFrame( cog, line, CenterFrame, sizeof(CenterFrame), 0.985 );
+	CHECK( hub.FrameCount == 7 && hub.Channels[0] == 1024 );
+	CHECK( LOST == 6 );
+
+	CHECK( !cog.Failed );
+	#undef LOST
+}
@@ -0,0 +1,109 @@
+#include <math.h>
+#include <stdlib.h>
+#include "tests.h"
+#include "../GroundStation-Qt/driftfit.h"
+
+// Checks that the drift the sensors cog computes from the uploaded DriftScale, DriftOffset and
+// DriftCurve prefs follows the curve the GroundStation fit to the calibration samples.
+
+
+// Divide in sensors_driver.spin - signs are handled separately, and the quotient is 16 bits,
+// so it truncates toward zero
+static int CogDivide( int dividend, int divisor )
+{
+	int sign = (dividend ^ divisor) < 0;
+	unsigned int result = abs(dividend);
+	unsigned int shifted = (unsigned int)abs(divisor) << 15;
+
+	for( int i = 0; i < 16; i++ )
+	{
+		unsigned int c = (result >= shifted);		// cmpsub divResult, divisor wc
+		if( c ) result -= shifted;
+		result = (result << 1) | c;					// rcl divResult, #1
+	}
+	result &= 0xffff;
+	return sign ? -(int)result : (int)result;
+}
+
+
+// ComputeDrift in sensors_driver.spin, for one axis.  A zero Scale or Curve leaves that term out.
+static int CogDrift( int temp, int offset, int scale, int curve )
+{
+	int square = (int)((unsigned int)(temp * temp) >> 8);
+
+	int drift = offset;
+	if( scale != 0 ) drift += CogDivide( temp, scale );
+	if( curve != 0 ) drift += CogDivide( square, curve );
+	return drift;
+}
+
+
+struct DRIFT_CASE {
+	double	intercept, slope, curve;	// The gyro's true drift, in readings per temperature unit
+	int		tmin, tmax;					// Temperature range of the capture, 16 units per degree C, 0 = 25C
+};
+
+static const DRIFT_CASE Cases[] = {
+	{  40.0,  1.0 / 8.0,   1.0 / (256.0 * 40.0),   -400, 500 },		// Cold morning to a hot day
+	{ -25.0, -1.0 / 5.0,  -1.0 / (256.0 * 25.0),   -200, 300 },
+	{  12.0,  1.0 / 12.0,  0.0,                      -50, 400 },		// A gyro that really is linear
+	{ -60.0, -1.0 / 3.0,   1.0 / (256.0 * 100.0),  -320,   0 },		// Cold side only
+};
+
+
+void Test_GyroDrift(void)
+{
+	// The divide is what the curve term depends on, so check it on its own first
+	CHECK( CogDivide( 1000, 7 ) == 142 );
+	CHECK( CogDivide( -1000, 7 ) == -142 );
+	CHECK( CogDivide( 1000, -7 ) == -142 );
+	CHECK( CogDivide( 65535 * 3, 3 ) == 65535 );
+
+	for( unsigned c = 0; c < sizeof(Cases) / sizeof(Cases[0]); c++ )
+	{
+		const DRIFT_CASE & dc = Cases[c];
+
+		// Capture the way the GroundStation does - integer readings, with a little noise that averages out
+		double sumT[5] = {0}, sumY[1][3] = {{0}};
+		srand( 1234 + c );
+		for( int t = dc.tmin; t <= dc.tmax; t++ )
+		{
+			for( int n = 0; n < 4; n++ )
+			{
+				double y = dc.intercept + dc.slope * t + dc.curve * t * t;
+				int reading = (int)floor( y + (rand() % 7 - 3) + 0.5 );
+				DriftFit_AddSample( sumT, sumY, 1, t, &reading );
+			}
+		}
+
+		double intercept, slope, curve;
+		DriftFit_Compute( sumT, sumY[0], 3, intercept, slope, curve );
+
+		CHECK_NEAR( intercept, dc.intercept, 0.5 );
+		CHECK_NEAR( slope, dc.slope, 0.002 );
+		CHECK_NEAR( curve * 1.0e6, dc.curve * 1.0e6, 5.0 );
+
+		int offset = (int)round( intercept );
+		int scale = DriftScaleFromFit( slope );
+		int curvePref = DriftCurveFromFit( curve );
+
+		// Each term truncates toward zero in the cog and the prefs are rounded to integers, so allow
+		// a little over a unit for each of the three terms.  The curve term accounts for as much as 25
+		// units in these cases, so leaving it out, or computing it from |t| instead of t*t, won't pass.
+		int worst = 0;
+		for( int t = dc.tmin; t <= dc.tmax; t++ )
+		{
+			double fit = intercept + slope * t + curve * t * t;
+			int err = abs( CogDrift( t, offset, scale, curvePref ) - (int)floor( fit + 0.5 ) );
+			if( err > worst ) worst = err;
+		}
+		CHECK( worst <= 3 );
+		if( worst > 3 ) printf( "  case %u: cog drift is up to %d off the fit\n", c, worst );
+	}
+
+	// A flat fit leaves the terms out rather than dividing by something huge
+	CHECK( DriftScaleFromFit( 0.0 ) == 0 );
+	CHECK( DriftCurveFromFit( 0.0 ) == 0 );
+	CHECK( DriftCurveFromFit( 1.0e-12 ) == 0 );
+	CHECK( CogDrift( 300, 7, 0, 0 ) == 7 );
+}
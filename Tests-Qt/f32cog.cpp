@@ -0,0 +1,55 @@
+#include <math.h>
+#include "../Firmware-C/f32.h"
+
+// Stands in for the F32 cog, in place of f32.cpp.  Streams run to completion as soon as they're
+// started, in host floats.  Each command is 4 bytes - the instruction, pre-shifted by
+// QuatIMU_AdjustStreamPointers, then the indices of a, b and the result in the variable block.
+
+int F32::Start(void) { return 1; }
+void F32::Stop(void) {}
+void F32::WaitStream(void) {}
+
+float F32::FFloat( int n ) { return (float)n; }
+float F32::FDiv( float a, float b ) { return a / b; }
+
+
+void F32::RunStream( unsigned char * a, float * vars )
+{
+	int * ints = (int *)vars;
+
+	for( ; a[0] != 0; a += 4 )
+	{
+		float fa = vars[a[1]], fb = vars[a[2]];
+		int ia = ints[a[1]], ib = ints[a[2]];
+		float & r = vars[a[3]];
+		int & ir = ints[a[3]];
+
+		switch( a[0] >> 2 )
+		{
+		case F32_opAdd:		r = fa + fb;	break;
+		case F32_opSub:		r = fa - fb;	break;
+		case F32_opMul:		r = fa * fb;	break;
+		case F32_opDiv:		r = fa / fb;	break;
+		case F32_opFloat:	r = (float)ia;	break;
+		case F32_opTruncRound:	ir = (ib == 0) ? (int)fa : (int)floorf( fa + 0.5f );	break;
+		case F32_opSqrt:	r = sqrtf( fa );	break;
+		case F32_opCmp:		ir = (fa > fb) ? 1 : (fa < fb) ? -1 : 0;	break;
+		case F32_opSin:		r = sinf( fa );	break;
+		case F32_opCos:		r = cosf( fa );	break;
+		case F32_opTan:		r = tanf( fa );	break;
+		case F32_opLog2:	r = log2f( fa );	break;
+		case F32_opExp2:	r = exp2f( fa );	break;
+		case F32_opPow:		r = powf( fa, fb );	break;
+		case F32_opASinCos:	r = (ib == 0) ? acosf( fa ) : asinf( fa );	break;
+		case F32_opATan2:	r = atan2f( fa, fb );	break;
+		case F32_opShift:	r = ldexpf( fa, ib );	break;
+		case F32_opNeg:		r = -fa;	break;
+		case F32_opSinCos:	vars[a[2]] = sinf( fa );  r = cosf( fa );	break;		// b = Sin(a), result = Cos(a)
+		case F32_opFAbs:	r = fabsf( fa );	break;
+		case F32_opFMin:	r = (fa < fb) ? fa : fb;	break;
+		case F32_opFrac:	r = fa - truncf( fa );	break;
+		case F32_opCNeg:	r = (ib < 0) ? -fa : fa;	break;
+		case F32_opMov:		ir = ia;	break;
+		}
+	}
+}
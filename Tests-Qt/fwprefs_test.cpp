@@ -0,0 +1,97 @@
+#include <stddef.h>
+#include <string.h>
+#include <fdserial.h>
+#include "tests.h"
+
+// Firmware prefs storage.  The GroundStation has its own PREFS, so the firmware's is built into
+// the test in a namespace of its own, over an EEPROM that's just a block of memory.
+
+namespace FW {
+#include "../Firmware-C/prefs.cpp"
+
+static char Eeprom[65536];
+
+void EEPROM::ToRam( void * startAddr, void * endAddr, int eeStart ) {
+	memcpy( startAddr, Eeprom + eeStart, (char *)endAddr - (char *)startAddr + 1 );
+}
+
+void EEPROM::FromRam( void * startAddr, void * endAddr, int eeStart ) {
+	memcpy( Eeprom + eeStart, startAddr, (char *)endAddr - (char *)startAddr + 1 );
+}
+}
+
+using namespace FW;
+
+
+// Saves the current prefs the way firmware with an older, shorter PREFS would have, and clears the RAM copy
+static void SaveOld( int size )
+{
+	memset( Eeprom + PREFS_EEPROM_ADDR, 0xFF, sizeof(PREFS) );		// Whatever was there before
+	memcpy( Eeprom + PREFS_EEPROM_ADDR, &Prefs, size - 4 );
+	int check = ChecksumLongs( &Prefs, size/4 - 1 );
+	memcpy( Eeprom + PREFS_EEPROM_ADDR + size - 4, &check, 4 );
+	memset( &Prefs, 0, sizeof(Prefs) );
+}
+
+static void SetCalibration(void)
+{
+	Prefs_SetDefaults();
+	Prefs.DriftScale[0] = 1234;
+	Prefs.AccelOffset[2] = -56;
+	Prefs.MagScaleOfs[3] = 987;
+	Prefs.ThroCenter = 11900;
+	Prefs.Aux3Center = -321;
+	Prefs.GyroNotch[0] = 3500;
+	Prefs.GyroNotch[3] = 6000;
+}
+
+
+void Test_PrefsUpgrade(void)
+{
+	// Current prefs load as they were saved
+	SetCalibration();
+	Prefs.DriftCurve[1] = 77;
+	Prefs_Save();
+	memset( &Prefs, 0, sizeof(Prefs) );
+	CHECK( Prefs_Load() == 1 );
+	CHECK( Prefs.DriftScale[0] == 1234 );
+	CHECK( Prefs.DriftCurve[1] == 77 );
+
+	// The first release's PREFS was 176 bytes, and each layout since is longer
+	CHECK( OldPrefsSize[0] == 176 );
+	CHECK( OldPrefsSize[1] > OldPrefsSize[0] && sizeof(PREFS) > OldPrefsSize[1] );
+
+	// Prefs from each older layout keep everything they had, with the newer fields off
+	for( unsigned i = 0; i < sizeof(OldPrefsSize) / sizeof(OldPrefsSize[0]); i++ )
+	{
+		SetCalibration();
+		SaveOld( OldPrefsSize[i] );
+
+		CHECK( Prefs_Load() == 1 );
+		CHECK( Prefs.DriftScale[0] == 1234 );
+		CHECK( Prefs.AccelOffset[2] == -56 );
+		CHECK( Prefs.MagScaleOfs[3] == 987 );
+		CHECK( Prefs.ThroCenter == 11900 );
+		CHECK( Prefs.Aux3Center == -321 );
+		CHECK( Prefs.DriftCurve[0] == 0 && Prefs.DriftCurve[1] == 0 && Prefs.DriftCurve[2] == 0 );
+		if( OldPrefsSize[i] <= offsetof(PREFS, GyroLowPass) + 4 ) {
+			CHECK( Prefs.GyroNotch[0] == 0 && Prefs.GyroNotch[3] == 0 );
+		}
+		else {
+			CHECK( Prefs.GyroNotch[0] == 3500 && Prefs.GyroNotch[3] == 6000 );
+		}
+
+		// ...and were saved in the current layout
+		memset( &Prefs, 0, sizeof(Prefs) );
+		CHECK( Prefs_Load() == 1 );
+		CHECK( Prefs.Checksum == Prefs_CalculateChecksum( Prefs ) );
+		CHECK( Prefs.DriftScale[0] == 1234 );
+	}
+
+	// Anything else still resets to the defaults
+	memset( Eeprom + PREFS_EEPROM_ADDR, 0xA5, sizeof(PREFS) );
+	CHECK( Prefs_Load() == 0 );
+	CHECK( Prefs.DriftScale[0] == 0 );
+	CHECK( Prefs.ThroScale == 1024 );
+	CHECK( Prefs_Load() == 1 );
+}
@@ -0,0 +1,46 @@
+#include <stdio.h>
+#include <string.h>
+#include "tests.h"
+
+int TestFailures = 0;
+
+struct TEST {
+	const char * name;
+	void (*run)(void);
+};
+
+static const TEST Tests[] = {
+	{ "compact telemetry",	Test_CompactTelemetry },
+	{ "crsf receiver",		Test_CrsfReceiver },
+	{ "gyro bias",			Test_GyroBias },
+	{ "gyro drift",			Test_GyroDrift },
+	{ "gyro filters",		Test_GyroFilters },
+	{ "initial orientation",	Test_InitOrientation },
+	{ "noise tracker",		Test_NoiseTrack },
+	{ "prefs upgrade",		Test_PrefsUpgrade },
+	{ "serial rings",		Test_SerialRings },
+};
+
+
+int main( int argc, char * argv[] )
+{
+	// Any arguments pick which tests to run by name, otherwise they all run
+	int failedTests = 0;
+	for( unsigned i = 0; i < sizeof(Tests) / sizeof(Tests[0]); i++ )
+	{
+		bool selected = (argc < 2);
+		for( int a = 1; a < argc; a++ ) {
+			if( strcmp( argv[a], Tests[i].name ) == 0 ) selected = true;
+		}
+		if( !selected ) continue;
+
+		int before = TestFailures;
+		Tests[i].run();
+
+		bool passed = (TestFailures == before);
+		printf( "%-24s %s\n", Tests[i].name, passed ? "ok" : "FAILED" );
+		if( !passed ) failedTests++;
+	}
+
+	return failedTests ? 1 : 0;
+}
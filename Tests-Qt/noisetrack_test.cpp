@@ -0,0 +1,82 @@
+#include <math.h>
+#include "tests.h"
+#include "../GroundStation-Qt/prefs.h"
+
+// Motor noise tracking.  The tracker's thread never returns, so this builds noisetrack.cpp in with
+// the test and runs the same steps the thread does on each block - start the bins around a hint, feed
+// a block of gyro changes through them, and measure.
+
+#include "../Firmware-C/noisetrack.cpp"
+
+static volatile int GyroHistory[18];
+
+volatile int * Sensors_GyroHistory(void) { return GyroHistory; }
+void Sensors_SetGyroNotchCenter( int ) {}
+
+
+static const double SampleRate = 952.0;
+
+
+// Returns what the tracker measures for a tone at hz, with bins spread around hint
+static int MeasureTone( int hint, double hz, double amplitude )
+{
+	StartBlock( hint );
+	for( int n = 0; n < BlockSize; n++ )
+	{
+		double w = 2.0 * M_PI * hz * n / SampleRate;
+		int dx = (int)floor( amplitude * sin( w ) + 0.5 );
+		int dy = (int)floor( amplitude * 0.5 * cos( w ) + 0.5 );
+		AddSample( dx, dy );
+	}
+	return Measure();
+}
+
+
+void Test_NoiseTrack(void)
+{
+	// A tone anywhere across the bank is found to within a few hz
+	static const double tones[] = { 148.0, 163.5, 170.0, 173.0, 181.0, 192.0 };
+	for( unsigned i = 0; i < sizeof(tones) / sizeof(tones[0]); i++ ) {
+		CHECK_NEAR( MeasureTone( 170, tones[i], 300.0 ), tones[i], 3.0 );
+	}
+
+	// ...at the ends of the range
+	CHECK_NEAR( MeasureTone( 80, 75.0, 300.0 ), 75.0, 3.0 );
+	CHECK_NEAR( MeasureTone( 420, 410.0, 300.0 ), 410.0, 3.0 );
+
+	// ...and when it's large enough to be clamped
+	CHECK_NEAR( MeasureTone( 250, 247.0, 3000.0 ), 247.0, 4.0 );
+
+	// Silence, or noise too weak to chase, measures nothing
+	CHECK( MeasureTone( 170, 173.0, 0.0 ) == 0 );
+	CHECK( MeasureTone( 170, 173.0, 2.0 ) == 0 );
+
+	// A tone outside the bank isn't mistaken for one inside it
+	int far = MeasureTone( 170, 300.0, 300.0 );
+	CHECK( far == 0 || far <= BinHz[0] || far >= BinHz[Bins-1] );
+
+
+	// The notch center read back from the prefs matches what GroundStation set, and moving it
+	// keeps the -a1 GroundStation would have computed for the same width
+	static const int notches[][2] = { { 120, 40 }, { 180, 60 }, { 250, 60 }, { 400, 80 } };
+	for( unsigned i = 0; i < sizeof(notches) / sizeof(notches[0]); i++ )
+	{
+		PREFS prefs;
+		Prefs_SetGyroNotch( prefs, notches[i][0], notches[i][1] );
+		NoiseTrack_SetPrefs( prefs.GyroNotch, 100 );
+		CHECK( NotchOn );
+		CHECK_NEAR( NotchCenter(), notches[i][0], 1.0 );
+
+		for( int hz = 60; hz <= 440; hz += 95 )
+		{
+			PREFS moved;
+			Prefs_SetGyroNotch( moved, hz, notches[i][1] );
+			CHECK_NEAR( NotchA1For( hz ), moved.GyroNotch[3], 3.0 );
+		}
+	}
+
+	short off[5] = { 0, 0, 0, 0, 0 };
+	NoiseTrack_SetPrefs( off, 0 );
+	CHECK( !NotchOn );
+	CHECK( ThrottleRange == 1 );
+}
@@ -0,0 +1,652 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include "pasmcog.h"
+
+// Registers that only exist as a source.  As a destination they read and write the shadow RAM at the same
+// address instead, so "test ina, mask" tests whatever was last written there - zero, as a rule.
+enum { Reg_Par = 0x1F0, Reg_Cnt = 0x1F1, Reg_Ina = 0x1F2, Reg_Inb = 0x1F3 };
+
+enum { Kind_Normal, Kind_Jmp, Kind_Call, Kind_Ret, Kind_Nop };
+
+struct OPCODE {
+	const char * name;
+	int code;
+	bool r;				// Writes the result unless told otherwise
+	int kind;
+};
+
+static const OPCODE Opcodes[] = {
+	{ "wrbyte", 0, false, Kind_Normal },	{ "rdbyte", 0, true, Kind_Normal },
+	{ "wrword", 1, false, Kind_Normal },	{ "rdword", 1, true, Kind_Normal },
+	{ "wrlong", 2, false, Kind_Normal },	{ "rdlong", 2, true, Kind_Normal },
+	{ "ror", 8, true, Kind_Normal },		{ "rol", 9, true, Kind_Normal },
+	{ "shr", 10, true, Kind_Normal },		{ "shl", 11, true, Kind_Normal },
+	{ "rcr", 12, true, Kind_Normal },		{ "rcl", 13, true, Kind_Normal },
+	{ "sar", 14, true, Kind_Normal },		{ "rev", 15, true, Kind_Normal },
+	{ "mins", 16, true, Kind_Normal },		{ "maxs", 17, true, Kind_Normal },
+	{ "min", 18, true, Kind_Normal },		{ "max", 19, true, Kind_Normal },
+	{ "movs", 20, true, Kind_Normal },		{ "movd", 21, true, Kind_Normal },
+	{ "movi", 22, true, Kind_Normal },		{ "jmpret", 23, true, Kind_Normal },
+	{ "jmp", 23, false, Kind_Jmp },			{ "call", 23, true, Kind_Call },
+	{ "ret", 23, false, Kind_Ret },
+	{ "and", 24, true, Kind_Normal },		{ "test", 24, false, Kind_Normal },
+	{ "andn", 25, true, Kind_Normal },		{ "testn", 25, false, Kind_Normal },
+	{ "or", 26, true, Kind_Normal },		{ "xor", 27, true, Kind_Normal },
+	{ "muxc", 28, true, Kind_Normal },		{ "muxnc", 29, true, Kind_Normal },
+	{ "muxz", 30, true, Kind_Normal },		{ "muxnz", 31, true, Kind_Normal },
+	{ "add", 32, true, Kind_Normal },		{ "sub", 33, true, Kind_Normal },
+	{ "cmp", 33, false, Kind_Normal },
+	{ "mov", 40, true, Kind_Normal },		{ "neg", 41, true, Kind_Normal },
+	{ "abs", 42, true, Kind_Normal },
+	{ "cmps", 48, false, Kind_Normal },
+	{ "adds", 52, true, Kind_Normal },		{ "subs", 53, true, Kind_Normal },
+	{ "djnz", 57, true, Kind_Normal },		{ "tjnz", 58, false, Kind_Normal },
+	{ "tjz", 59, false, Kind_Normal },
+	{ "waitpeq", 60, false, Kind_Normal },	{ "waitpne", 61, false, Kind_Normal },
+	{ "waitcnt", 62, true, Kind_Normal },
+	{ "nop", 0, false, Kind_Nop },
+};
+
+// Condition bits, one per combination of C and Z: bit 0 = !C & !Z, bit 1 = !C & Z, bit 2 = C & !Z, bit 3 = C & Z
+struct CONDITION {
+	const char * name;
+	int bits;
+};
+
+static const CONDITION Conditions[] = {
+	{ "if_always", 15 },	{ "if_never", 0 },
+	{ "if_e", 10 },			{ "if_z", 10 },			{ "if_ne", 5 },			{ "if_nz", 5 },
+	{ "if_c", 12 },			{ "if_b", 12 },			{ "if_nc", 3 },			{ "if_ae", 3 },
+	{ "if_a", 1 },			{ "if_nc_and_nz", 1 },	{ "if_nz_and_nc", 1 },
+	{ "if_be", 14 },		{ "if_c_or_z", 14 },	{ "if_z_or_c", 14 },
+	{ "if_nc_and_z", 2 },	{ "if_z_and_nc", 2 },	{ "if_c_and_nz", 4 },	{ "if_nz_and_c", 4 },
+	{ "if_c_and_z", 8 },	{ "if_z_and_c", 8 },	{ "if_nc_or_nz", 7 },	{ "if_nz_or_nc", 7 },
+	{ "if_nc_or_z", 11 },	{ "if_z_or_nc", 11 },	{ "if_c_or_nz", 13 },	{ "if_nz_or_c", 13 },
+	{ "if_c_eq_z", 9 },		{ "if_z_eq_c", 9 },		{ "if_c_ne_z", 6 },		{ "if_z_ne_c", 6 },
+};
+
+static const char * Registers[] = {
+	"par", "cnt", "ina", "inb", "outa", "outb", "dira", "dirb",
+	"ctra", "ctrb", "frqa", "frqb", "phsa", "phsb", "vcfg", "vscl",
+};
+
+
+static std::string Lower( std::string s ) {
+	for( size_t i = 0; i < s.size(); i++ ) s[i] = (char)tolower( (unsigned char)s[i] );
+	return s;
+}
+
+static std::string Trim( const std::string & s ) {
+	size_t a = s.find_first_not_of( " \t\r\n" );
+	if( a == std::string::npos ) return "";
+	size_t b = s.find_last_not_of( " \t\r\n" );
+	return s.substr( a, b - a + 1 );
+}
+
+static const OPCODE * FindOpcode( const std::string & name ) {
+	for( size_t i = 0; i < sizeof(Opcodes) / sizeof(Opcodes[0]); i++ ) {
+		if( name == Opcodes[i].name ) return &Opcodes[i];
+	}
+	return 0;
+}
+
+static int FindCondition( const std::string & name ) {
+	for( size_t i = 0; i < sizeof(Conditions) / sizeof(Conditions[0]); i++ ) {
+		if( name == Conditions[i].name ) return Conditions[i].bits;
+	}
+	return -1;
+}
+
+static bool IsDirective( const std::string & name ) {
+	return name == "org" || name == "long" || name == "res" || name == "fit";
+}
+
+static bool IsEffect( const std::string & name ) {
+	return name == "wz" || name == "wc" || name == "wr" || name == "nr";
+}
+
+static bool Parity( uint32_t v ) {
+	v ^= v >> 16;  v ^= v >> 8;  v ^= v >> 4;  v ^= v >> 2;  v ^= v >> 1;
+	return (v & 1) != 0;
+}
+
+
+PASM_COG::PASM_COG( uint8_t * hub, int hubSize ) : Now(0), Failed(false), hub(hub), hubSize(hubSize), pc(0), c(false), z(false), par(0)
+{
+	memset( image, 0, sizeof(image) );
+	memset( cog, 0, sizeof(cog) );
+}
+
+
+bool PASM_COG::Load( const char * spinFile )
+{
+	FILE * f = fopen( spinFile, "rb" );
+	if( !f ) {
+		printf( "  can't open %s\n", spinFile );
+		return false;
+	}
+	std::string text;
+	char buf[4096];
+	size_t n;
+	while( (n = fread( buf, 1, sizeof(buf), f )) > 0 ) text.append( buf, n );
+	fclose( f );
+
+	return Parse( text );
+}
+
+
+int PASM_COG::Label( const char * name ) const
+{
+	std::map<std::string, uint32_t>::const_iterator it = symbols.find( Lower( name ) );
+	return it == symbols.end() ? -1 : (int)it->second;
+}
+
+
+bool PASM_COG::Parse( const std::string & source )
+{
+	// Block comments, {..} and {{..}}, can span lines - blank them out, keeping the line breaks
+	std::string text = source;
+	int depth = 0;
+	for( size_t i = 0; i < text.size(); i++ ) {
+		char ch = text[i];
+		if( ch == '{' ) depth++;
+		if( depth > 0 && ch != '\n' ) text[i] = ' ';
+		if( ch == '}' && depth > 0 ) depth--;
+	}
+
+	std::string section, scope;
+	int number = 0, addr = 0;
+	size_t pos = 0;
+	while( pos < text.size() )
+	{
+		size_t end = text.find( '\n', pos );
+		if( end == std::string::npos ) end = text.size();
+		std::string line = text.substr( pos, end - pos );
+		pos = end + 1;
+		number++;
+
+		size_t quote = line.find( '\'' );
+		if( quote != std::string::npos ) line.erase( quote );
+		if( Trim( line ).empty() ) continue;
+
+		bool column0 = !isspace( (unsigned char)line[0] );
+		std::string rest = Trim( line );
+		std::string word = Lower( rest.substr( 0, rest.find_first_of( " \t" ) ) );
+
+		if( column0 && (word == "con" || word == "var" || word == "obj" || word == "pub" || word == "pri" || word == "dat") ) {
+			section = word;
+			rest = Trim( rest.substr( word.size() ) );
+			if( rest.empty() || section != "con" ) continue;
+		}
+
+		if( section == "con" )
+		{
+			// One "Name = value" per line is all the drivers here use
+			size_t eq = rest.find( '=' );
+			uint32_t value;
+			if( eq == std::string::npos || !Eval( rest.substr( eq + 1 ), "", value ) ) {
+				printf( "  line %d: can't read constant\n", number );
+				return false;
+			}
+			symbols[Lower( Trim( rest.substr( 0, eq ) ) )] = value;
+			continue;
+		}
+		if( section != "dat" ) continue;
+
+		LINE l;
+		l.number = number;
+		l.wz = l.wc = l.wr = l.nr = false;
+
+		// Label, then an optional condition, then the instruction or directive
+		if( word[0] == ':' || (column0 && !IsDirective( word ) && !FindOpcode( word ) && FindCondition( word ) < 0) ) {
+			l.label = word;
+			rest = Trim( rest.substr( word.size() ) );
+			word = Lower( rest.substr( 0, rest.find_first_of( " \t" ) ) );
+		}
+		if( FindCondition( word ) >= 0 ) {
+			l.cond = word;
+			rest = Trim( rest.substr( word.size() ) );
+			word = Lower( rest.substr( 0, rest.find_first_of( " \t" ) ) );
+		}
+		l.op = word;
+		rest = Trim( rest.substr( word.size() ) );
+
+		// Operands, then effects - the effects can be separated by spaces or commas
+		std::vector<std::string> parts;
+		size_t start = 0;
+		for( size_t i = 0; i <= rest.size(); i++ ) {
+			if( i == rest.size() || rest[i] == ',' ) {
+				parts.push_back( Trim( rest.substr( start, i - start ) ) );
+				start = i + 1;
+			}
+		}
+		while( !parts.empty() )
+		{
+			std::string & last = parts.back();
+			size_t space = last.find_last_of( " \t" );
+			std::string tail = Lower( space == std::string::npos ? last : last.substr( space + 1 ) );
+			if( !IsEffect( tail ) ) break;
+
+			if( tail == "wz" ) l.wz = true;
+			if( tail == "wc" ) l.wc = true;
+			if( tail == "wr" ) l.wr = true;
+			if( tail == "nr" ) l.nr = true;
+			last = (space == std::string::npos) ? "" : Trim( last.substr( 0, space ) );
+			if( last.empty() ) parts.pop_back();
+		}
+		if( parts.size() > 0 ) l.dest = parts[0];
+		if( parts.size() > 1 ) l.src = parts[1];
+
+		if( !l.label.empty() ) {
+			std::string name = (l.label[0] == ':') ? scope + l.label : l.label;
+			if( l.label[0] != ':' ) scope = l.label;
+			symbols[name] = addr;
+		}
+
+		l.addr = addr;
+		if( l.op == "org" ) {
+			uint32_t value = 0;
+			if( !l.dest.empty() && !Eval( l.dest, scope, value ) ) return false;
+			addr = (int)value;
+			l.addr = addr;
+		}
+		else if( l.op == "res" ) {
+			uint32_t count = 1;
+			if( !l.dest.empty() && !Eval( l.dest, scope, count ) ) return false;
+			addr += (int)count;
+		}
+		else if( l.op == "long" ) {
+			addr += (int)(parts.empty() ? 1 : parts.size());
+		}
+		else if( l.op == "fit" ) {
+			uint32_t limit = 496;
+			if( !l.dest.empty() && !Eval( l.dest, scope, limit ) ) return false;
+			if( addr > (int)limit ) {
+				printf( "  line %d: %d longs don't fit in %d\n", number, addr, (int)limit );
+				return false;
+			}
+		}
+		else if( l.op.empty() ) {
+			// A label on its own
+		}
+		else if( FindOpcode( l.op ) ) {
+			addr++;
+		}
+		else {
+			printf( "  line %d: can't assemble \"%s\"\n", number, l.op.c_str() );
+			return false;
+		}
+
+		if( addr > 496 ) {
+			printf( "  line %d: past the end of the cog\n", number );
+			return false;
+		}
+		l.src = (l.op == "long") ? rest : l.src;
+		l.label = scope;		// Kept as the scope for local labels in the second pass
+		lines.push_back( l );
+	}
+
+	// Second pass, now that every label has an address
+	memset( image, 0, sizeof(image) );
+	for( size_t i = 0; i < lines.size(); i++ )
+	{
+		LINE & l = lines[i];
+		if( l.op == "long" ) {
+			int a = l.addr;
+			size_t start = 0;
+			for( size_t j = 0; j <= l.src.size(); j++ ) {
+				if( j == l.src.size() || l.src[j] == ',' ) {
+					uint32_t value;
+					if( !Eval( l.src.substr( start, j - start ), l.label, value ) ) {
+						printf( "  line %d: bad value\n", l.number );
+						return false;
+					}
+					image[a++] = value;
+					start = j + 1;
+				}
+			}
+		}
+		else if( FindOpcode( l.op ) ) {
+			if( !Assemble( l, image[l.addr] ) ) {
+				printf( "  line %d: can't assemble \"%s %s, %s\"\n", l.number, l.op.c_str(), l.dest.c_str(), l.src.c_str() );
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+
+bool PASM_COG::Assemble( LINE & l, uint32_t & code )
+{
+	const OPCODE * op = FindOpcode( l.op );
+	int cond = l.cond.empty() ? 15 : FindCondition( l.cond );
+	uint32_t d = 0, s = 0;
+	bool r = op->r, imm = false;
+
+	switch( op->kind )
+	{
+	case Kind_Nop:
+		code = 0;
+		return true;
+
+	case Kind_Ret:
+		imm = true;
+		break;
+
+	case Kind_Jmp:
+	case Kind_Call:
+	{
+		std::string target = l.dest;
+		imm = (target[0] == '#');
+		if( imm ) target = Trim( target.substr( 1 ) );
+		if( !Eval( target, l.label, s ) ) return false;
+
+		if( op->kind == Kind_Call ) {
+			if( !imm ) return false;
+			std::map<std::string, uint32_t>::const_iterator ret = symbols.find( Lower( target ) + "_ret" );
+			if( ret == symbols.end() ) return false;
+			d = ret->second;
+		}
+		break;
+	}
+
+	default:
+		if( l.dest.empty() || l.src.empty() || !Eval( l.dest, l.label, d ) ) return false;
+		std::string src = l.src;
+		imm = (src[0] == '#');
+		if( imm ) src = Trim( src.substr( 1 ) );
+		if( !Eval( src, l.label, s ) ) return false;
+		break;
+	}
+
+	if( d > 511 || s > 511 ) return false;
+	if( l.wr ) r = true;
+	if( l.nr ) r = false;
+
+	code = (uint32_t)op->code << 26 | (uint32_t)l.wz << 25 | (uint32_t)l.wc << 24 | (uint32_t)r << 23 |
+		   (uint32_t)imm << 22 | (uint32_t)cond << 18 | d << 9 | s;
+	return true;
+}
+
+
+// Numbers ($hex, %binary, decimal - all with _ allowed), symbols, and + - * / << >> & | ^ with the usual precedence
+bool PASM_COG::Eval( const std::string & expr, const std::string & scope, uint32_t & value )
+{
+	std::vector<std::string> tokens;
+	for( size_t i = 0; i < expr.size(); )
+	{
+		char ch = expr[i];
+		if( isspace( (unsigned char)ch ) ) { i++;  continue; }
+		if( (ch == '<' || ch == '>') && i + 1 < expr.size() && expr[i+1] == ch ) {
+			tokens.push_back( expr.substr( i, 2 ) );
+			i += 2;
+			continue;
+		}
+		if( strchr( "+-*/&|^()", ch ) ) {
+			tokens.push_back( std::string( 1, ch ) );
+			i++;
+			continue;
+		}
+		size_t j = i + 1;
+		while( j < expr.size() && (isalnum( (unsigned char)expr[j] ) || expr[j] == '_') ) j++;
+		tokens.push_back( expr.substr( i, j - i ) );
+		i = j;
+	}
+
+	size_t at = 0;
+	bool ok = true;
+
+	struct PARSER {
+		PASM_COG * cog;
+		const std::string & scope;
+		std::vector<std::string> & tokens;
+		size_t & at;
+		bool & ok;
+
+		uint32_t Atom(void)
+		{
+			if( at >= tokens.size() ) { ok = false;  return 0; }
+			std::string t = tokens[at++];
+			if( t == "-" ) return -Atom();
+			if( t == "(" ) {
+				uint32_t v = Level( 0 );
+				if( at >= tokens.size() || tokens[at++] != ")" ) ok = false;
+				return v;
+			}
+
+			std::string digits;
+			int base = 10;
+			if( t[0] == '$' ) { base = 16;  t = t.substr( 1 ); }
+			else if( t[0] == '%' ) { base = 2;  t = t.substr( 1 ); }
+			else if( !isdigit( (unsigned char)t[0] ) ) {
+				std::string name = Lower( t[0] == ':' ? scope + t : t );
+				for( int r = 0; r < 16; r++ ) {
+					if( name == Registers[r] ) return 0x1F0 + r;
+				}
+				std::map<std::string, uint32_t>::const_iterator it = cog->symbols.find( name );
+				if( it == cog->symbols.end() ) { ok = false;  return 0; }
+				return it->second;
+			}
+			for( size_t i = 0; i < t.size(); i++ ) if( t[i] != '_' ) digits += t[i];
+			char * end;
+			uint32_t v = (uint32_t)strtoul( digits.c_str(), &end, base );
+			if( digits.empty() || *end ) ok = false;
+			return v;
+		}
+
+		uint32_t Level( int level )
+		{
+			static const char * ops[4][3] = { { "|", "^", 0 }, { "&", 0, 0 }, { "<<", ">>", 0 }, { "+", "-", 0 } };
+			if( level == 4 ) {
+				uint32_t v = Atom();
+				while( at < tokens.size() && (tokens[at] == "*" || tokens[at] == "/") ) {
+					std::string op = tokens[at++];
+					uint32_t rhs = Atom();
+					if( op == "*" ) v *= rhs;
+					else if( rhs ) v /= rhs;
+					else ok = false;
+				}
+				return v;
+			}
+
+			uint32_t v = Level( level + 1 );
+			while( at < tokens.size() ) {
+				std::string op = tokens[at];
+				bool found = false;
+				for( int i = 0; i < 3 && ops[level][i]; i++ ) found |= (op == ops[level][i]);
+				if( !found ) break;
+				at++;
+				uint32_t rhs = Level( level + 1 );
+				if( op == "|" ) v |= rhs;
+				else if( op == "^" ) v ^= rhs;
+				else if( op == "&" ) v &= rhs;
+				else if( op == "<<" ) v <<= (rhs & 31);
+				else if( op == ">>" ) v >>= (rhs & 31);
+				else if( op == "+" ) v += rhs;
+				else v -= rhs;
+			}
+			return v;
+		}
+	} parser = { this, scope, tokens, at, ok };
+
+	value = parser.Level( 0 );
+	return ok && at == tokens.size();
+}
+
+
+void PASM_COG::Start( uint32_t parValue, uint64_t time )
+{
+	memcpy( cog, image, sizeof(image) );
+	par = parValue & 0xFFFC;
+	pc = 0;
+	c = z = false;
+	Now = time;
+	Failed = false;
+}
+
+
+void PASM_COG::SetIna( uint64_t time, uint32_t pins )
+{
+	ina.push_back( std::make_pair( time, pins ) );
+}
+
+
+uint32_t PASM_COG::Ina( uint64_t time ) const
+{
+	// The last change at or before time - floating inputs before the first, as good as pulled up
+	std::vector<std::pair<uint64_t, uint32_t> >::const_iterator it =
+		std::upper_bound( ina.begin(), ina.end(), std::make_pair( time, 0xFFFFFFFFu ) );
+	return (it == ina.begin()) ? 0xFFFFFFFF : (it - 1)->second;
+}
+
+
+// Moves Now to when (INA & mask) == value (or !=), or to 'until' if that's first.  True if it got there.
+bool PASM_COG::WaitPins( uint32_t mask, uint32_t value, bool equal, uint64_t until )
+{
+	if( ((Ina( Now ) & mask) == value) == equal ) return true;
+
+	size_t i = std::upper_bound( ina.begin(), ina.end(), std::make_pair( Now, 0xFFFFFFFFu ) ) - ina.begin();
+	for( ; i < ina.size(); i++ ) {
+		if( ina[i].first >= until ) break;
+		if( ((ina[i].second & mask) == value) == equal ) {
+			Now = ina[i].first;
+			return true;
+		}
+	}
+	Now = until;
+	return false;
+}
+
+
+// Hub access comes around every 16 clocks - this cog's turn is when the counter is a multiple of 16
+uint64_t PASM_COG::HubTime(void) const
+{
+	return 8 + ((16 - (Now & 15)) & 15);
+}
+
+
+void PASM_COG::RunUntil( uint64_t time )
+{
+	while( Now < time && !Failed ) Step( time );
+}
+
+
+void PASM_COG::Step( uint64_t until )
+{
+	uint32_t ins = cog[pc];
+	int op = ins >> 26;
+	bool wz = (ins >> 25) & 1, wc = (ins >> 24) & 1, wr = (ins >> 23) & 1, imm = (ins >> 22) & 1;
+	int cond = (ins >> 18) & 15;
+	int da = (ins >> 9) & 511, sa = ins & 511;
+
+	if( ((cond >> ((c ? 2 : 0) + (z ? 1 : 0))) & 1) == 0 ) {
+		Now += 4;
+		pc = (pc + 1) & 511;
+		return;
+	}
+
+	// Source reads the hardware for PAR, CNT and INA, destination reads the shadow RAM
+	uint32_t s;
+	if( imm ) s = sa;
+	else if( sa == Reg_Par ) s = par;
+	else if( sa == Reg_Cnt ) s = (uint32_t)(Now + 2);
+	else if( sa == Reg_Ina ) s = Ina( Now + 2 );
+	else s = cog[sa];
+	uint32_t d = cog[da];
+
+	uint32_t r = d;
+	bool nc = c, nz;
+	int next = (pc + 1) & 511;
+	uint64_t clocks = 4;
+
+	switch( op )
+	{
+	case 0: case 1: case 2:			// rd/wr byte, word, long
+	{
+		int size = 1 << op;
+		uint32_t addr = (s & 0xFFFF) & ~(uint32_t)(size - 1);
+		if( (int)(addr + size) > hubSize ) { Failed = true;  return; }
+		clocks = HubTime();
+		if( wr ) {
+			r = 0;
+			memcpy( &r, hub + addr, size );
+		}
+		else {
+			memcpy( hub + addr, &d, size );
+		}
+		break;
+	}
+	case 8:  r = (d >> (s & 31)) | (d << ((32 - (s & 31)) & 31));  nc = d & 1;  break;			// ror
+	case 9:  r = (d << (s & 31)) | (d >> ((32 - (s & 31)) & 31));  nc = d >> 31;  break;		// rol
+	case 10: r = d >> (s & 31);  nc = d & 1;  break;											// shr
+	case 11: r = d << (s & 31);  nc = d >> 31;  break;											// shl
+	case 12: r = (s & 31) ? (d >> (s & 31)) | (c ? ~0u << (32 - (s & 31)) : 0) : d;  nc = d & 1;  break;	// rcr
+	case 13: r = (s & 31) ? (d << (s & 31)) | (c ? ~0u >> (32 - (s & 31)) : 0) : d;  nc = d >> 31;  break;	// rcl
+	case 14: r = (uint32_t)((int32_t)d >> (s & 31));  nc = d & 1;  break;						// sar
+	case 16: nc = (int32_t)d < (int32_t)s;  r = nc ? s : d;  break;								// mins
+	case 17: nc = (int32_t)d < (int32_t)s;  r = nc ? d : s;  break;								// maxs
+	case 18: nc = d < s;  r = nc ? s : d;  break;												// min
+	case 19: nc = d < s;  r = nc ? d : s;  break;												// max
+	case 20: r = (d & ~0x1FFu) | (s & 0x1FF);  break;											// movs
+	case 21: r = (d & ~(0x1FFu << 9)) | ((s & 0x1FF) << 9);  break;								// movd
+	case 22: r = (d & ~(0x1FFu << 23)) | ((s & 0x1FF) << 23);  break;							// movi
+	case 23: r = (d & ~0x1FFu) | (uint32_t)next;  next = s & 511;  break;						// jmpret / jmp / call / ret
+	case 24: r = d & s;  nc = Parity( r );  break;												// and / test
+	case 25: r = d & ~s;  nc = Parity( r );  break;												// andn
+	case 26: r = d | s;  nc = Parity( r );  break;												// or
+	case 27: r = d ^ s;  nc = Parity( r );  break;												// xor
+	case 28: r = (d & ~s) | (c ? s : 0);  nc = Parity( r );  break;								// muxc
+	case 29: r = (d & ~s) | (!c ? s : 0);  nc = Parity( r );  break;							// muxnc
+	case 30: r = (d & ~s) | (z ? s : 0);  nc = Parity( r );  break;								// muxz
+	case 31: r = (d & ~s) | (!z ? s : 0);  nc = Parity( r );  break;							// muxnz
+	case 32: r = d + s;  nc = r < d;  break;													// add
+	case 33: r = d - s;  nc = d < s;  break;													// sub / cmp
+	case 40: r = s;  nc = s >> 31;  break;														// mov
+	case 41: r = -s;  nc = s >> 31;  break;														// neg
+	case 42: r = ((int32_t)s < 0) ? -s : s;  nc = s >> 31;  break;								// abs
+	case 48: r = d - s;  nc = (int32_t)d < (int32_t)s;  break;									// cmps
+	case 52: r = d + s;  nc = (((d ^ ~s) & (d ^ r)) >> 31) != 0;  break;						// adds
+	case 53: r = d - s;  nc = (((d ^ s) & (d ^ r)) >> 31) != 0;  break;							// subs
+	case 57:																					// djnz
+		r = d - 1;
+		nc = d == 0;
+		if( r != 0 ) next = s & 511;
+		else clocks = 8;
+		break;
+	case 58: if( d != 0 ) next = s & 511; else clocks = 8;  nc = false;  break;				// tjnz
+	case 59: if( d == 0 ) next = s & 511; else clocks = 8;  nc = false;  break;				// tjz
+	case 60:																					// waitpeq
+	case 61:																					// waitpne
+		if( !WaitPins( s, d, op == 60, until ) ) return;		// Still waiting - run it again next time
+		clocks = 6;
+		break;
+	case 62:																					// waitcnt
+	{
+		uint64_t wake = Now + 2 + (uint32_t)(d - (uint32_t)(Now + 2));
+		if( wake > until ) { Now = until;  return; }
+		Now = wake;
+		clocks = 6;
+		r = d + s;
+		nc = r < d;
+		break;
+	}
+	default:
+		printf( "  PASM at $%03X: opcode %d isn't emulated\n", pc, op );
+		Failed = true;
+		return;
+	}
+
+	nz = (r == 0);
+	if( op == 33 || op == 48 ) nz = (d == s);			// cmp and cmps compare, whatever gets written
+
+	if( wr ) cog[da] = r;
+	if( wz ) z = nz;
+	if( wc ) c = nc;
+
+	Now += clocks;
+	pc = next;
+}
@@ -0,0 +1,63 @@
+#ifndef PASMCOG_H
+#define PASMCOG_H
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Runs the PASM in a driver's .spin file, as one cog would.  Instructions are encoded the same way as
+// on the Propeller, so self-modifying code works, and the timing follows the P8X32A - 4 clocks per
+// instruction, 8 to 23 for hub access, and waits that last until the counter or pins say otherwise.
+// Time is in clocks, 64 bits so it never wraps, and CNT is the low 32 bits of it.
+//
+// Only the DAT section is assembled, with the instructions the drivers here use.  Running anything
+// else stops the cog and sets Failed.
+
+class PASM_COG
+{
+public:
+	PASM_COG( uint8_t * hub, int hubSize );
+
+	bool Load( const char * spinFile );				// Assembles the DAT section, false with a message if it can't
+	int  Label( const char * name ) const;			// Cog address of a label, -1 if there isn't one
+
+	void Start( uint32_t par, uint64_t time );		// Loads the cog image and starts at address 0
+	void RunUntil( uint64_t time );
+
+	void SetIna( uint64_t time, uint32_t pins );	// INA from this time on - times have to go forward
+	uint32_t Reg( int addr ) const { return cog[addr & 511]; }
+
+	uint64_t Now;
+	bool Failed;
+
+private:
+	struct LINE {
+		int number;
+		std::string label, cond, op, dest, src;
+		bool wz, wc, wr, nr;
+		int addr;
+	};
+
+	bool Parse( const std::string & text );
+	bool Assemble( LINE & line, uint32_t & code );
+	bool Eval( const std::string & expr, const std::string & scope, uint32_t & value );
+	uint32_t Ina( uint64_t time ) const;
+	bool WaitPins( uint32_t mask, uint32_t value, bool equal, uint64_t until );
+	uint64_t HubTime(void) const;
+	void Step( uint64_t until );
+
+	uint8_t * hub;
+	int hubSize;
+	uint32_t image[512];
+	uint32_t cog[512];
+	int pc;
+	bool c, z;
+	uint32_t par;
+
+	std::vector<LINE> lines;
+	std::map<std::string, uint32_t> symbols;
+	std::vector<std::pair<uint64_t, uint32_t> > ina;
+};
+
+#endif
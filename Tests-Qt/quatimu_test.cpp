@@ -0,0 +1,157 @@
+#include <math.h>
+#include <stdlib.h>
+#include "tests.h"
+#include "../Firmware-C/quatimu.h"
+
+// IMU orientation.  quatimu.cpp runs as written, with its F32 streams run by the stand-in in f32cog.cpp.
+// IMU axes are X right, Y up, Z forward, and the sensors are mounted so that in IMU axes the
+// accelerometer reads ( -AX, AZ, AY ) and the compass ( MX, MZ, MY ).
+
+static const double PI = 3.14159265358979323846;
+static const double OneG = 4096.0 * 16.0;		// 16 summed samples
+
+
+// Rows are the world axes in body (IMU) axes, from a quaternion w, x, y, z
+static void ToMatrix( const double * q, double m[3][3] )
+{
+	double w = q[0], x = q[1], y = q[2], z = q[3];
+	m[0][0] = 1 - 2*(y*y + z*z);	m[0][1] = 2*(x*y - w*z);		m[0][2] = 2*(x*z + w*y);
+	m[1][0] = 2*(x*y + w*z);		m[1][1] = 1 - 2*(x*x + z*z);	m[1][2] = 2*(y*z - w*x);
+	m[2][0] = 2*(x*z - w*y);		m[2][1] = 2*(y*z + w*x);		m[2][2] = 1 - 2*(x*x + y*y);
+}
+
+static double Dot( const double * a, const double * b ) {
+	return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+// QuatIMU_Start converts the command streams in place, so it can only run once
+static void StartIMU(void)
+{
+	static bool started = false;
+	if( !started ) QuatIMU_Start();
+	started = true;
+}
+
+static double Random( void ) {
+	return rand() / (double)RAND_MAX * 2.0 - 1.0;
+}
+
+
+// Sets the orientation from what the sensors would read in orientation q, and returns the angle
+// between the true and estimated up vectors, and the heading the field has in the estimate
+static void InitFrom( const double * q, const double * field, double & tiltErr, double & headingErr )
+{
+	double m[3][3];
+	ToMatrix( q, m );
+	const double * up = m[1];
+
+	double mb[3];			// The field in body axes
+	for( int i = 0; i < 3; i++ ) mb[i] = m[0][i] * field[0] + m[1][i] * field[1] + m[2][i] * field[2];
+
+	int accel[3] = { (int)lround( -up[0] * OneG ), (int)lround( up[2] * OneG ), (int)lround( up[1] * OneG ) };
+	int mag[3] = { (int)lround( mb[0] * 500.0 ), (int)lround( mb[2] * 500.0 ), (int)lround( mb[1] * 500.0 ) };
+	QuatIMU_InitOrientation( accel, mag );
+
+	float * fq = QuatIMU_GetQuaternion();	// x, y, z, w
+	double e[4] = { fq[3], fq[0], fq[1], fq[2] };
+	CHECK_NEAR( sqrt( e[0]*e[0] + e[1]*e[1] + e[2]*e[2] + e[3]*e[3] ), 1.0, 1e-5 );
+
+	double me[3][3];
+	ToMatrix( e, me );
+	double cosTilt = Dot( me[1], up );
+	tiltErr = acos( cosTilt > 1.0 ? 1.0 : cosTilt ) * 180.0 / PI;
+
+	// The estimate should put the level part of the field straight along +Z
+	double mw[3];
+	for( int i = 0; i < 3; i++ ) mw[i] = Dot( me[i], mb );
+	headingErr = atan2( mw[0], mw[2] ) * 180.0 / PI;
+}
+
+
+void Test_InitOrientation(void)
+{
+	StartIMU();
+
+	// Level with no compass is no rotation at all
+	int level[3] = { 0, 0, (int)OneG }, none[3] = { 0, 0, 0 };
+	QuatIMU_InitOrientation( level, none );
+	float * q = QuatIMU_GetQuaternion();
+	CHECK_NEAR( q[0], 0.0, 1e-6 );
+	CHECK_NEAR( q[1], 0.0, 1e-6 );
+	CHECK_NEAR( q[2], 0.0, 1e-6 );
+	CHECK_NEAR( q[3], 1.0, 1e-6 );
+
+	// Any orientation, with the field dipping steeply.  The float quaternion alone is good to a few
+	// hundredths of a degree, so these only allow for that
+	static const double field[3] = { 0.3, -0.8, 0.9 };
+	double worstTilt = 0.0, worstHeading = 0.0;
+	srand( 1 );
+	for( int i = 0; i < 5000; i++ )
+	{
+		// Uniform random rotations - points in the unit 4-ball, pushed out to its surface
+		double r[4], len2;
+		do {
+			for( int j = 0; j < 4; j++ ) r[j] = Random();
+			len2 = r[0]*r[0] + r[1]*r[1] + r[2]*r[2] + r[3]*r[3];
+		} while( len2 > 1.0 || len2 < 0.01 );
+		for( int j = 0; j < 4; j++ ) r[j] /= sqrt( len2 );
+
+		double tilt, heading;
+		InitFrom( r, field, tilt, heading );
+		if( tilt > worstTilt ) worstTilt = tilt;
+		if( fabs( heading ) > worstHeading ) worstHeading = fabs( heading );
+	}
+	CHECK( worstTilt < 0.1 );
+	CHECK( worstHeading < 0.5 );
+}
+
+
+// Runs the IMU for a number of seconds at the update rate, level, with the gyro reading X and Y off zero
+static void RunLevel( int seconds, int biasX, int biasY )
+{
+	int sensors[11] = { biasX, biasY, 0,  0, 0, 4096,  0, 0, 0,  0, 0 };	// gyro, accel, compass, alt, alt rate
+	for( int i = 0; i < seconds * 250; i++ ) {
+		QuatIMU_Update( sensors, 80000000 / 250 );
+	}
+}
+
+static void StartLevel(void)
+{
+	int level[3] = { 0, 0, 4096 }, none[3] = { 0, 0, 0 };
+	QuatIMU_SetGyroZero( 0, 0, 0 );
+	QuatIMU_InitOrientation( level, none );
+}
+
+
+void Test_GyroBias(void)
+{
+	StartIMU();
+	int zero[3];
+
+	// Disarmed, a gyro sitting off zero is learned within half a minute
+	QuatIMU_SetArmed( false );
+	StartLevel();
+	RunLevel( 30, 20, -15 );
+	QuatIMU_GetGyroZero( zero );
+	CHECK_NEAR( zero[0], 20, 1 );
+	CHECK_NEAR( zero[1], -15, 1 );
+	CHECK( zero[2] == 0 );
+
+	// Arming keeps what was learned, and it holds
+	QuatIMU_SetArmed( true );
+	QuatIMU_GetGyroZero( zero );
+	CHECK_NEAR( zero[0], 20, 1 );
+	RunLevel( 10, 20, -15 );
+	QuatIMU_GetGyroZero( zero );
+	CHECK_NEAR( zero[0], 20, 1 );
+	CHECK_NEAR( zero[1], -15, 1 );
+
+	// Armed, the same offset from scratch is only a small part learned in the same time
+	StartLevel();
+	RunLevel( 30, 20, -15 );
+	QuatIMU_GetGyroZero( zero );
+	CHECK( zero[0] > 0 && zero[0] <= 5 );
+	CHECK( zero[1] < 0 && zero[1] >= -4 );
+
+	QuatIMU_SetArmed( false );
+}
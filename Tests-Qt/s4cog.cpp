@@ -0,0 +1,52 @@
+#include <propeller.h>
+#include "s4cog.h"
+
+// The first three members of S4_COGVARS - the cog is handed these and nothing else about the indices
+struct S4_REFS {
+	volatile int * Rx_II_Ref[4];
+	int * Tx_II_Ref[4];
+	volatile int * Tx_EI_Ref[4];
+};
+
+static char TxBuf[4][128];
+static char RxBuf[4][128];
+static int TxSize, RxSize;
+
+static S4_REFS * Refs(void) { return (S4_REFS *)(HostCogDriver + 2); }		// Right after the signature
+
+
+void S4Cog_Start( int txSize, int rxSize )
+{
+	TxSize = txSize;
+	RxSize = rxSize;
+
+	S4_Initialize();
+	for( int port = Port_First; port <= Port_Last; port++ ) {
+		S4_Define_Port( port, 115200, port, TxBuf[port], (char)txSize, port + 4, RxBuf[port], (char)rxSize );
+		S4_Reset_Stats( port );
+	}
+	S4_Start();
+}
+
+int S4Cog_Transmit( char port, void * dest, int maxCount )
+{
+	int count = 0;
+	volatile int & ei = *Refs()->Tx_EI_Ref[(int)port];
+
+	while( count < maxCount && ei != *Refs()->Tx_II_Ref[(int)port] )
+	{
+		((char *)dest)[count++] = TxBuf[(int)port][ei];
+		ei = (ei + 1) % TxSize;
+	}
+	return count;
+}
+
+void S4Cog_Receive( char port, const void * src, int count )
+{
+	volatile int & ii = *Refs()->Rx_II_Ref[(int)port];
+
+	for( int i = 0; i < count; i++ ) {
+		RxBuf[(int)port][ii] = ((const char *)src)[i];
+		ii = (ii + 1) % RxSize;
+	}
+}
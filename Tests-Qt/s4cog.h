@@ -0,0 +1,13 @@
+#ifndef S4COG_H
+#define S4COG_H
+
+#include "../Firmware-C/serial_4x.h"
+
+// Stands in for the serial_4x cog.  It finds the ring indices through the same references the cog
+// is given, and only ever moves the indices the cog owns - Tx extraction and Rx insertion.
+
+void S4Cog_Start( int txSize, int rxSize );						// Initialize, define all 4 ports and start
+int  S4Cog_Transmit( char port, void * dest, int maxCount );	// Takes up to maxCount bytes from the Tx ring
+void S4Cog_Receive( char port, const void * src, int count );	// Puts bytes in the Rx ring, as if they'd arrived
+
+#endif
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "tests.h"
+#include "s4cog.h"
+#include "../Firmware-C/commlink.h"
+
+// Ring buffer logic of serial_4x.cpp - reserve / commit and the non-blocking puts at every position
+// in the ring, including blocks that wrap past the end, and the per-port statistics
+
+u16 Checksum( u16 checksum, u16 * buf, int len );		// commlink.cpp
+
+static const int TxSize = 16;
+static const int RxSize = 16;
+
+
+// Sends and transmits filler until the Tx indices are both at position
+static void MoveTxTo( char port, int position )
+{
+	char buf[TxSize];
+	while( S4_Reserve( port, 1 ) != position ) {
+		S4_Put( port, 0 );
+		S4Cog_Transmit( port, buf, TxSize );
+	}
+}
+
+
+static void TestReserveCommit(void)
+{
+	const char port = 1;
+	CHECK( S4_Tx_Free( port ) == TxSize - 1 );		// One slot is always left open, so full and empty differ
+
+	for( int start = 0; start < TxSize; start++ )
+	{
+		for( int count = 1; count < TxSize; count++ )
+		{
+			MoveTxTo( port, start );
+
+			int index = S4_Reserve( port, count );
+			CHECK( index == start );
+			if( index < 0 ) continue;
+
+			char * buf = S4_Tx_Buffer( port );
+			for( int i = 0; i < count; i++ ) {
+				buf[index] = (char)(start * 16 + i);
+				index = (index + 1) % S4_Tx_Size( port );
+			}
+
+			char sent[TxSize];
+			CHECK( S4Cog_Transmit( port, sent, TxSize ) == 0 );		// Nothing goes out until the commit
+
+			S4_Commit( port, index );
+			CHECK( S4_Tx_Free( port ) == TxSize - 1 - count );
+
+			int n = S4Cog_Transmit( port, sent, TxSize );
+			CHECK( n == count );
+			for( int i = 0; i < n; i++ ) CHECK( sent[i] == (char)(start * 16 + i) );
+		}
+	}
+
+	// Refused when it won't fit, without waiting, and without counting a drop - the caller may try again
+	S4_Reset_Stats( port );
+	MoveTxTo( port, 11 );
+	CHECK( S4_Reserve( port, TxSize ) < 0 );
+	S4_Put_Bytes( port, (void *)"0123456789", 10 );
+	for( int retry = 0; retry < 5; retry++ ) CHECK( S4_Reserve( port, 6 ) < 0 );
+	CHECK( S4_Reserve( port, 5 ) == (11 + 10) % TxSize );
+	CHECK( S4_Tx_Dropped( port ) == 0 );
+	CHECK( S4_Tx_High_Water( port ) == 10 );
+
+	// COMMLINK reports it once when it gives up on the packet
+	CHECK( COMMLINK::Reserve( port, 0x1A, 8 ) == 0 );
+	COMMLINK::Drop();
+	CHECK( S4_Tx_Dropped( port ) == 16 );
+
+	char sent[TxSize];
+	CHECK( S4Cog_Transmit( port, sent, TxSize ) == 10 );
+	CHECK( memcmp( sent, "0123456789", 10 ) == 0 );
+}
+
+
+static void TestPacketWrap(void)
+{
+	// A zero-copy packet that straddles the end of the ring arrives whole, with a good checksum
+	const char port = 2;
+	for( int start = 0; start < TxSize; start++ )
+	{
+		MoveTxTo( port, start );
+
+		u16 payload[2] = { 0x1234, (u16)(0xA500 + start) };
+		CHECK( COMMLINK::Reserve( port, 0x19, 4 ) == 1 );
+		COMMLINK::Write( payload, 4 );
+		COMMLINK::Commit();
+
+		u16 sent[6];
+		CHECK( S4Cog_Transmit( port, sent, sizeof(sent) ) == 12 );
+		CHECK( sent[0] == 0xAA55 && sent[1] == 0x19 && sent[2] == 12 );
+		CHECK( sent[3] == payload[0] && sent[4] == payload[1] );
+		CHECK( sent[5] == Checksum( 0, sent, 5 ) );
+	}
+}
+
+
+static void TestNonBlockingPuts(void)
+{
+	const char port = 3;
+	S4_Reset_Stats( port );
+	MoveTxTo( port, 13 );
+
+	// Try_Put takes bytes until the ring is full, and counts each one it refuses
+	int accepted = 0;
+	for( int i = 0; i < TxSize + 3; i++ ) accepted += S4_Try_Put( port, (char)i );
+	CHECK( accepted == TxSize - 1 );
+	CHECK( S4_Tx_Free( port ) == 0 );
+	CHECK( S4_Tx_Dropped( port ) == 4 );
+	CHECK( S4_Tx_High_Water( port ) == TxSize - 1 );
+
+	// Put_Partial takes what fits, wrapping, and counts the rest
+	char sent[TxSize];
+	CHECK( S4Cog_Transmit( port, sent, 6 ) == 6 );
+	CHECK( S4_Put_Partial( port, (void *)"abcdefghij", 10 ) == 6 );
+	CHECK( S4_Tx_Dropped( port ) == 4 + 4 );
+
+	CHECK( S4Cog_Transmit( port, sent, TxSize ) == TxSize - 1 );
+	for( int i = 0; i < TxSize - 1 - 6; i++ ) CHECK( sent[i] == (char)(i + 6) );
+	CHECK( memcmp( sent + TxSize - 1 - 6, "abcdef", 6 ) == 0 );
+}
+
+
+static void TestReceive(void)
+{
+	const char port = 0;
+	S4_Reset_Stats( port );
+
+	// Move the Rx indices close to the end, so the reads below wrap
+	char buf[RxSize];
+	S4Cog_Receive( port, "xxxxxxxxxxxx", 12 );
+	CHECK( S4_Get_Bytes_Timed( port, buf, 12, 0 ) == 1 );
+
+	CHECK( S4_Check( port ) == -1 );
+	S4Cog_Receive( port, "ABCDEFGH", 8 );
+	CHECK( S4_Rx_Count( port ) == 8 );
+	CHECK( S4_Peek( port ) == 'A' );
+	CHECK( S4_Check( port ) == 'A' );
+	CHECK( S4_Rx_High_Water( port ) == 8 );
+
+	CHECK( S4_Get_Bytes_Timed( port, buf, 8, 0 ) == 0 );		// Only 7 waiting - none are taken
+	CHECK( S4_Get_Bytes_Timed( port, buf, 7, 0 ) == 1 );
+	CHECK( memcmp( buf, "BCDEFGH", 7 ) == 0 );
+	CHECK( S4_Rx_Count( port ) == 0 );
+}
+
+
+void Test_SerialRings(void)
+{
+	S4Cog_Start( TxSize, RxSize );
+
+	TestReserveCommit();
+	TestPacketWrap();
+	TestNonBlockingPuts();
+	TestReceive();
+}
@@ -0,0 +1,6 @@
+#ifndef FDSERIAL_H
+#define FDSERIAL_H
+
+// Nothing the firmware files the tests build use from fdserial.h
+
+#endif
@@ -0,0 +1,23 @@
+#include <math.h>
+#include <propeller.h>
+
+volatile unsigned int CNT = 0;
+unsigned int CLKFREQ = 80000000;
+
+// The S4_COGVARS block is larger here than on the Propeller, since pointers are 64 bits, and
+// the signature is placed so the block after it is aligned for them
+alignas(8) uint32_t HostCogDriver[256] = { 0, 0x12345678 };
+
+
+// First quadrant of sine, 0 to 65535, in 2048 steps
+unsigned short HostRomSine[2049];
+
+static bool FillRomSine(void)
+{
+	for( int i = 0; i <= 2048; i++ ) {
+		HostRomSine[i] = (unsigned short)floor( sin( i / 2048.0 * 3.14159265358979323846 / 2.0 ) * 65535.0 + 0.5 );
+	}
+	return true;
+}
+
+static bool RomSineFilled = FillRomSine();
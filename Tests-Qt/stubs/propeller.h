@@ -0,0 +1,31 @@
+#ifndef PROPELLER_H
+#define PROPELLER_H
+
+// Just enough of propgcc's propeller.h for the firmware files the tests build.  There are no other
+// cogs here - a test that needs one stands in for it, using the same hub memory the cog would.
+
+#include <stdint.h>
+#include <string.h>
+
+extern volatile unsigned int CNT;
+extern unsigned int CLKFREQ;
+
+#define waitcnt(t)						((void)(t))
+#define cogstop(id)						((void)(id))
+
+// Cog drivers - every driver gets the same block of host memory, starting with the serial_4x
+// driver's signature, so S4_Initialize finds its variables right after it
+extern uint32_t HostCogDriver[];
+
+#define use_cog_driver(name)
+#define get_cog_driver(name)			(HostCogDriver)
+#define load_cog_driver(name, par)		(0)
+
+// Cogs started from C just don't start
+#define cogstart(func, par, stack, size)	((void)(func), (void)(stack), -1)
+
+// The sine table in the Propeller ROM, filled in the same way
+extern unsigned short HostRomSine[2049];
+#define ROM_SINE						(HostRomSine)
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef TESTS_H
+#define TESTS_H
+
+#include <stdio.h>
+
+// Each test is a function that runs its checks and reports anything that fails.  A failed check
+// doesn't stop the test, so one run shows everything that's wrong.
+
+extern int TestFailures;
+
+#define CHECK(cond)  do { \
+		if( !(cond) ) { printf( "  %s(%d): check failed: %s\n", __FILE__, __LINE__, #cond ); TestFailures++; } \
+	} while(0)
+
+#define CHECK_NEAR(a, b, tol)  do { \
+		double _a = (a), _b = (b); \
+		if( !(_a - _b <= (tol) && _b - _a <= (tol)) ) { \
+			printf( "  %s(%d): %s = %g, expected %g +/- %g\n", __FILE__, __LINE__, #a, _a, _b, (double)(tol) ); TestFailures++; \
+		} \
+	} while(0)
+
+
+void Test_CompactTelemetry(void);
+void Test_CrsfReceiver(void);
+void Test_GyroBias(void);
+void Test_GyroDrift(void);
+void Test_GyroFilters(void);
+void Test_InitOrientation(void);
+void Test_NoiseTrack(void);
+void Test_PrefsUpgrade(void);
+void Test_SerialRings(void);
+
+#endif